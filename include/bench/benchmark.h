@@ -0,0 +1,137 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "chip8/buffered_writer.h"
+#include "chip8/chip8.h"
+#include "chip8/chip8_types.h"
+
+// Time of one benchmark (nanoseconds per operation: one instruction, one
+// sprite drawn, ...)
+struct BenchmarkResult {
+  std::string name;
+  u64 operations;  // Timed in all samples together
+  double nanoseconds;  // Per operation in the fastest sample
+  double median_nanoseconds;
+};
+
+/*
+    Benchmark class:
+    Measures the speed of the core in three groups of benchmarks:
+    - handler/NAME: every handler of the Interpreter on its own, called
+      with an already decoded instruction (without fetch and dispatch)
+    - draw/..., clear/... and scroll/...: draw_sprite across sprite
+      heights and positions (also on the 128x64 display), clear_screen on
+      an empty and a full display, and the scrolls of a full display
+    - program/NAME: whole programs for a fixed number of instructions on
+      an execution engine (fetch, dispatch and timers included)
+
+    Every benchmark is timed in SAMPLES samples of about the same length,
+    the fastest one is the result (the least disturbed by the rest of the
+    machine). The results are written as JSON, two result files are
+    compared with compare.
+*/
+
+class Benchmark {
+ public:
+  static const u32 SAMPLES = 5;
+  static const u32 VERSION = 1;
+
+  // Only the benchmarks whose name contains filter run, each for about
+  // seconds in total
+  Benchmark(const std::string& filter, double seconds);
+
+  void run_handlers();
+  void run_display();
+  // Run every program for cycles instructions on engine
+  void run_programs(const std::vector<std::string>& programs, u32 cycles,
+                    Chip8Engine engine);
+
+  const std::vector<BenchmarkResult>& get_results() { return this->results; }
+
+  void write_json(BufferedWriter& out);
+  // Reads the files written by write_json
+  static bool read_json(const std::string& filename,
+                        std::vector<BenchmarkResult>& results);
+
+  // Table of the benchmarks in both result sets, returns the number of
+  // them that got slower by more than threshold percent
+  static u32 compare(const std::vector<BenchmarkResult>& before,
+                     const std::vector<BenchmarkResult>& after,
+                     double threshold, BufferedWriter& out);
+
+ private:
+  // Instructions of a handler benchmark between two restores (the stack
+  // has 16 levels)
+  static const u32 ROUND_SIZE = 16;
+
+  std::string filter;
+  double seconds;
+  std::vector<BenchmarkResult> results;
+
+  // Written into the JSON for the reader, not compared
+  std::string engine_name;
+  u32 program_cycles;
+
+  bool is_selected(const std::string& name) {
+    return name.find(this->filter) != std::string::npos;
+  }
+
+  // Time batch (returns the number of operations it executed) in SAMPLES
+  // samples and print the result
+  template <typename Batch>
+  void measure(const std::string& name, Batch batch);
+
+  static void print_result(const BenchmarkResult& result);
+
+  // Execute instruction count times on chip8 in rounds of ROUND_SIZE,
+  // restoring the program counter, I and the stack pointer before each
+  // round
+  static u32 execute_rounds(Chip8& chip8, const Instruction& instruction,
+                            u16 stack_pointer, u32 count);
+};
+
+template <typename Batch>
+void Benchmark::measure(const std::string& name, Batch batch) {
+  using Clock = std::chrono::steady_clock;
+  if (!this->is_selected(name)) {
+    return;
+  }
+
+  // The first batch warms up the caches and tells how many batches fit
+  // into the time of one sample
+  const auto start = Clock::now();
+  batch();
+  const double batch_seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  const double sample_seconds = this->seconds / SAMPLES;
+  const u64 batches =
+      batch_seconds >= sample_seconds ? 1 : sample_seconds / batch_seconds;
+
+  std::vector<double> samples;
+  u64 operations = 0;
+  for (u32 sample = 0; sample < SAMPLES; sample++) {
+    u64 sample_operations = 0;
+    const auto sample_start = Clock::now();
+    for (u64 i = 0; i < batches; i++) {
+      sample_operations += batch();
+    }
+    const double nanoseconds =
+        std::chrono::duration<double, std::nano>(Clock::now() - sample_start)
+            .count();
+    samples.push_back(sample_operations > 0 ? nanoseconds / sample_operations
+                                            : 0);
+    operations += sample_operations;
+  }
+
+  std::sort(samples.begin(), samples.end());
+  this->results.push_back(
+      BenchmarkResult{name, operations, samples[0], samples[SAMPLES / 2]});
+  this->print_result(this->results.back());
+}
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include <array>
+#include <vector>
+
+#include "chip8_types.h"
+
+class Chip8;
+
+/*
+    AotContext class:
+    The view of the Chip8 state used by code generated with
+    chip8-recompile. Simple instructions work directly on the registers,
+    everything else (display, random numbers, memory) is handed to the
+    Interpreter with interpret. Generated code counts the executed
+    instructions itself and only updates the timers with tick where it
+    matters (before interpreted instructions and when leaving a block).
+*/
+
+class AotContext {
+ public:
+  explicit AotContext(Chip8& chip8);
+
+  u8* const v;
+  u16* const stack;
+  u16& index_register;
+  u16& program_counter;
+  u16& stack_pointer;
+
+  // Decrement the timers for the given number of executed instructions
+  void tick(u32 ticks);
+
+  // Value of the delay timer after pending_ticks more instructions
+  u8 get_delay_timer(u32 pending_ticks);
+
+  bool is_key_pressed(u8 key);
+
+  // Execute the instruction at address with the Interpreter (including the
+  // timer update that follows every instruction)
+  void interpret(u16 address);
+
+ private:
+  Chip8& chip8;
+};
+
+// Native code of a basic block: returns the number of executed
+// instructions (at most budget) and leaves the program counter at the next
+// instruction
+typedef u32 (*AotFunction)(AotContext& context, u32 budget);
+
+struct AotBlock {
+  u16 start_address;
+  u16 end_address;  // One past the last byte of the block
+  u16 cycles;       // Instructions executed by one pass of the block
+  AotFunction function;
+};
+
+// A recompiled program: the ROM it was generated from and its blocks
+struct AotProgram {
+  const char* name;
+  const u8* rom;
+  u16 rom_size;
+  const AotBlock* blocks;
+  u16 block_count;
+};
+
+/*
+    AotEngine class:
+    Execution engine for programs recompiled ahead of time by
+    chip8-recompile and linked into the executable. The generated sources
+    register their program at startup. Whenever the memory holds a
+    registered program, its blocks run instead of the Interpreter. Blocks
+    whose bytes no longer match the original program (self-modifying
+    code), computed jumps into unknown code and programs without recompiled
+    code fall back to the Interpreter.
+*/
+
+class AotEngine {
+ public:
+  explicit AotEngine(Chip8& chip8);
+
+  u32 run(u32 cycles);
+  void flush();
+
+  static bool register_program(const AotProgram& program);
+
+  // Returns the registered program whose ROM is rom (followed by zeros
+  // only), nullptr if there is none
+  static const AotProgram* find_program(const u8* rom, u32 size);
+
+ private:
+  Chip8& chip8;
+  const AotProgram* program;
+
+  // Enabled block starting at each address (nullptr = interpret)
+  std::array<const AotBlock*, 4096> block_at;
+
+  void attach();
+  void invalidate_written_memory();
+  bool is_unmodified(const AotBlock& block);
+
+  static std::vector<AotProgram>& programs();
+};
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef ARGUMENTS_H
+#define ARGUMENTS_H
+
+#include <limits>
+#include <string>
+
+#include "chip8_types.h"
+
+// Parse the whole text as an unsigned number: digits only (no sign, no
+// spaces), decimal or with base 0 also 0x hexadecimal and 0 octal.
+// False if the text is anything else or does not fit into a u64.
+bool parse_number(const std::string& text, u64& value, int base = 10);
+// Parse the whole text as a finite decimal number
+bool parse_number(const std::string& text, double& value);
+
+// Parse the value of a command line option into value if it is a number
+// in [minimum, maximum], otherwise report it and return false
+bool parse_option(const std::string& option, const std::string& text,
+                  u64& value, u64 minimum, u64 maximum, int base = 10);
+bool parse_option(const std::string& option, const std::string& text,
+                  double& value, double minimum, double maximum);
+
+// The same for narrower options, by default up to the largest value of
+// their type
+template <typename T>
+bool parse_option(const std::string& option, const std::string& text,
+                  T& value, u64 minimum,
+                  u64 maximum = std::numeric_limits<T>::max()) {
+  u64 number;
+  if (!parse_option(option, text, number, minimum, maximum)) {
+    return false;
+  }
+  value = static_cast<T>(number);
+  return true;
+}
+
+#endif
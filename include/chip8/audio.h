@@ -0,0 +1,150 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <atomic>
+#include <vector>
+
+#include "chip8_types.h"
+
+// Format and buffering of the generated sound (mono, signed 16 bit)
+struct AudioSettings {
+  u32 sample_rate = 44100;
+  u32 tone_frequency = 440;  // Hz of the square wave
+  i16 amplitude = 4000;      // Of the square wave, 0 = silent
+  // Most sound buffered between the emulation and the audio device (at
+  // least two frames), more is dropped (overrun). The device starts
+  // playing at half of it.
+  u32 latency_ms = 60;
+  // Samples the audio device requests at a time
+  u32 device_samples = 512;
+
+  u32 get_latency_samples() const {
+    const u32 samples =
+        static_cast<u64>(this->sample_rate) * this->latency_ms / 1000;
+    const u32 minimum = 2 * (this->sample_rate / 60 + 1);
+    return samples > minimum ? samples : minimum;
+  }
+};
+
+/*
+    AudioRing class:
+    Wait-free ring of samples between one producer thread (the emulation)
+    and one consumer thread (the audio device). Each side only stores its
+    own position and loads the other one, so neither ever waits, locks or
+    allocates: write copies what fits and read copies what is there.
+    Overruns (sound the consumer had no room for) and underruns (sound the
+    consumer asked for before it was produced) are counted by the side that
+    notices them and can be read from any thread.
+*/
+
+class AudioRing {
+ public:
+  // capacity is rounded up to a power of two
+  explicit AudioRing(u32 capacity);
+
+  AudioRing(const AudioRing&) = delete;
+  AudioRing& operator=(const AudioRing&) = delete;
+
+  // Producer: copy up to count samples, returns the number copied
+  u32 write(const i16* samples, u32 count);
+  // Consumer: copy up to count samples, returns the number copied
+  u32 read(i16* samples, u32 count);
+
+  // Samples buffered (the other side may change it at any time)
+  u32 get_size() {
+    return this->written.load(std::memory_order_acquire) -
+           this->consumed.load(std::memory_order_acquire);
+  }
+  u32 get_capacity() { return this->mask + 1; }
+
+  void record_overrun() {
+    this->overruns.fetch_add(1, std::memory_order_relaxed);
+  }
+  void record_underrun() {
+    this->underruns.fetch_add(1, std::memory_order_relaxed);
+  }
+  u64 get_overruns() { return this->overruns.load(std::memory_order_relaxed); }
+  u64 get_underruns() {
+    return this->underruns.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::vector<i16> samples;
+  u32 mask;
+
+  // Samples written and read since the start, on separate cache lines so
+  // the two threads do not contend for one
+  alignas(64) std::atomic<u64> written;
+  alignas(64) std::atomic<u64> consumed;
+  std::atomic<u64> overruns;
+  std::atomic<u64> underruns;
+};
+
+/*
+    AudioGenerator class:
+    Produces the sound of a Chip8 in emulated time (see Chip8::set_audio):
+    every frame adds 1/60 second of samples to the ring, a square wave at
+    the tone frequency while the sound timer is not zero and silence
+    otherwise. The fraction of a sample left over by a frame is carried to
+    the next one, so 60 frames are exactly sample_rate samples, and the
+    wave starts at the same phase with every tone, so the stream only
+    depends on the emulated program.
+    A frame that would buffer more than the latency of the settings is
+    dropped as a whole and counted as an overrun (e.g. in turbo mode).
+*/
+
+class AudioGenerator {
+ public:
+  static const u32 FRAMES_PER_SECOND = 60;
+
+  explicit AudioGenerator(const AudioSettings& settings);
+
+  const AudioSettings& get_settings() { return this->settings; }
+  AudioRing& get_ring() { return this->ring; }
+
+  // One frame of emulated time, sound is the sound timer being non-zero
+  void run_frame(bool sound);
+
+  // Samples generated (including dropped ones)
+  u64 get_samples() { return this->samples; }
+
+ private:
+  const AudioSettings settings;
+  AudioRing ring;
+  u32 latency_samples;
+
+  // The samples of one frame (allocated once)
+  std::vector<i16> frame;
+  u32 remainder;  // Sixtieths of a sample carried to the next frame
+  u32 phase;      // Of the square wave, in 1 / sample_rate periods
+  u64 samples;
+};
+
+/*
+    NullAudioSink class:
+    Consumer of an AudioRing without an audio device (headless runs). It
+    drains the ring whenever called and keeps counts and a hash of the
+    samples, so tests can check the generated sound.
+*/
+
+class NullAudioSink {
+ public:
+  NullAudioSink()
+      : samples(0), tone_samples(0), hash(0xCBF29CE484222325ull) {}
+
+  // Read everything buffered in ring
+  void drain(AudioRing& ring);
+
+  u64 get_samples() { return this->samples; }
+  // Samples that are not silent
+  u64 get_tone_samples() { return this->tone_samples; }
+  // 64-bit FNV-1a over the bytes of the samples
+  u64 get_hash() { return this->hash; }
+
+ private:
+  u64 samples;
+  u64 tone_samples;
+  u64 hash;
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <memory>
+
+#include "chip8.h"
+#include "chip8_types.h"
+#include "thread_pool.h"
+
+/*
+    Chip8Batch class:
+    Many independent Chip8 instances stepped in parallel on a ThreadPool.
+    Every instance runs its own frame budget (instructions per frame) and
+    shares the decoder table with all others. An instance that faults is
+    halted while the rest of the batch keeps running.
+*/
+
+class Chip8Batch {
+ public:
+  // 0 threads = one per hardware thread
+  explicit Chip8Batch(u32 size, u32 threads = 0);
+
+  // Copy the program into every instance (see Chip8::save_rom)
+  bool load_program(const void* source, u32 size);
+  void set_engine(Chip8Engine engine);
+  void set_timer_mode(Chip8TimerMode mode);
+  void set_quirks(Chip8Quirks quirks);
+  // Seed every instance with its own stream (the index), so the instances
+  // get independent random numbers
+  void set_random_seed(u64 seed);
+  void set_frame_budget(u32 index, u32 cycles_per_frame);
+
+  // Run frames frames on every instance that is not halted, returns the
+  // total number of executed instructions
+  u64 run_frames(u32 frames);
+
+  u32 size() { return this->count; }
+  u32 get_thread_count() { return this->pool.get_thread_count(); }
+  bool is_halted(u32 index) { return this->halted[index]; }
+  Chip8& operator[](u32 index) { return this->instances[index]; }
+
+ private:
+  // Instances stepped by one task of the pool: large enough to keep the
+  // scheduling overhead small, small enough to balance the workers
+  static const u32 INSTANCES_PER_TASK = 16;
+
+  u32 count;
+  std::unique_ptr<Chip8[]> instances;
+  std::unique_ptr<u32[]> cycles_per_frame;
+  std::unique_ptr<bool[]> halted;
+  ThreadPool pool;
+};
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#include <array>
+#include <vector>
+
+#include "chip8_types.h"
+#include "decoder.h"
+
+class Chip8;
+
+// Superinstructions: frequent pairs of instructions that are fused into a
+// single operation of a block. They continue the numbering of Operation.
+enum Superinstruction : u8 {
+  // [6xnn, 6ynn]: LD Vx, byte; LD Vy, byte
+  kSetTwoRegisters = kOperationCount,
+  // [Annn, Dxyn]: LD I, addr; DRW Vx, Vy, nibble
+  kSetIndexRegisterAndDraw,
+  // [Fx07, 3xnn]: LD Vx, DT; SE Vx, byte (delay timer spin loop)
+  kLoadDelayTimerAndSkipIfEqual,
+  // [Fx07, 4xnn]: LD Vx, DT; SNE Vx, byte
+  kLoadDelayTimerAndSkipIfNotEqual,
+};
+
+// One operation of a translated block: a single instruction or a fused
+// pair of instructions (first and second)
+struct BlockInstruction {
+  u8 operation;  // Operation or Superinstruction
+  u8 cycles;     // Number of Chip-8 instructions covered (1 or 2)
+  u16 opcode;    // Operation code of the last covered instruction
+  u16 next_address;
+  // Timers are updated lazily within a block, except before instructions
+  // that read or set them and before drawing (also fused), so they are up
+  // to date whenever the display changes
+  bool synchronize_timers;
+  Instruction first;
+  Instruction second;
+};
+
+// A straight-line run of instructions starting at start_address. Only the
+// last instruction of a block can jump or write to memory, skip
+// instructions in between leave the block early when taken.
+struct Block {
+  u16 start_address;
+  u16 end_address;  // One past the last byte of the block
+  u16 cycles;
+  u16 size;
+  u32 first_instruction;  // Index into BlockCache::instructions
+  u64 pages;              // Bit mask of the 64 byte pages the block covers
+  u16 successor;          // Index + 1 of the block executed after this one
+  bool valid;
+};
+
+/*
+    BlockCache class:
+    Execution engine that translates straight-line runs of instructions
+    from memory into cached blocks of already decoded (and partially fused)
+    instructions. Blocks are executed by the Interpreter without fetching or
+    decoding anything. Whenever the program writes to memory covered by a
+    block, the block is dropped and translated again on its next use, so
+    self-modifying programs stay correct.
+*/
+
+class BlockCache {
+ public:
+  explicit BlockCache(Chip8& chip8);
+
+  u32 run(u32 cycles);
+  void flush();
+
+  // Returns the index + 1 of the block starting at address (0 = none) and
+  // translates it if necessary. previous is the index + 1 of the block
+  // executed before, its successor link is followed or updated.
+  u16 find(u16 address, u16 previous) {
+    if (previous != 0) {
+      const u16 successor = this->blocks[previous - 1].successor;
+      if (successor != 0 && this->blocks[successor - 1].valid &&
+          this->blocks[successor - 1].start_address == address) {
+        return successor;
+      }
+    }
+
+    // Addresses outside of the memory are handled by the interpreter
+    if (address > 0x0FFF) {
+      return 0;
+    }
+
+    u16 index = this->block_at[address];
+    if (index == 0) {
+      index = this->translate(address);
+    }
+
+    // Translating can flush the cache, in which case previous is stale
+    if (previous != 0 && previous <= this->blocks.size()) {
+      this->blocks[previous - 1].successor = index;
+    }
+
+    return index;
+  }
+
+  const Block& get_block(u16 index) { return this->blocks[index - 1]; }
+  const BlockInstruction* get_instructions(const Block& block) {
+    return &this->instructions[block.first_instruction];
+  }
+
+  // Drop the blocks overlapping the memory written by the program since the
+  // last call. Returns true if any block was dropped.
+  bool invalidate_written_memory();
+
+ private:
+  // Blocks end after this many instructions even without a branch
+  static const u16 MAXIMUM_BLOCK_SIZE = 32;
+  // Flush everything once the instruction pool grows beyond this size
+  static const u32 MAXIMUM_INSTRUCTIONS = 16384;
+
+  Chip8& chip8;
+
+  // Index + 1 of the block starting at each address (0 = not translated)
+  std::array<u16, 4096> block_at;
+  std::vector<Block> blocks;
+  std::vector<BlockInstruction> instructions;
+  u64 code_pages;
+
+  u16 translate(u16 address);
+
+  static bool ends_block(Operation operation);
+  static bool synchronizes_timers(u8 operation);
+  static bool fuse(BlockInstruction& previous, const Instruction& next);
+};
+
+#endif
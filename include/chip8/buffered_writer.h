@@ -0,0 +1,51 @@
+#ifndef BUFFERED_WRITER_H
+#define BUFFERED_WRITER_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "chip8_types.h"
+
+/*
+    BufferedWriter class:
+    Collects text in a fixed buffer and hands it to the file in large
+    writes, so output made of many small pieces (one operand at a time)
+    costs one fwrite per buffer instead of one per piece. Write errors are
+    remembered and reported by flush.
+*/
+
+class BufferedWriter {
+ public:
+  static const size_t DEFAULT_CAPACITY = 64 * 1024;
+
+  // The file stays open when the writer is destroyed (after a flush)
+  explicit BufferedWriter(std::FILE* file, size_t capacity = DEFAULT_CAPACITY);
+  ~BufferedWriter();
+
+  BufferedWriter(const BufferedWriter&) = delete;
+  BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+  void write(const char* data, size_t size);
+  BufferedWriter& operator<<(char character);
+  BufferedWriter& operator<<(const char* text);
+  BufferedWriter& operator<<(const std::string& text);
+  BufferedWriter& operator<<(u64 value);
+
+  // Upper case hexadecimal with at least digits digits (no prefix)
+  void write_hex(u32 value, int digits);
+  // Pads with spaces to the given column of the current line
+  void pad_to(size_t column);
+
+  // Returns false if any write failed
+  bool flush();
+
+ private:
+  std::FILE* file;
+  std::vector<char> buffer;
+  size_t used;
+  size_t line_start;  // Position of the current line in the buffer
+  bool failed;
+};
+
+#endif
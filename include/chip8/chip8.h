@@ -2,55 +2,269 @@
 #define CHIP8_H
 
 #include <array>
-#include <functional>
-#include <unordered_map>
+#include <string>
+#include <type_traits>
 
 #include "chip8_types.h"
 #include "display.h"
 #include "keypad.h"
+#include "profiler.h"
 #include "random.h"
 
+// Reasons why the Chip8 stopped executing instructions. The program counter
+// is left at the instruction that faulted, which is not executed.
+// kStackOverflow: 2nnn with all 16 levels of the stack in use
+// kStackUnderflow: 00EE with an empty stack
+enum Chip8Fault { kNoFault, kUnknownOpcode, kStackOverflow, kStackUnderflow };
+
+// How instructions are executed
+// kInterpreterEngine: fetch, decode and execute one instruction at a time
+// kBlockCacheEngine: execute cached blocks of already decoded instructions
+// kJitEngine: execute hot code compiled to native code (x86-64 Linux only)
+// kAotEngine: execute code recompiled ahead of time by chip8-recompile
+enum Chip8Engine {
+  kInterpreterEngine,
+  kBlockCacheEngine,
+  kJitEngine,
+  kAotEngine
+};
+
+// When the delay and sound timers tick
+// kInstructionTimers: once per executed instruction
+// kFrameTimers: once per frame of emulated time (see Chip8::run_frame), at
+// 60 Hz independent of the number of instructions per frame
+enum Chip8TimerMode { kInstructionTimers, kFrameTimers };
+
+// Which interpreter a program was written for (see quirks.h)
+// kDefaultQuirks: the behaviour of this emulator, on every engine
+// kCosmacVipQuirks, kChip48Quirks, kSuperChipQuirks: the COSMAC VIP,
+// CHIP-48 and SUPER-CHIP 1.1, on the interpreter and the BlockCache only
+enum Chip8Quirks {
+  kDefaultQuirks,
+  kCosmacVipQuirks,
+  kChip48Quirks,
+  kSuperChipQuirks
+};
+
+/*
+    Chip8State struct:
+    The complete architectural state of a Chip8 (memory, registers, stack,
+    timers, display, keypad and random number generator) in one trivially
+    copyable block aligned to a cache line. A snapshot is a single copy of
+    this struct (see Chip8::snapshot and Chip8::restore).
+*/
+
+struct alignas(64) Chip8State {
+  std::array<u8, 4096> memory;
+  std::array<u8, 16> general_purpose_variable_registers;
+  std::array<u16, 16> stack;
+  u16 stack_pointer;
+  u16 index_register;
+  u16 program_counter;
+  u16 current_opcode;
+  u8 delay_timer;
+  u8 sound_timer;
+  Chip8Fault fault;
+  // Instructions executed since the last reset (input movies are keyed by
+  // it, see Movie)
+  u64 cycles;
+
+  Display display;
+  Keypad keypad;
+  Random rand;
+};
+
+static_assert(std::is_trivially_copyable<Chip8State>::value,
+              "Snapshots copy the Chip8State as a whole");
+
+class AotEngine;
+class AudioGenerator;
+class BlockCache;
+class ExecutionTrace;
+class Jit;
+template <typename Quirks>
+class BasicInterpreter;
+
 class Chip8 {
  public:
   Chip8();
   ~Chip8();
 
-  void save_rom(const void* source);
+  // A Chip8 owns its execution engines
+  Chip8(const Chip8&) = delete;
+  Chip8& operator=(const Chip8&) = delete;
+
+  // Copy a program of size bytes to 0x200 and clear the rest of the program
+  // area (false if it does not fit)
+  bool save_rom(const void* source, u32 size);
   void cycle();
+  u32 run(u32 cycles);
+  // Run one frame of cycles instructions, generate its sound (see
+  // set_audio), then tick the timers once if they tick per frame (and the
+  // Chip8 did not fault)
+  u32 run_frame(u32 cycles);
   void reset();
 
+  // Hash over the complete architectural state (memory, registers, stack,
+  // timers, display and random number generator). Two machines with equal
+  // hashes behave identically (the cycle counter is not part of it).
+  // Without random_state the generator is left out, which compares
+  // machines seeded on different streams (e.g. the instances of a batch).
+  u64 get_state_hash(bool random_state = true);
+
+  void set_engine(Chip8Engine engine);
+  Chip8Engine get_engine() { return this->engine; }
+
+  // Copy the complete architectural state into state (a single copy)
+  void snapshot(Chip8State& state) { state = this->state; }
+  // Continue from a snapshot: the execution engines drop everything they
+  // derived from the old memory and the whole display is redrawn
+  void restore(const Chip8State& state);
+  const Chip8State& get_state() { return this->state; }
+
+  // Restart the random numbers (Cxnn) with a seed and stream (see Random).
+  // reset keeps the seed and restarts its sequence.
+  void set_random_seed(u64 seed, u64 stream = 0) {
+    this->state.rand.set_seed(seed, stream);
+  }
+  u64 get_random_seed() { return this->state.rand.get_seed(); }
+
+  // Record every instruction into trace (nullptr to stop). A traced Chip8
+  // runs on the interpreter, whatever its engine (see ExecutionTrace).
+  void set_trace(ExecutionTrace* trace) { this->trace = trace; }
+  ExecutionTrace* get_trace() { return this->trace; }
+
+  // Count the execution into profiler (nullptr to stop). The hooks are in
+  // the interpreter and only built with CHIP8_PROFILER (see Profiler).
+  void set_profiler(Profiler* profiler) { this->profiler = profiler; }
+
+  // Generate one frame of sound into audio per run_frame, from the sound
+  // timer before the tick (nullptr = silent)
+  void set_audio(AudioGenerator* audio) { this->audio = audio; }
+
+  // The JIT and AotEngine only implement kDefaultQuirks, a Chip8 with
+  // another profile runs on the interpreter instead
+  void set_quirks(Chip8Quirks quirks) { this->quirks = quirks; }
+  Chip8Quirks get_quirks() { return this->quirks; }
+  // "default", "vip", "chip48" and "schip"
+  static const char* get_quirks_name(Chip8Quirks quirks);
+  static bool parse_quirks(const std::string& name, Chip8Quirks& quirks);
+
+  // Skip the instructions of idle loops instead of executing them (on by
+  // default): a run that starts in a loop which cannot end before the run
+  // does (see skip_idle_loop) only applies the effect of its instructions,
+  // the state is the same as if they were executed
+  void set_idle_skipping(bool enabled) { this->idle_skipping = enabled; }
+  // Instructions skipped that way since the Chip8 was created
+  u64 get_skipped_cycles() { return this->skipped_cycles; }
+  // True if nothing but a key can change the Chip8 any more: it waits for
+  // a key (Fx0A) or jumps to itself, and both timers are stopped. Until
+  // the next key event every frame only adds to the instruction count.
+  bool is_waiting_for_input();
+
+  void set_timer_mode(Chip8TimerMode mode);
+  Chip8TimerMode get_timer_mode() { return this->timer_mode; }
+  void tick_timers() {
+    // The timers tick once per frame of emulated time
+    CHIP8_PROFILE(*this, end_frame());
+    if (this->state.delay_timer > 0) {
+      --this->state.delay_timer;
+    }
+    if (this->state.sound_timer > 0) {
+      --this->state.sound_timer;
+    }
+  }
+
  public:
-  void set_key(u8 key, bool state) { this->keypad.set_key(key, state); }
+  // Key 0 - F of the keypad went down (state true) or up
+  void set_key(u8 key, bool state) { this->state.keypad.set_key(key, state); }
   bool get_draw_flag() { return this->draw_flag; }
   void deactivate_draw_flag() { this->draw_flag = false; }
-  Display& get_display() { return *this->display; }
+  Display& get_display() { return this->state.display; }
+  Chip8Fault get_fault() { return this->state.fault; }
+  // "unknown opcode", "stack overflow", ...
+  static const char* get_fault_name(Chip8Fault fault);
+  u16 get_current_opcode() { return this->state.current_opcode; }
+  u16 get_program_counter() { return this->state.program_counter; }
+  u64 get_cycles() { return this->state.cycles; }
 
  private:
-  typedef std::unordered_map<u8, std::function<void()> > instruction_subset;
-  std::unordered_map<u8, instruction_subset> instructions;
+  // First member, so the Chip8 keeps the alignment of the state
+  Chip8State state;
 
   bool draw_flag;
+  Chip8Engine engine;
+  Chip8TimerMode timer_mode;
+  Chip8Quirks quirks;
 
-  u16 current_opcode;
-  u8 delay_timer;
-  u16 index_register;
-  u16 program_counter;
-  u8 sound_timer;
-  u16 stack_pointer;
+  BlockCache* block_cache;
+  Jit* jit;
+  AotEngine* aot;
+  ExecutionTrace* trace;
+  Profiler* profiler;
+  AudioGenerator* audio;
+  bool idle_skipping;
+  u64 skipped_cycles;
 
-  std::array<u8, 16> general_purpose_variable_registers;
-  std::array<u8, 4096> memory;
-  std::array<u16, 16> stack;
+  // Range of memory written by the program since an execution engine last
+  // looked at it (used to detect self-modifying code)
+  bool memory_written;
+  u16 memory_written_begin;
+  u16 memory_written_end;
 
-  Display* display;
-  Keypad keypad;
-  Random rand;
+  u16 read_opcode(u16 address) {
+    return this->state.memory[address & 0x0FFFu] << 8 |
+           this->state.memory[(address + 1) & 0x0FFFu];
+  }
+  // If the program counter is in one of the idle loops Fx0A (no key
+  // pressed), 1nnn (to itself) or Fx07, 3x00, 1nnn (back to Fx07, while
+  // the delay timer ticking per frame is not zero), which only end by a
+  // key or a timer tick between runs: apply the effect of the next cycles
+  // instructions and return cycles, otherwise 0
+  u32 skip_idle_loop(u32 cycles);
+
+  // The range wraps around the end of the memory like the accesses of
+  // Fx33 and Fx55 (address may be beyond it)
+  void mark_memory_written(u16 address, u16 length) {
+    address &= 0x0FFFu;
+    if (address + length > 4096) {
+      this->extend_memory_written(0, address + length - 4096);
+      this->extend_memory_written(address, 4096);
+    } else {
+      this->extend_memory_written(address, address + length);
+    }
+  }
+  void extend_memory_written(u16 address, u16 end) {
+    if (address >= end) {
+      return;
+    }
+
+    if (!this->memory_written) {
+      this->memory_written = true;
+      this->memory_written_begin = address;
+      this->memory_written_end = end;
+      return;
+    }
 
-  void bind_instructions();
+    if (address < this->memory_written_begin) {
+      this->memory_written_begin = address;
+    }
+    if (end > this->memory_written_end) {
+      this->memory_written_end = end;
+    }
+  }
 
-  // Enable the Interpreter class to access
-  // private and protected members of the Chip8 class
-  friend class Interpreter;
+  // Enable the interpreters and the execution engines to access private
+  // and protected members of the Chip8 class
+  template <typename Quirks>
+  friend class BasicInterpreter;
+  friend class BlockCache;
+  friend class Jit;
+  friend class AotContext;
+  friend class AotEngine;
+  friend class Chip8Lockstep;
+  // The handler benchmarks of chip8-bench set up the state directly
+  friend class Benchmark;
 };
 
 #endif
\ No newline at end of file
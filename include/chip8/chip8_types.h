@@ -1,3 +1,8 @@
+#ifndef CHIP8_TYPES_H
+#define CHIP8_TYPES_H
+
+#include <cstdint>
+
 // 8 bits = 1 byte -> [0-255] or [0x00-0xFF]
 // = unsigned char
 typedef uint8_t u8;
@@ -13,4 +18,10 @@ typedef uint32_t u32;
 // 64 bits = 8 bytes
 // -> [0-18446744073709551615] or [0x0000000000000000-0xFFFFFFFFFFFFFFFF]
 // = unsigned long long
-typedef uint64_t u64;
\ No newline at end of file
+typedef uint64_t u64;
+
+// Signed 16 bits -> [-32768-32767] (audio samples)
+// = short
+typedef int16_t i16;
+
+#endif
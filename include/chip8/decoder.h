@@ -0,0 +1,107 @@
+#ifndef DECODER_H
+#define DECODER_H
+
+#include <array>
+
+#include "chip8_types.h"
+
+// List of all operations known to the interpreter as (Name, handler) pairs.
+// The handler is the name of the corresponding member function of the
+// Interpreter class. The list is expanded wherever we need one entry per
+// operation (enum values, dispatch labels) so they never go out of sync.
+// The display extensions of the SUPER-CHIP and XO-CHIP follow the
+// operations of the Chip-8.
+#define CHIP8_OPERATIONS(OPERATION)                                          \
+  OPERATION(ClearScreen, clear_screen)                                       \
+  OPERATION(ReturnFromSubroutine, return_from_subroutine)                    \
+  OPERATION(JumpToLocation, jump_to_location)                                \
+  OPERATION(CallSubroutine, call_subroutine)                                 \
+  OPERATION(SkipIfEqual, skip_next_instruction_if_equal)                     \
+  OPERATION(SkipIfNotEqual, skip_next_instruction_if_not_equal)              \
+  OPERATION(SkipIfVxEqualVy, skip_next_instruction_if_vx_equal_vy)           \
+  OPERATION(SetVx, set_general_purpose_variable_registers)                   \
+  OPERATION(AddToVx, add_to_general_purpose_variable_registers)              \
+  OPERATION(LoadVyInVx, load_vy_in_vx)                                       \
+  OPERATION(OrVxVy, set_vx_to_bitwise_or_of_vx_and_vy)                       \
+  OPERATION(AndVxVy, set_vx_to_bitwise_and_of_vx_and_vy)                     \
+  OPERATION(XorVxVy, set_vx_to_bitwise_xor_of_vx_and_vy)                     \
+  OPERATION(AddVyToVx, add_vy_to_vx)                                         \
+  OPERATION(SubtractVyFromVx, subtract_vy_from_vx)                           \
+  OPERATION(ShiftRight, shift_vx_by_one_to_right)                            \
+  OPERATION(SetVxToVyMinusVx, set_vx_to_vy_minus_vx)                         \
+  OPERATION(ShiftLeft, shift_vx_by_one_to_left)                              \
+  OPERATION(SkipIfVxNotEqualVy, skip_next_instruction_if_vx_not_equal_vy)    \
+  OPERATION(SetIndexRegister, set_index_register)                            \
+  OPERATION(JumpToExtendedLocation, jump_to_extended_v0_location)            \
+  OPERATION(GenerateRandomNumber, generate_random_number)                    \
+  OPERATION(DrawSprite, draw_sprite)                                         \
+  OPERATION(SkipIfKeyPressed, skip_instruction_if_key_pressed)               \
+  OPERATION(SkipIfKeyNotPressed, skip_instruction_if_key_is_not_pressed)     \
+  OPERATION(SetVxToDelayTimer, set_vx_to_delay_timer)                        \
+  OPERATION(WaitForKeyPressed, wait_for_key_pressed)                         \
+  OPERATION(SetDelayTimer, set_delay_timer_to_vx)                            \
+  OPERATION(SetSoundTimer, set_sound_timer_to_vx)                            \
+  OPERATION(AddVxToI, add_i_to_vx)                                           \
+  OPERATION(SetIToSpriteCharacter, set_i_to_sprite_character_in_vx)          \
+  OPERATION(StoreBinaryCodedDecimal, store_binary_coded_decimal_of_vx)       \
+  OPERATION(StoreRegisters, store_registers_at_i)                            \
+  OPERATION(LoadRegisters, load_registers_from_i)                            \
+  OPERATION(ScrollDown, scroll_down)                                         \
+  OPERATION(ScrollUp, scroll_up)                                             \
+  OPERATION(ScrollRight, scroll_right)                                       \
+  OPERATION(ScrollLeft, scroll_left)                                         \
+  OPERATION(LowResolution, disable_high_resolution)                          \
+  OPERATION(HighResolution, enable_high_resolution)                          \
+  OPERATION(DrawLargeSprite, draw_large_sprite)                              \
+  OPERATION(SelectPlanes, select_planes)
+
+#define CHIP8_OPERATION_ENUM(name, handler) k##name,
+
+// kUnknown is always the first value, so a zero initialized Instruction
+// traps instead of executing anything
+enum Operation : u8 {
+  kUnknown,
+  CHIP8_OPERATIONS(CHIP8_OPERATION_ENUM) kOperationCount
+};
+
+#undef CHIP8_OPERATION_ENUM
+
+// Operations that can halt the Chip8 (see Chip8Fault) besides kUnknown
+constexpr bool can_fault(Operation operation) {
+  return operation == kReturnFromSubroutine || operation == kCallSubroutine;
+}
+
+// A decoded operation code with all operands already extracted:
+// x   = second nibble (register Vx)
+// y   = third nibble (register Vy)
+// n   = last nibble
+// nn  = last byte
+// nnn = last 12 bits (address)
+struct Instruction {
+  Operation operation;
+  u8 x;
+  u8 y;
+  u8 n;
+  u8 nn;
+  u16 nnn;
+};
+
+/*
+    Decoder class:
+    Translates every possible operation code (0x0000 - 0xFFFF) exactly once
+    into an Instruction. The resulting table is immutable and shared by all
+    Chip8 instances, so decoding at runtime is a single indexed load.
+*/
+
+class Decoder {
+ public:
+  typedef std::array<Instruction, 0x10000> Table;
+
+  static const Table& table();
+  static const Instruction& decode(u16 opcode) { return table()[opcode]; }
+
+ private:
+  static Instruction decode_opcode(u16 opcode);
+};
+
+#endif
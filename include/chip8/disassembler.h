@@ -1,23 +1,120 @@
 #ifndef DISASSEMBLER_H
 #define DISASSEMBLER_H
 
+#include <array>
+#include <map>
 #include <string>
+#include <vector>
 
+#include "buffered_writer.h"
 #include "chip8_types.h"
+#include "decoder.h"
+
+// What a byte of the program is, as found by Disassembler::analyze
+enum DisassembledByte : u8 {
+  kUnreachedByte,  // Neither reached as code nor referenced as data
+  kCodeByte,       // First byte of a reachable instruction
+  kOperandByte,    // Second byte of a reachable instruction
+  kSpriteByte,     // Drawn by Dxyn with a known I
+  kDataByte        // Read or written through I (Fx33, Fx55, Fx65) or
+                   // loaded into I but never drawn
+};
+
+// Why an address has a label (bit mask)
+enum DisassemblerLabel : u8 {
+  kJumpLabel = 1 << 0,
+  kCallLabel = 1 << 1,
+  kDataLabel = 1 << 2
+};
+
+// How a basic block continues
+// kFallThroughEdge: the next instruction (also a skip that is not taken)
+// kSkipEdge: the instruction after the next (skip taken)
+// kJumpEdge: 1nnn
+// kCallEdge: 2nnn, the block continues with a kReturnEdge after the call
+// kTableEdge: an entry of a jump table of Bnnn
+enum DisassemblerEdge {
+  kFallThroughEdge,
+  kSkipEdge,
+  kJumpEdge,
+  kCallEdge,
+  kReturnEdge,
+  kTableEdge
+};
+
+struct DisassembledBlock {
+  u16 start_address;
+  u16 end_address;  // One past the last byte of the block
+  u16 instructions;
+  std::vector<std::pair<u16, DisassemblerEdge>> successors;
+};
+
+enum DisassemblerGraphFormat { kDotGraph, kJsonGraph };
+
+/*
+    Disassembler class:
+    Separates the code of a Chip-8 program from its data and writes it as
+    labelled assembly (Cowgod's mnemonics) and as control flow graph.
+    analyze follows the control flow from 0x200 (jumps, calls, returns,
+    both sides of skips and jump tables of Bnnn) and tracks the value of I
+    along the way, so the sprites drawn by Dxyn and the bytes used by Fx33,
+    Fx55 and Fx65 are known as data. A linear sweep over the bytes that
+    are neither shows which of them would decode as instructions (code
+    only reached through computed jumps).
+*/
 
 class Disassembler {
  public:
   Disassembler();
-  ~Disassembler();
 
-  void load_program(std::string filename);
+  bool load_program(const std::string& filename);
+  // A program from memory, e.g. as passed to Chip8::save_rom (trailing
+  // zero bytes are dropped)
+  void load_program(const void* program, u32 size, const std::string& name);
+
+  void analyze();
+
+  void write_listing(BufferedWriter& out);
+  void write_graph(BufferedWriter& out, DisassemblerGraphFormat format);
+  // Mnemonic and operands of one instruction, addresses inside the analyzed
+  // program (if any) as labels
+  void write_instruction(BufferedWriter& out, u16 opcode);
+
+  const std::string& get_program_name() { return this->program_name; }
+  u32 get_program_size() { return this->program_size; }
+  u32 get_instruction_count();
+  u32 get_block_count() { return this->blocks.size(); }
+  u32 get_byte_count(DisassembledByte kind);
 
  private:
-  u16 program_counter;
-  u16 maximum_address_count;
-  std::streampos program_size;
+  static const u16 PROGRAM_START = 0x200;
+  // I is unknown (set by Fx1E, Fx29 or a path where it was not set yet)
+  static constexpr u16 UNKNOWN_INDEX = 0xFFFF;
+  // Values of I an instruction is traced with at most
+  static const u8 MAXIMUM_INDEX_VALUES = 4;
+
+  std::string program_name;
+  u32 program_size;
+  std::array<u8, 4096> memory;
+  std::array<DisassembledByte, 4096> bytes;
+  std::array<u8, 4096> labels;
+  std::map<u16, DisassembledBlock> blocks;
+
+  u16 get_program_end() { return PROGRAM_START + this->program_size; }
+  u16 get_opcode(u16 address) {
+    return this->memory[address] << 8 | this->memory[address + 1];
+  }
+  bool is_code(u16 address) {
+    return address < 4096 && this->bytes[address] == kCodeByte;
+  }
+
+  void trace(u16 entry);
+  void mark_data(u16 address, u16 length, DisassembledByte kind);
+  void find_blocks();
 
-  const int PROGRAM_STARTING_LOCATION;
+  void write_label(BufferedWriter& out, u16 address);
+  void write_address(BufferedWriter& out, u16 address);
+  void write_data(BufferedWriter& out, u16 address, u16 end);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -2,31 +2,153 @@
 #define DISPLAY_H
 
 #include <array>
-#include <cstring>
 
 #include "chip8_types.h"
 
+/*
+    Display class:
+    Framebuffer of up to two bit planes (XO-CHIP) in the low resolution
+    64x32 mode of the Chip-8 or the high resolution 128x64 mode of the
+    SUPER-CHIP. Every row of a plane is two u64 words whose most
+    significant bits are the leftmost pixels: a low resolution row is the
+    first word alone, so a sprite row is drawn with one shift, one XOR and
+    one AND for the collision; a high resolution row spans both words.
+    Scrolling moves whole rows (vertically) or shifts whole words
+    (horizontally), never single pixels.
+    Drawing, clearing and scrolling only affect the planes selected with
+    select_planes (the first plane unless a program selects others).
+    Rows changed since the consumer last cleared them are marked in a dirty
+    bit mask (bit y = row y), so unchanged rows need not be processed again.
+*/
+
 class Display {
  public:
-  const int get_width() { return this->WIDTH; }
-  const int get_height() { return this->HEIGHT; }
-  const int get_scale() { return this->SCALE; }
+  static const int PLANES = 2;
+
+  int get_width() {
+    return this->high_resolution ? HIGH_RES_WIDTH : LOW_RES_WIDTH;
+  }
+  int get_height() {
+    return this->high_resolution ? HIGH_RES_HEIGHT : LOW_RES_HEIGHT;
+  }
+  // Window pixels per pixel, the window has the same size in both modes
+  int get_scale() { return WINDOW_WIDTH / this->get_width(); }
+
+  bool is_high_resolution() { return this->high_resolution; }
+  // Switch between 64x32 and 128x64 pixels, which clears all planes
+  void set_high_resolution(bool enabled);
+
+  // Bit p of mask selects plane p
+  void select_planes(u8 mask) { this->planes = mask & ((1u << PLANES) - 1); }
+  u8 get_selected_planes() { return this->planes; }
+
+  // False if the members hold values that no Display reaches (a plane
+  // mask beyond PLANES or a bool that is neither 0 nor 1), e.g. in a state
+  // read from a file
+  bool is_valid() const;
+
+  void clear_screen() {
+    for (int plane = 0; plane < PLANES; plane++) {
+      if ((this->planes & (1u << plane)) == 0) {
+        continue;
+      }
+      for (int y = 0; y < this->get_height(); y++) {
+        std::array<u64, 2>& row = this->rows[plane][y];
+        if ((row[0] | row[1]) != 0) {
+          row = {};
+          this->dirty_rows |= 1ull << y;
+        }
+      }
+    }
+  }
+
+  // XOR a sprite of height rows of 8 pixels onto the display. The start
+  // coordinate wraps around the display, pixels beyond the right and bottom
+  // edges are clipped. With several planes selected the sprite holds
+  // height bytes for each of them, in the order of the planes. Returns
+  // true if a set pixel was cleared (collision).
+  bool draw_sprite(u8 x, u8 y, const u8* sprite, u8 height) {
+    if (this->high_resolution || this->planes != 1) {
+      return this->draw_planes(x, y, sprite, height, 1);
+    }
 
-  void clear_screen() { std::memset(pixels.data(), 0, WIDTH * HEIGHT); }
+    x %= LOW_RES_WIDTH;
+    y %= LOW_RES_HEIGHT;
+    if (height > LOW_RES_HEIGHT - y) {
+      height = LOW_RES_HEIGHT - y;
+    }
+
+    u64 collision = 0;
+    for (u8 row = 0; row < height; row++) {
+      const u64 pixels = static_cast<u64>(sprite[row]) << 56 >> x;
+      u64& word = this->rows[0][y + row][0];
+      collision |= word & pixels;
+      word ^= pixels;
+      if (pixels != 0) {
+        this->dirty_rows |= 1ull << (y + row);
+      }
+    }
+
+    return collision != 0;
+  }
+
+  // Same for a sprite of 16 rows of 16 pixels (two bytes per row, 32 bytes
+  // per plane)
+  bool draw_large_sprite(u8 x, u8 y, const u8* sprite) {
+    return this->draw_planes(x, y, sprite, 16, 2);
+  }
+
+  // Move the selected planes down or up by count rows, or right or left by
+  // 4 pixels (of the current resolution). Pixels moved off the display
+  // are lost, the pixels moved in are cleared.
+  void scroll_down(u8 count);
+  void scroll_up(u8 count);
+  void scroll_right();
+  void scroll_left();
 
-  u8& operator[](int index) {
-    if (index > pixels.size()) {
-      throw std::out_of_range("index out of range");
+  // Bit p is set if the pixel is set in plane p
+  u8 get_pixel(int x, int y) {
+    u8 pixel = 0;
+    for (int plane = 0; plane < PLANES; plane++) {
+      pixel |= ((this->rows[plane][y][x >> 6] >> (63 - (x & 63))) & 1u)
+               << plane;
     }
-    return pixels[index];
+    return pixel;
+  }
+  // Pixels of row y of a plane, the most significant bit of word 0 is the
+  // leftmost pixel (word 1 is empty in low resolution)
+  u64 get_row(int y, int word = 0, int plane = 0) {
+    return this->rows[plane][y][word];
   }
+  // True if only the first plane of the low resolution display was ever
+  // used since the last mode switch, so get_row(y) is the whole display
+  bool is_basic() {
+    return !this->high_resolution && this->planes == 1 &&
+           this->is_plane_empty(1);
+  }
+
+  // Bit y is set if row y changed since the last clear_dirty_rows
+  u64 get_dirty_rows() { return this->dirty_rows; }
+  void clear_dirty_rows() { this->dirty_rows = 0; }
+  void mark_all_rows_dirty() { this->dirty_rows = ~0ull; }
 
  private:
-  static const int HEIGHT = 32;
-  static const int SCALE = 10;
-  static const int WIDTH = 64;
+  static const int LOW_RES_WIDTH = 64;
+  static const int LOW_RES_HEIGHT = 32;
+  static const int HIGH_RES_WIDTH = 128;
+  static const int HIGH_RES_HEIGHT = 64;
+  static const int WINDOW_WIDTH = 640;
+
+  // rows[plane][y][word]
+  std::array<std::array<std::array<u64, 2>, HIGH_RES_HEIGHT>, PLANES> rows{};
+  u64 dirty_rows = ~0ull;
+  bool high_resolution = false;
+  u8 planes = 1;
 
-  std::array<u8, WIDTH * HEIGHT> pixels;
+  // draw_sprite and draw_large_sprite on any plane in any resolution,
+  // width is the number of bytes per sprite row
+  bool draw_planes(u8 x, u8 y, const u8* sprite, u8 height, u8 width);
+  bool is_plane_empty(int plane);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,11 +1,36 @@
 #ifndef INTERPRETER_H
 #define INTERPRETER_H
 
+#include "block_cache.h"
 #include "chip8.h"
-
-class Interpreter {
+#include "decoder.h"
+#include "quirks.h"
+
+/*
+    BasicInterpreter class:
+    Executes the instructions of a Chip8 one at a time (or the blocks of a
+    BlockCache), templated on the quirk profile it implements (see
+    quirks.h). Interpreter is the DefaultQuirks profile; a Chip8 runs the
+    instantiation of its profile (see run_interpreter).
+*/
+
+template <typename Quirks>
+class BasicInterpreter {
  public:
-  explicit Interpreter(Chip8& chip8) : chip8(chip8) {}
+  explicit BasicInterpreter(Chip8& chip8)
+      : chip8(chip8), instruction(nullptr) {}
+
+  // Execute up to the given number of instructions and return how many were
+  // actually executed (less if the Chip8 faults on the way)
+  u32 execute(u32 cycles);
+
+  // Same as execute, but runs the blocks of already decoded (and partially
+  // fused) instructions translated by the BlockCache
+  u32 execute_blocks(BlockCache& cache, u32 cycles);
+
+  // Execute a single instruction fetched by the caller: the program counter
+  // already points to the next instruction and the timers are not updated
+  void execute_fetched(const Instruction& instruction);
 
   // Standard Chip-8 Instructions:
   // [Opcode, Type]: Syntax for assembly language - Explanation
@@ -13,11 +38,15 @@ class Interpreter {
   //
   // ! Not supported:
   // ! [0nnn, Call]: SYS addr - Jump to a machine code routine at nnn
-  // ! Super Chip-48 Instructions
+  // ! SUPER-CHIP 00FD, Fx30, Fx75 and Fx85, and XO-CHIP apart from its
+  // ! bit planes (audio, 16-bit addresses, register ranges)
 
-  // Helpers
-  u8 get_x();
-  u8 get_y();
+  // Helpers: operands of the current (already decoded) instruction
+  u8 get_x() { return this->instruction->x; }
+  u8 get_y() { return this->instruction->y; }
+  u8 get_n() { return this->instruction->n; }
+  u8 get_nn() { return this->instruction->nn; }
+  u16 get_nnn() { return this->instruction->nnn; }
 
   // [00E0, Display]: CLS - Clear display
   void clear_screen();
@@ -66,14 +95,16 @@ class Interpreter {
   // If Vx is larger than Vy, then Vf is set to 1, otherwise 0
   void subtract_vy_from_vx();
 
-  // [8xy6, BitOp]: SHR Vx {, Vy} - Set Vx = Vx SHR 1
+  // [8xy6, BitOp]: SHR Vx {, Vy} - Set Vx = Vx SHR 1 (Vy SHR 1 with
+  // Quirks::SHIFT_VY)
   void shift_vx_by_one_to_right();
 
   // [8xy7, Math]: SUBN Vx, Vy - Set Vx = Vy - Vx
   // If Vy is larger than Vx, then Vf is set to 1, otherwise 0
   void set_vx_to_vy_minus_vx();
 
-  // [8xyE, BitOp]: SHL Vx {, Vy} - Set Vx = Vx SHL 1
+  // [8xyE, BitOp]: SHL Vx {, Vy} - Set Vx = Vx SHL 1 (Vy SHL 1 with
+  // Quirks::SHIFT_VY)
   void shift_vx_by_one_to_left();
 
   // [9xy0, Cond]: SNE Vx, Vy - Skip next instruction if Vx != Vy
@@ -83,6 +114,7 @@ class Interpreter {
   void set_index_register();
 
   // [Bnnn, Flow]: JP V0, addr - Jump to the location nnn plus V0
+  // (Bxnn: xnn plus Vx with Quirks::JUMP_VX)
   void jump_to_extended_v0_location();
 
   // [Cxnn, Rand]: RND Vx, byte - Set Vx to the result of a bitwise AND
@@ -130,8 +162,78 @@ class Interpreter {
   // [FX65, MEM]: LD Vx, [I] - Fill from V0 to Vx with values from memory @ I
   void load_registers_from_i();
 
+  // Display extensions of the SUPER-CHIP and XO-CHIP (see Display)
+
+  // [00Cn, Display]: SCD nibble - Scroll the display down by n rows
+  void scroll_down();
+
+  // [00Dn, Display]: SCU nibble - Scroll the display up by n rows (XO-CHIP)
+  void scroll_up();
+
+  // [00FB, Display]: SCR - Scroll the display right by 4 pixels
+  void scroll_right();
+
+  // [00FC, Display]: SCL - Scroll the display left by 4 pixels
+  void scroll_left();
+
+  // [00FE, Display]: LOW - Switch to 64x32 pixels (clears the display)
+  void disable_high_resolution();
+
+  // [00FF, Display]: HIGH - Switch to 128x64 pixels (clears the display)
+  void enable_high_resolution();
+
+  // [Dxy0, Display]: DRW Vx, Vy, 0 - Draw a 16x16 sprite at (Vx, Vy)
+  void draw_large_sprite();
+
+  // [Fn01, Display]: PLANE n - Select the planes drawn, cleared and
+  // scrolled by the mask n (XO-CHIP)
+  void select_planes();
+
  private:
   Chip8& chip8;
+  const Instruction* instruction;
+
+  // execute with or without appending every instruction to the trace of
+  // the Chip8
+  template <bool kTraced>
+  u32 execute_instructions(u32 cycles);
+  template <bool kTraced>
+  void fetch(const Instruction* decoded);
+  void update_timers();
+  void update_timers(u16 ticks);
+  void trap_unknown_opcode();
+  // Halt at the current instruction without executing it
+  void trap(Chip8Fault fault);
+  // After Fx55 and Fx65 of V0 - Vx (see Quirks::LOAD_STORE_INDEX)
+  void advance_index_register(u8 x);
+  // Each selected plane takes its own sprite data
+  u8 count_selected_planes();
 };
 
+using Interpreter = BasicInterpreter<DefaultQuirks>;
+
+// Call function (a generic lambda) with the interpreter of the quirk
+// profile of chip8 and return its result
+template <typename Function>
+u32 run_interpreter(Chip8& chip8, Function function) {
+  switch (chip8.get_quirks()) {
+    case kCosmacVipQuirks: {
+      BasicInterpreter<CosmacVipQuirks> interpreter(chip8);
+      return function(interpreter);
+    }
+    case kChip48Quirks: {
+      BasicInterpreter<Chip48Quirks> interpreter(chip8);
+      return function(interpreter);
+    }
+    case kSuperChipQuirks: {
+      BasicInterpreter<SuperChipQuirks> interpreter(chip8);
+      return function(interpreter);
+    }
+    default: {
+      Interpreter interpreter(chip8);
+      return function(interpreter);
+    }
+  }
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,87 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <array>
+#include <vector>
+
+#include "chip8_types.h"
+#include "decoder.h"
+
+class Chip8;
+
+// A compiled block: native code for the instructions between start_address
+// and end_address
+struct JitBlock {
+  u16 start_address;
+  u16 end_address;  // One past the last compiled byte
+  u16 cycles;       // Chip-8 instructions executed by one pass of the block
+  u32 code_offset;  // Offset of the native code in the code arena
+};
+
+// An exit of a compiled block to a known address that still returns to
+// Jit::run. It is patched to jump straight into the block compiled there.
+struct JitExit {
+  u16 target;
+  u32 jump_offset;  // Offset of the rel32 of the exit's jump in the arena
+};
+
+/*
+    Jit class:
+    Execution engine (Linux x86-64 only) that compiles hot regions of
+    Chip-8 code into native machine code in an executable memory arena.
+
+    Compiled code works directly on the Chip8 object. The general purpose
+    registers used by a block and the index register are kept in host
+    registers while the block runs, the program counter is only written
+    when leaving it. Blocks jump directly into each other as long as the
+    cycle budget allows, so hot loops do not leave native code. Instructions
+    that touch the display, the stack or the memory, or that set the timers,
+    are never compiled: the block exits and the Interpreter executes them.
+    Writing to memory covered by compiled code flushes all compiled code. On
+    other platforms the Jit simply runs the Interpreter.
+*/
+
+class Jit {
+ public:
+  explicit Jit(Chip8& chip8);
+  ~Jit();
+
+  static bool is_supported();
+
+  u32 run(u32 cycles);
+  void flush();
+
+ private:
+  // Signature of the native code of a block: returns the number of executed
+  // Chip-8 instructions, which never exceeds budget
+  typedef u32 (*NativeBlock)(Chip8* chip8, u32 budget);
+
+  // Number of times a block start is reached before it is compiled
+  static const u8 COMPILE_THRESHOLD = 4;
+  // Blocks end after this many instructions even without a branch
+  static const u16 MAXIMUM_BLOCK_SIZE = 64;
+  static const u32 ARENA_SIZE = 256 * 1024;
+
+  Chip8& chip8;
+
+  // Index + 1 of the compiled block starting at each address
+  std::array<u16, 4096> block_at;
+  std::array<u8, 4096> heat;
+  std::vector<JitBlock> blocks;
+  std::vector<JitExit> unlinked_exits;
+
+  u8* arena;
+  u32 arena_used;
+
+  NativeBlock lookup(u16 address, u16& cycles);
+  u16 compile(u16 address);
+  void link(const JitExit& exit, const JitBlock& block);
+  void invalidate_written_memory();
+  void update_timers(u32 ticks);
+  u16 count_cold_instructions(u16 address);
+
+  static bool is_compilable(u16 opcode);
+  static bool ends_cold_run(Operation operation);
+};
+
+#endif
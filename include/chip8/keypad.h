@@ -1,11 +1,14 @@
 #ifndef KEYPAD_H
 #define KEYPAD_H
 
-#include <array>
+#include "chip8_types.h"
 
 /*
     Keypad class:
-    Chip-8 hexadecimal keypad with 16 keys, ranging from 0 to F.
+    Chip-8 hexadecimal keypad with 16 keys, ranging from 0 to F, stored as
+    a 16-bit mask (bit k = key k is down). Which host keys or buttons press
+    which key is up to the frontend (see the InputMap of the SDL
+    executable, which defaults to the layout below).
 
     +----------------------+-----------------------+
     |   Chip-8 Keyboard    |    Keyboard Map       |
@@ -19,45 +22,34 @@
 
 class Keypad {
  public:
-  u8& operator[](u8 index) {
-    if (index > keys.size()) {
-      throw std::out_of_range("keys[] : index out of range");
-    }
-    return keys[index];
-  }
+  static const u8 KEYS = 16;
 
+  // Values of Vx beyond F name no key, which is never pressed
   bool is_pressed(u8 key) {
-    if (key > keys.size()) {
-      throw std::out_of_range("IsPressed : keys[] : index out of range");
+    return key < KEYS && (this->keys >> key & 1) != 0;
+  }
+
+  // Keys beyond F are ignored
+  void set_key(u8 key, bool state) {
+    if (key >= KEYS) {
+      return;
+    }
+    if (state) {
+      this->keys |= 1u << key;
+    } else {
+      this->keys &= ~(1u << key);
     }
-    return keys[kKeyMap[key]] == 1;
   }
 
-  void set_key(u8 key, bool state) { this->keys[key] = state; }
+  u16 get_keys() { return this->keys; }
 
-  u8 size() { return 16; }
+  u8 size() { return KEYS; }
 
  private:
-  std::array<u8, 256> keys{};
-
-  std::array<u8, 16> kKeyMap = {
-      0x31,  // 1
-      0x32,  // 2
-      0x33,  // 3
-      0x34,  // 4
-      0x71,  // Q
-      0x77,  // W
-      0x65,  // E
-      0x72,  // R
-      0x61,  // A
-      0x73,  // S
-      0x64,  // D
-      0x66,  // F
-      0x7a,  // Z
-      0x78,  // X
-      0x63,  // C
-      0x76,  // V
-  };
+  u16 keys = 0;
+
+  // Compiled code reads the keys directly
+  friend class Jit;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,134 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "chip8.h"
+#include "chip8_types.h"
+#include "lockstep_kernel.h"
+
+/*
+    Chip8Lockstep class:
+    Execution engine for many machines running the same program. The
+    registers, the index register, the program counter and the timers of
+    all machines (lanes) are kept in structure of arrays layout. The lanes
+    at the address of the first unfinished lane that see the same operation
+    code there form a group, which executes instructions together until the
+    lanes may diverge (skips, returns, computed jumps, memory writes):
+    arithmetic, skips, jumps, calls and timer instructions with SSE2/AVX2
+    kernels (see lockstep_kernel.h), drawing and memory instructions lane by
+    lane in the Interpreter. A lane that runs alone, or waits for a key,
+    finishes its budget in the Interpreter. Results are identical to running
+    every machine on its own.
+*/
+
+class Chip8Lockstep {
+ public:
+  explicit Chip8Lockstep(u32 size);
+
+  Chip8Lockstep(const Chip8Lockstep&) = delete;
+  Chip8Lockstep& operator=(const Chip8Lockstep&) = delete;
+
+  // Reset every lane and copy the program into it (see Chip8::save_rom)
+  bool load_program(const void* source, u32 size);
+  void set_key(u32 lane, u8 key, bool state) {
+    this->machines[lane].set_key(key, state);
+  }
+
+  // Timers of all lanes tick per instruction (default) or once per frame of
+  // run_frames, same as Chip8::run_frame
+  void set_timer_mode(Chip8TimerMode mode);
+  // Seed every lane with its own stream (the lane), same as
+  // Chip8Batch::set_random_seed
+  void set_random_seed(u64 seed);
+
+  // Execute frames frames of cycles_per_frame instructions on every lane
+  // that is not halted, returns the total number of executed instructions
+  u64 run_frames(u32 frames, u32 cycles_per_frame);
+  u64 run(u32 cycles) { return this->run_frames(1, cycles); }
+
+  u32 size() { return this->count; }
+  bool is_halted(u32 lane) { return this->halted[lane]; }
+
+  // The machine of a lane, with the registers of the lane written back.
+  // Only for inspection: changes to it are not seen by the lane.
+  Chip8& get_machine(u32 lane);
+
+  // Kernel used for the vectorized instructions: avx2, sse2 or portable.
+  // The best supported kernel is selected by default.
+  const char* get_kernel_name();
+  bool set_kernel(const std::string& name);
+
+ private:
+  u32 count;
+  std::unique_ptr<Chip8[]> machines;
+
+  // Registers in structure of arrays layout (see LockstepLanes)
+  std::vector<u8> general_purpose_variable_registers;
+  std::vector<u16> index_register;
+  std::vector<u16> program_counter;
+  std::vector<u8> delay_timer;
+  std::vector<u8> sound_timer;
+  std::vector<u8> group;
+  std::vector<u8> key_pressed;
+  std::vector<u16> return_address;
+  std::vector<u16> current_opcode;
+  LockstepLanes lanes;
+  LockstepKernel kernel;
+
+  // Instructions left in the current run and halted lanes (fault or
+  // exception)
+  std::vector<u32> remaining;
+  std::vector<u8> halted;
+
+  // 64 byte pages each lane has written since the program was loaded. All
+  // lanes hold the same program, so lanes that have not written the page
+  // of an instruction see the same operation code there without fetching.
+  std::vector<u64> written_pages;
+
+  u16 fetch(u32 lane) {
+    const u16 address = this->program_counter[lane] & 0x0FFFu;
+    const Chip8& machine = this->machines[lane];
+    return machine.state.memory[address] << 8 |
+           machine.state.memory[(address + 1) & 0x0FFFu];
+  }
+
+  u64 run_tile(u32 begin, u32 end);
+
+  // Executes the parts of an instruction that need the machine of each
+  // lane of the group, after steps instructions of the group. Returns the
+  // number of lanes dropped from the group because they halted.
+  u32 prepare_group(u32 begin, u32 end, const Instruction& instruction,
+                    u16 opcode, u32 steps);
+  // Take a halted lane out of the group, at the instruction opcode after
+  // steps instructions of the group
+  void drop_lane(u32 lane, u16 opcode, u32 steps);
+  // Execute an instruction in the Interpreter on the machine of a lane,
+  // copying only the given general purpose registers (bit mask). Returns
+  // false if the lane halted.
+  bool execute_lane(u32 lane, const Instruction& instruction, u16 registers);
+  void track_written_memory(u32 lane);
+
+  // Copy the registers of a lane from / to its machine
+  void load_lane(u32 lane);
+  void store_lane(u32 lane);
+  // Run a lane on its own in the Interpreter
+  u32 run_lane(u32 lane, u32 cycles);
+
+  // 64 byte pages holding the operation code at address
+  static u64 get_code_pages(u16 address) {
+    return 1ull << ((address & 0x0FFFu) >> 6) |
+           1ull << (((address + 1) & 0x0FFFu) >> 6);
+  }
+
+  // Instructions executed by a group (the others run lane by lane)
+  static bool is_group_instruction(Operation operation);
+  // Instructions after which all lanes of a group are still at the same
+  // address with the same code in memory
+  static bool keeps_group_together(Operation operation);
+  static u16 get_used_registers(const Instruction& instruction);
+};
+
+#endif
@@ -0,0 +1,312 @@
+#ifndef LOCKSTEP_KERNEL_H
+#define LOCKSTEP_KERNEL_H
+
+#include "chip8_types.h"
+#include "decoder.h"
+
+// Lanes are stored in multiples of this many lanes, so every kernel can
+// work on whole vectors (32 lanes = one AVX2 register of bytes)
+static const u32 LOCKSTEP_ALIGNMENT = 32;
+// Lanes executed together (a multiple of LOCKSTEP_ALIGNMENT): the machines
+// of a tile, about 6.5 KB each, should fit into the L2 cache
+static const u32 LOCKSTEP_TILE = 64;
+
+// Registers of all lanes in structure of arrays layout: element i of every
+// array belongs to lane i
+struct LockstepLanes {
+  u32 count;  // Multiple of LOCKSTEP_ALIGNMENT
+  u8* general_purpose_variable_registers[16];
+  u16* index_register;
+  u16* program_counter;
+  u8* delay_timer;
+  u8* sound_timer;
+  // 0xFF for the lanes that execute the current instruction, 0 otherwise
+  u8* group;
+  // Per lane inputs of instructions that need the machine of the lane
+  // (prepared by Chip8Lockstep::prepare_group): 0xFF if the key of a key
+  // skip is pressed, the return address of 00EE
+  u8* key_pressed;
+  u16* return_address;
+  // 1 if the timers tick per instruction, 0 if they tick per frame
+  u8 timer_tick;
+};
+
+// Executes one instruction on the lanes of the group between begin and end,
+// including the increment of the program counter and the timer update of
+// the Interpreter. Parts that need the machine of a lane are done before
+// (see Chip8Lockstep::prepare_group). begin is a multiple of
+// LOCKSTEP_ALIGNMENT.
+typedef void (*LockstepKernel)(LockstepLanes& lanes,
+                               const Instruction& instruction, u32 begin,
+                               u32 end);
+
+void execute_lockstep_portable(LockstepLanes& lanes,
+                               const Instruction& instruction, u32 begin,
+                               u32 end);
+#if defined(CHIP8_LOCKSTEP_SSE2)
+void execute_lockstep_sse2(LockstepLanes& lanes,
+                           const Instruction& instruction, u32 begin, u32 end);
+#endif
+#if defined(CHIP8_LOCKSTEP_AVX2)
+void execute_lockstep_avx2(LockstepLanes& lanes,
+                           const Instruction& instruction, u32 begin, u32 end);
+#endif
+
+// The kernel itself, written once against a Vector policy that provides
+// WIDTH byte lanes per Bytes value and WIDTH / WORDS word vectors for the
+// 16 bit registers. Every file compiled for another instruction set
+// instantiates it with its own policy (see lockstep_sse2.cpp and
+// lockstep_avx2.cpp), so no code compiled for one instruction set can leak
+// into the others.
+//
+// Loads and stores follow the order of the Interpreter exactly, so
+// instructions using VF as an operand give the same results.
+template <class Vector>
+void execute_lockstep(LockstepLanes& lanes, const Instruction& instruction,
+                      u32 begin, u32 end) {
+  typedef typename Vector::Bytes Bytes;
+  typedef typename Vector::Words Words;
+  static const u32 WIDTH = Vector::WIDTH;
+  static const u32 WORDS = Vector::WORDS;
+  static const u32 WORD_WIDTH = WIDTH / WORDS;
+
+  u8* const* v = lanes.general_purpose_variable_registers;
+  u8* const vx = v[instruction.x];
+  u8* const vy = v[instruction.y];
+  u8* const vf = v[0xF];
+
+  const Bytes zero = Vector::splat(0);
+  const Bytes one = Vector::splat(1);
+  const Bytes two = Vector::splat(2);
+
+  for (u32 lane = begin; lane < end; lane += WIDTH) {
+    const Bytes group = Vector::load(lanes.group + lane);
+    if (Vector::is_zero(group)) {
+      continue;
+    }
+
+    // Program counter step in bytes: 2 for the fetch plus 2 for a taken skip
+    Bytes step = Vector::and_(group, two);
+    // New program counter for jumps (jump = true)
+    bool jump = false;
+    Words target[WORDS];
+
+    switch (instruction.operation) {
+      case kSkipIfEqual:
+      case kSkipIfNotEqual: {
+        Bytes taken = Vector::equal(Vector::load(vx + lane),
+                                    Vector::splat(instruction.nn));
+        if (instruction.operation == kSkipIfNotEqual) {
+          taken = Vector::and_not(taken, group);
+        }
+        step = Vector::add(step, Vector::and_(Vector::and_(taken, group), two));
+        break;
+      }
+      case kSkipIfVxEqualVy:
+      case kSkipIfVxNotEqualVy: {
+        Bytes taken =
+            Vector::equal(Vector::load(vx + lane), Vector::load(vy + lane));
+        if (instruction.operation == kSkipIfVxNotEqualVy) {
+          taken = Vector::and_not(taken, group);
+        }
+        step = Vector::add(step, Vector::and_(Vector::and_(taken, group), two));
+        break;
+      }
+      case kSkipIfKeyPressed:
+      case kSkipIfKeyNotPressed: {
+        Bytes taken = Vector::load(lanes.key_pressed + lane);
+        if (instruction.operation == kSkipIfKeyNotPressed) {
+          taken = Vector::and_not(taken, group);
+        }
+        step = Vector::add(step, Vector::and_(Vector::and_(taken, group), two));
+        break;
+      }
+      case kSetVx:
+        Vector::store_masked(vx + lane, Vector::splat(instruction.nn), group);
+        break;
+      case kAddToVx:
+        Vector::store_masked(
+            vx + lane,
+            Vector::add(Vector::load(vx + lane), Vector::splat(instruction.nn)),
+            group);
+        break;
+      case kLoadVyInVx:
+        Vector::store_masked(vx + lane, Vector::load(vy + lane), group);
+        break;
+      case kOrVxVy:
+        Vector::store_masked(
+            vx + lane,
+            Vector::or_(Vector::load(vx + lane), Vector::load(vy + lane)),
+            group);
+        break;
+      case kAndVxVy:
+        Vector::store_masked(
+            vx + lane,
+            Vector::and_(Vector::load(vx + lane), Vector::load(vy + lane)),
+            group);
+        break;
+      case kXorVxVy:
+        Vector::store_masked(
+            vx + lane,
+            Vector::xor_(Vector::load(vx + lane), Vector::load(vy + lane)),
+            group);
+        break;
+      case kAddVyToVx: {
+        const Bytes x = Vector::load(vx + lane);
+        const Bytes y = Vector::load(vy + lane);
+        const Bytes sum = Vector::add(x, y);
+        // The saturated sum differs from the wrapped sum exactly on overflow
+        const Bytes carry =
+            Vector::and_not(Vector::equal(Vector::add_saturated(x, y), sum),
+                            one);
+        Vector::store_masked(vf + lane, carry, group);
+        Vector::store_masked(vx + lane, sum, group);
+        break;
+      }
+      case kSubtractVyFromVx: {
+        const Bytes greater =
+            Vector::and_not(Vector::equal(
+                                Vector::subtract_saturated(
+                                    Vector::load(vx + lane),
+                                    Vector::load(vy + lane)),
+                                zero),
+                            one);
+        Vector::store_masked(vf + lane, greater, group);
+        Vector::store_masked(vx + lane,
+                             Vector::subtract(Vector::load(vx + lane),
+                                              Vector::load(vy + lane)),
+                             group);
+        break;
+      }
+      case kShiftRight:
+        Vector::store_masked(
+            vf + lane, Vector::and_(Vector::load(vx + lane), one), group);
+        Vector::store_masked(
+            vx + lane, Vector::shift_right(Vector::load(vx + lane)), group);
+        break;
+      case kSetVxToVyMinusVx: {
+        const Bytes greater =
+            Vector::and_not(Vector::equal(
+                                Vector::subtract_saturated(
+                                    Vector::load(vy + lane),
+                                    Vector::load(vx + lane)),
+                                zero),
+                            one);
+        Vector::store_masked(vf + lane, greater, group);
+        Vector::store_masked(vx + lane,
+                             Vector::subtract(Vector::load(vy + lane),
+                                              Vector::load(vx + lane)),
+                             group);
+        break;
+      }
+      case kShiftLeft: {
+        // The most significant bit is set where the byte is >= 0x80
+        const Bytes high = Vector::and_not(
+            Vector::equal(Vector::subtract_saturated(Vector::load(vx + lane),
+                                                     Vector::splat(0x7F)),
+                          zero),
+            one);
+        Vector::store_masked(vf + lane, high, group);
+        const Bytes x = Vector::load(vx + lane);
+        Vector::store_masked(vx + lane, Vector::add(x, x), group);
+        break;
+      }
+      case kSetIndexRegister:
+        for (u32 w = 0; w < WORDS; w++) {
+          u16* index = lanes.index_register + lane + w * WORD_WIDTH;
+          Vector::store_words(
+              index,
+              Vector::select_words(Vector::load_words(index),
+                                   Vector::splat_words(instruction.nnn),
+                                   Vector::widen_mask(group, w)));
+        }
+        break;
+      case kAddVxToI: {
+        // Adding 0 on the other lanes needs no blend
+        const Bytes x = Vector::and_(Vector::load(vx + lane), group);
+        for (u32 w = 0; w < WORDS; w++) {
+          u16* index = lanes.index_register + lane + w * WORD_WIDTH;
+          Vector::store_words(index,
+                              Vector::add_words(Vector::load_words(index),
+                                                Vector::widen(x, w)));
+        }
+        break;
+      }
+      case kSetIToSpriteCharacter: {
+        const Bytes x = Vector::load(vx + lane);
+        for (u32 w = 0; w < WORDS; w++) {
+          u16* index = lanes.index_register + lane + w * WORD_WIDTH;
+          const Words wide = Vector::widen(x, w);
+          // x * 5 = (x << 2) + x
+          const Words twice = Vector::add_words(wide, wide);
+          const Words sprite = Vector::add_words(
+              Vector::add_words(twice, twice), wide);
+          Vector::store_words(
+              index, Vector::select_words(Vector::load_words(index), sprite,
+                                          Vector::widen_mask(group, w)));
+        }
+        break;
+      }
+      case kReturnFromSubroutine:
+        jump = true;
+        for (u32 w = 0; w < WORDS; w++) {
+          target[w] =
+              Vector::load_words(lanes.return_address + lane + w * WORD_WIDTH);
+        }
+        break;
+      case kJumpToLocation:
+      case kCallSubroutine:
+        jump = true;
+        for (u32 w = 0; w < WORDS; w++) {
+          target[w] = Vector::splat_words(instruction.nnn);
+        }
+        break;
+      case kJumpToExtendedLocation: {
+        jump = true;
+        const Bytes v0 = Vector::load(v[0] + lane);
+        for (u32 w = 0; w < WORDS; w++) {
+          target[w] = Vector::add_words(Vector::widen(v0, w),
+                                        Vector::splat_words(instruction.nnn));
+        }
+        break;
+      }
+      case kSetVxToDelayTimer:
+        Vector::store_masked(vx + lane, Vector::load(lanes.delay_timer + lane),
+                             group);
+        break;
+      case kSetDelayTimer:
+        Vector::store_masked(lanes.delay_timer + lane, Vector::load(vx + lane),
+                             group);
+        break;
+      case kSetSoundTimer:
+        Vector::store_masked(lanes.sound_timer + lane, Vector::load(vx + lane),
+                             group);
+        break;
+      default:
+        break;
+    }
+
+    for (u32 w = 0; w < WORDS; w++) {
+      u16* program_counter = lanes.program_counter + lane + w * WORD_WIDTH;
+      const Words current = Vector::load_words(program_counter);
+      const Words next =
+          jump ? Vector::select_words(current, target[w],
+                                      Vector::widen_mask(group, w))
+               : Vector::add_words(current, Vector::widen(step, w));
+      Vector::store_words(program_counter, next);
+    }
+
+    // Timers tick once per executed instruction (unless they tick per frame)
+    if (lanes.timer_tick != 0) {
+      const Bytes tick = Vector::and_(group, one);
+      u8* delay_timer = lanes.delay_timer + lane;
+      u8* sound_timer = lanes.sound_timer + lane;
+      Vector::store(delay_timer, Vector::subtract_saturated(
+                                     Vector::load(delay_timer), tick));
+      Vector::store(sound_timer, Vector::subtract_saturated(
+                                     Vector::load(sound_timer), tick));
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include <string>
+#include <vector>
+
+#include "chip8.h"
+#include "chip8_types.h"
+
+// Header of a movie file, followed by event_count MovieEvents
+struct MovieHeader {
+  char magic[4];  // "C8MV"
+  u32 version;    // Movie::VERSION
+  u64 program_hash;  // RomLibrary::get_hash of the program
+  u64 seed;          // Random seed (stream 0)
+  u32 instructions_per_frame;
+  u32 event_count;
+  u64 cycles;      // Length of the movie in instructions
+  u64 state_hash;  // Chip8::get_state_hash at the end of the movie
+  // Added in version 2, version 1 movies ran with kDefaultQuirks
+  u32 quirks;  // Chip8Quirks
+  u32 reserved;
+};
+
+// A key went down or up before the instruction with the number cycle (see
+// Chip8::get_cycles)
+struct MovieEvent {
+  u64 cycle;
+  // Key of the keypad (0 - F) since version 3, before that the host key
+  // code (Movie::read translates it)
+  u8 key;
+  u8 pressed;
+  u8 reserved[6];
+};
+
+/*
+    Movie class:
+    Records the keypad input of a session and plays it back. A movie
+    starts at the reset state of a program and runs in frames of a fixed
+    number of instructions with frame timers (like the Scheduler), so the
+    seed of the random numbers and the key transitions with their cycle
+    numbers are all it takes to repeat the session exactly. The hash of
+    the final state tells whether the replay ended where the recording
+    did. Files are the MovieHeader and the events in native byte order.
+*/
+
+class Movie {
+ public:
+  static const u32 VERSION = 3;
+
+  // Recording: start, then record every key change, then finish
+  void start(u64 program_hash, u64 seed, u32 instructions_per_frame,
+             Chip8Quirks quirks);
+  void record(u64 cycle, u8 key, bool pressed);
+  // Forget the events at and after cycle (the Chip8 was rewound to it)
+  void rewind(u64 cycle);
+  // The movie ends at the current state of chip8
+  void finish(Chip8& chip8);
+
+  bool write(const std::string& path);
+  bool read(const std::string& path);
+
+  // Runs the movie on chip8 (the program loaded, in its reset state) as
+  // fast as possible, with the quirks it was recorded with. Stops at the
+  // end of the movie or on a fault and returns the number of instructions
+  // executed.
+  u64 play(Chip8& chip8);
+
+  const MovieHeader& get_header() { return this->header; }
+  const std::vector<MovieEvent>& get_events() { return this->events; }
+
+ private:
+  MovieHeader header{};
+  std::vector<MovieEvent> events;
+};
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "buffered_writer.h"
+#include "chip8_types.h"
+#include "decoder.h"
+
+// Calls a hook of the Profiler attached to a Chip8 (if any). The hooks only
+// exist in builds with CHIP8_PROFILER (cmake -DCHIP8_PROFILER=ON), in all
+// other builds they are compiled out and cost nothing.
+#ifdef CHIP8_PROFILER
+#define CHIP8_PROFILE(chip8, hook)     \
+  do {                                 \
+    if ((chip8).profiler != nullptr) { \
+      (chip8).profiler->hook;          \
+    }                                  \
+  } while (false)
+#else
+#define CHIP8_PROFILE(chip8, hook) \
+  do {                             \
+  } while (false)
+#endif
+
+/*
+    Profiler class:
+    Counts where the emulated time of a program goes: the instructions
+    executed per operation (one counter per Interpreter handler) and per
+    call path of subroutines, per address (the hot program counters), the
+    bytes read and written through I, and the instructions of every frame.
+    The results are written as JSON and as folded stacks
+    ("start;sub_2A4;DrawSprite 1234", the input of flamegraph.pl).
+
+    The hooks are in the Interpreter, so a profiled Chip8 has to run on
+    kInterpreterEngine (see Chip8::set_profiler).
+*/
+
+class Profiler {
+ public:
+  // Subroutines nested deeper than the stack of the Chip8 are counted in
+  // their caller
+  static const u32 MAXIMUM_DEPTH = 16;
+
+  Profiler();
+
+  void reset();
+
+  // Hooks (called through CHIP8_PROFILE)
+  void count_instruction(u16 address, Operation operation) {
+    this->instructions++;
+    this->executed[address & 0x0FFFu]++;
+    this->paths[this->path].operations[operation]++;
+  }
+  void count_read(u16 address, u16 length) {
+    for (u16 i = 0; i < length; i++) {
+      this->reads[(address + i) & 0x0FFFu]++;
+    }
+  }
+  void count_write(u16 address, u16 length) {
+    for (u16 i = 0; i < length; i++) {
+      this->writes[(address + i) & 0x0FFFu]++;
+    }
+  }
+  void enter_subroutine(u16 address);
+  void leave_subroutine();
+  void end_frame();
+
+  u64 get_instruction_count() { return this->instructions; }
+  u64 get_operation_count(Operation operation);
+
+  void write_json(BufferedWriter& out);
+  void write_folded(BufferedWriter& out);
+
+ private:
+  // A subroutine on a call path from the start of the program
+  struct CallPath {
+    u16 address;  // Entry of the subroutine (0x200 for the root)
+    u32 parent;
+    u32 depth;
+    std::vector<u32> children;
+    std::array<u64, kOperationCount> operations;
+  };
+
+  std::vector<CallPath> paths;
+  u32 path;  // Current call path (index into paths)
+  // Calls deeper than MAXIMUM_DEPTH that did not return yet
+  u32 hidden_calls;
+
+  u64 instructions;
+
+  std::array<u64, 4096> executed;
+  std::array<u64, 4096> reads;
+  std::array<u64, 4096> writes;
+
+  std::vector<u32> frames;
+  u64 instructions_before_frame;
+
+  void write_path(BufferedWriter& out, u32 path);
+};
+
+#endif
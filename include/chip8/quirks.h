@@ -0,0 +1,60 @@
+#ifndef QUIRKS_H
+#define QUIRKS_H
+
+// How Fx55 and Fx65 leave I after storing or loading V0 - Vx
+// kIndexUnchanged: I stays where it was
+// kIndexPlusX: I = I + x
+// kIndexPlusXPlusOne: I = I + x + 1 (I points behind the last byte)
+enum IndexIncrement { kIndexUnchanged, kIndexPlusX, kIndexPlusXPlusOne };
+
+/*
+    Quirk profiles:
+    Behaviours that differ between Chip-8 interpreters, as compile-time
+    policies for the BasicInterpreter template. Every profile is its own
+    instantiation of the interpreter, so a quirk costs no branch at run
+    time. A Chip8 selects the profile with Chip8::set_quirks
+    (Chip8Quirks).
+
+    SHIFT_VY: 8xy6 and 8xyE shift Vy into Vx (instead of Vx in place)
+    LOAD_STORE_INDEX: how Fx55 and Fx65 leave I
+    JUMP_VX: Bxnn jumps to xnn + Vx (instead of nnn + V0)
+    LOGIC_RESETS_VF: 8xy1, 8xy2 and 8xy3 clear VF
+
+    Sprites clip at the edges of the display (their start coordinate
+    wraps) in all profiles.
+*/
+
+// What this interpreter always did, and the only profile the JIT, the
+// AotEngine and the lockstep engine implement
+struct DefaultQuirks {
+  static const bool SHIFT_VY = false;
+  static const IndexIncrement LOAD_STORE_INDEX = kIndexUnchanged;
+  static const bool JUMP_VX = false;
+  static const bool LOGIC_RESETS_VF = false;
+};
+
+// The original interpreter of the RCA COSMAC VIP (1977)
+struct CosmacVipQuirks {
+  static const bool SHIFT_VY = true;
+  static const IndexIncrement LOAD_STORE_INDEX = kIndexPlusXPlusOne;
+  static const bool JUMP_VX = false;
+  static const bool LOGIC_RESETS_VF = true;
+};
+
+// CHIP-48 on the HP-48 calculators (1990)
+struct Chip48Quirks {
+  static const bool SHIFT_VY = false;
+  static const IndexIncrement LOAD_STORE_INDEX = kIndexPlusX;
+  static const bool JUMP_VX = true;
+  static const bool LOGIC_RESETS_VF = false;
+};
+
+// SUPER-CHIP 1.1 (1991)
+struct SuperChipQuirks {
+  static const bool SHIFT_VY = false;
+  static const IndexIncrement LOAD_STORE_INDEX = kIndexUnchanged;
+  static const bool JUMP_VX = true;
+  static const bool LOGIC_RESETS_VF = false;
+};
+
+#endif
@@ -1,14 +1,55 @@
 #ifndef RANDOM_H
 #define RANDOM_H
 
-#include <iostream>
+#include "chip8_types.h"
+
+/*
+    Random class:
+    Deterministic pseudo random number generator of a Chip8 (PCG32, XSH RR
+    variant). The same seed and stream always give the same sequence, so
+    runs can be reproduced bit for bit. Machines running side by side
+    (e.g. in a batch) use different streams of the same seed to get
+    independent sequences.
+*/
 
 class Random {
  public:
-  Random();
-  ~Random();
+  static const u64 DEFAULT_SEED = 0x853C49E6748FEA9Bull;
+
+  explicit Random(u64 seed = DEFAULT_SEED, u64 stream = 0) {
+    this->set_seed(seed, stream);
+  }
+
+  // Restart the sequence of the given seed and stream
+  void set_seed(u64 seed, u64 stream = 0);
+  // Restart the sequence of the current seed and stream
+  void reset() { this->set_seed(this->seed, this->stream); }
+
+  u64 get_seed() { return this->seed; }
+  u64 get_stream() { return this->stream; }
+  // Current position in the sequence (part of the machine state)
+  u64 get_state() { return this->state; }
+
+  u8 get_random_number() {
+    // The high bits of the output are the best ones
+    return this->next() >> 24;
+  }
+
+ private:
+  static const u64 MULTIPLIER = 6364136223846793005ull;
+
+  u64 seed;
+  u64 stream;
+  u64 state;
+  u64 increment;  // Odd, selects the stream
 
-  int get_random_number();
+  u32 next() {
+    const u64 state = this->state;
+    this->state = state * MULTIPLIER + this->increment;
+    const u32 xorshifted = static_cast<u32>(((state >> 18) ^ state) >> 27);
+    const u32 rotation = static_cast<u32>(state >> 59);
+    return (xorshifted >> rotation) | (xorshifted << ((32 - rotation) & 31));
+  }
 };
 
-#endif
\ No newline at end of file
+#endif
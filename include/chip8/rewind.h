@@ -0,0 +1,82 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <deque>
+#include <vector>
+
+#include "chip8.h"
+#include "chip8_types.h"
+
+// A frame of the history: the XOR delta to the frame before, and every
+// KEYFRAME_INTERVAL frames the complete state after the delta
+struct RewindRecord {
+  u32 offset;      // Offset of the record in the storage of the buffer
+  u32 delta_size;  // Size of the run length encoded XOR delta
+  bool keyframe;   // The delta is followed by the complete Chip8State
+
+  u32 get_size() const {
+    return this->delta_size + (this->keyframe ? sizeof(Chip8State) : 0);
+  }
+};
+
+/*
+    RewindBuffer class:
+    History of the states of a Chip8, one per frame, in a fixed memory
+    budget. Every frame is stored as the XOR of its state with the state
+    of the frame before, run length encoded (most of the memory and the
+    display do not change from frame to frame). XOR works both ways, so
+    stepping back one frame only decodes the delta of the newest frame.
+    Periodic keyframes hold the complete state, so seeking far back does
+    not have to walk every frame. When the budget is used up, the oldest
+    frames are dropped.
+*/
+
+class RewindBuffer {
+ public:
+  // Frames per keyframe (every 10 seconds): a delta of a frame is mostly
+  // tens of bytes, a keyframe is the whole state
+  static const u32 KEYFRAME_INTERVAL = 600;
+  static const u32 MINIMUM_BUDGET = 64 * 1024;
+
+  // budget = bytes of storage for the encoded frames
+  explicit RewindBuffer(u32 budget = 8 * 1024 * 1024);
+
+  // Append the state of the next frame
+  void push(const Chip8State& state);
+  // Drop the newest frame and return the state of the frame before it in
+  // state. Returns false if there is no older frame.
+  bool step_back(Chip8State& state);
+  // Same as frames calls of step_back, but starts from the nearest
+  // keyframe if that is shorter. Returns false if not enough frames are
+  // left (the history is unchanged then).
+  bool seek_back(u32 frames, Chip8State& state);
+  void clear();
+
+  // Frames step_back can go back (the oldest frame is only a start point)
+  u32 get_frame_count() {
+    return this->records.empty() ? 0 : this->records.size() - 1;
+  }
+  u64 get_used_bytes() { return this->used_bytes; }
+  u32 get_budget() { return this->storage.size(); }
+
+ private:
+  std::vector<u8> storage;
+  std::deque<RewindRecord> records;
+  u32 write_offset;
+  u64 used_bytes;
+  // Number of the next frame pushed (frames divisible by KEYFRAME_INTERVAL
+  // are keyframes)
+  u64 next_frame;
+
+  // State of the newest frame
+  Chip8State current;
+  // Encoding scratch space (worst case: everything changed)
+  std::vector<u8> scratch;
+
+  u32 allocate(u32 size);
+  u32 encode(const Chip8State& previous, const Chip8State& next);
+
+  static void apply(const u8* delta, u32 size, Chip8State& state);
+};
+
+#endif
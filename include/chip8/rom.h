@@ -0,0 +1,95 @@
+#ifndef ROM_H
+#define ROM_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "chip8.h"
+#include "chip8_types.h"
+
+/*
+    RomFile class:
+    Maps a program file read-only into memory (mmap) instead of reading it
+    through a stream. open checks that the file is a regular file that fits
+    into the program area (0x200 to the end of memory), so get_size is the
+    real length of the program and never more than MAXIMUM_SIZE.
+*/
+
+class RomFile {
+ public:
+  // Bytes from 0x200 to the end of memory
+  static const u32 MAXIMUM_SIZE = 4096 - 0x200;
+
+  RomFile();
+  ~RomFile();
+
+  RomFile(const RomFile&) = delete;
+  RomFile& operator=(const RomFile&) = delete;
+
+  // Prints the reason to std::cerr if the file can not be used
+  bool open(const std::string& filename);
+  void close();
+
+  const u8* get_data() { return static_cast<const u8*>(this->mapping); }
+  u32 get_size() { return this->size; }
+
+ private:
+  void* mapping;
+  u32 size;
+};
+
+struct RomEntry {
+  std::string name;  // File name without directory
+  u64 hash;          // See RomLibrary::get_hash
+  u32 offset;        // Position of the program in the arena
+  u32 size;
+  Chip8Quirks quirks;  // See RomLibrary::find_quirks
+};
+
+/*
+    RomLibrary class:
+    Keeps the programs of a directory (e.g. public/roms) in one arena,
+    indexed by the hash of their content. The files are read once when the
+    library is built; loading a program afterwards (switching games,
+    resetting a machine) is a copy of its bytes from the arena, without any
+    file I/O. Files with the same content share their bytes in the arena
+    (the hash finds a candidate, the bytes are compared).
+*/
+
+class RomLibrary {
+ public:
+  // 64-bit FNV-1a over the program padded with zeros to RomFile::MAXIMUM_SIZE
+  // bytes (the program area as the Chip8 sees it, so trailing zeros of a
+  // file do not change the hash)
+  static u64 get_hash(const void* program, u32 size);
+
+  // The quirk profile of a program, listed in the file quirks.txt of its
+  // directory as "NAME.ch8 PROFILE" (one program per line, # starts a
+  // comment, see Chip8::parse_quirks). kDefaultQuirks if it is not listed.
+  static Chip8Quirks find_quirks(const std::string& program_file);
+
+  // Add every *.ch8 and *.c8 file of the directory (sorted by name). Files
+  // that can not be used are reported and skipped.
+  bool add_directory(const std::string& directory);
+  // Returns the entry of the program or nullptr if it can not be used
+  const RomEntry* add_file(const std::string& filename);
+
+  // The entries returned stay valid until the next program is added
+  const RomEntry* find(u64 hash);
+  const RomEntry* find_name(const std::string& name);
+
+  const u8* get_data(const RomEntry& entry) {
+    return this->arena.data() + entry.offset;
+  }
+  const std::vector<RomEntry>& get_entries() { return this->entries; }
+  u32 get_arena_size() { return this->arena.size(); }
+
+ private:
+  std::vector<u8> arena;
+  std::vector<RomEntry> entries;
+  // Hash of the content -> first entry with this content
+  std::unordered_map<u64, u32> entry_of_hash;
+};
+
+#endif
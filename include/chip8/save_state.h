@@ -0,0 +1,42 @@
+#ifndef SAVE_STATE_H
+#define SAVE_STATE_H
+
+#include <string>
+
+#include "chip8.h"
+#include "chip8_types.h"
+
+// Header of a save state file, followed by the Chip8State itself
+struct SaveStateHeader {
+  char magic[4];  // "C8SS"
+  u32 version;    // SaveState::VERSION
+  u32 state_size;  // sizeof(Chip8State)
+  u32 reserved;
+  u64 checksum;  // 64-bit FNV-1a of the Chip8State bytes
+};
+
+/*
+    SaveState class:
+    Reads and writes versioned binary save state files: a SaveStateHeader
+    and the Chip8State exactly as it is stored in memory (native byte
+    order). Files of another version, of another state size, with a wrong
+    checksum or with a state that no Chip8 reaches (e.g. a stack pointer
+    beyond the stack) are rejected. VERSION changes whenever the layout of
+    Chip8State changes.
+*/
+
+class SaveState {
+ public:
+  static const u32 VERSION = 4;
+
+  static bool write(const std::string& path, const Chip8State& state);
+  static bool read(const std::string& path, Chip8State& state);
+
+  static u64 get_checksum(const Chip8State& state);
+
+ private:
+  // The fields that index something or are enums or bools are in range
+  static bool is_valid(const Chip8State& state);
+};
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include "chip8.h"
+#include "chip8_types.h"
+#include "rewind.h"
+
+// How the Scheduler paces the emulation
+// kRealTimeMode: 60 frames per second of wall clock time
+// kTurboMode: as many frames as possible (uncapped)
+// kFrameStepMode: one frame per Scheduler::request_step
+enum SchedulerMode { kRealTimeMode, kTurboMode, kFrameStepMode };
+
+struct SchedulerStatistics {
+  u64 frames = 0;
+  u64 instructions = 0;
+  // Frames dropped because the host fell more than MAXIMUM_CATCH_UP frames
+  // behind the wall clock
+  u64 skipped_frames = 0;
+  // How late the waits for the next frame woke up (real time mode)
+  double average_overshoot_ms = 0;
+  double maximum_overshoot_ms = 0;
+  // Time spent blocked in idle waits (see Scheduler::set_idle_waiting)
+  double idle_ms = 0;
+  // Wall clock time minus emulated time since the mode was last set
+  // (positive: the emulation runs behind the wall clock)
+  double drift_ms = 0;
+};
+
+/*
+    Scheduler class:
+    Runs a Chip8 in frames of emulated time. Every frame executes a fixed
+    number of instructions (instructions per second / 60) and ticks the
+    delay and sound timers once, so the game speed is set by the
+    instructions per second and the timers always run at 60 Hz of emulated
+    time. The caller renders and polls the input once per call of
+    run_frames and then waits with wait_for_next_frame.
+*/
+
+class Scheduler {
+ public:
+  static const u32 FRAMES_PER_SECOND = 60;
+  // Most frames run by one call of run_frames in real time mode, the rest
+  // is skipped so a slow host does not spiral
+  static const u32 MAXIMUM_CATCH_UP = 4;
+  // Longest idle wait before the frames are caught up anyway
+  static constexpr u32 MAXIMUM_IDLE_WAIT_MS = 250;
+
+  explicit Scheduler(Chip8& chip8, u32 instructions_per_second = 600);
+
+  void set_instructions_per_second(u32 instructions_per_second);
+  u32 get_instructions_per_frame() { return this->instructions_per_frame; }
+
+  // Restarts the clock of the real time mode and the drift measurement
+  void set_mode(SchedulerMode mode);
+  SchedulerMode get_mode() { return this->mode; }
+  // Frame step mode: run one more frame on the next call of run_frames
+  void request_step() { this->pending_steps++; }
+  // Record the state after every frame run in rewind (nullptr = off)
+  void set_rewind_buffer(RewindBuffer* rewind) { this->rewind = rewind; }
+  // Step back one recorded frame instead of running one, at the pace of
+  // the mode (turbo rewinds fast, frame step mode rewinds per step)
+  void set_rewinding(bool rewinding) {
+    this->rewinding = rewinding && this->rewind != nullptr;
+  }
+  bool is_rewinding() { return this->rewinding; }
+  // Real time mode: while the Chip8 only waits for input (see
+  // Chip8::is_waiting_for_input), block in wait_for_next_frame until wake
+  // is called instead of waking up every frame. Only for callers that
+  // call wake on every input event.
+  void set_idle_waiting(bool enabled) { this->idle_waiting = enabled; }
+  // Ends an idle wait, from any thread (also one that has not started yet)
+  void wake();
+
+  // Runs the frames that are due: in real time mode the frames whose start
+  // time has passed, in turbo mode frames for one frame period of wall
+  // clock time, in frame step mode the requested steps. Stops early if the
+  // Chip8 faults or a rewind reaches the oldest recorded frame. Returns the
+  // number of frames run.
+  u32 run_frames();
+  // Sleeps until the next frame is due (no wait in turbo mode). An idle
+  // wait also runs the frames that were due while it blocked, so the
+  // input that ended it takes effect at the same frame as without it.
+  void wait_for_next_frame();
+
+  const SchedulerStatistics& get_statistics();
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  Chip8& chip8;
+  u32 instructions_per_frame;
+  SchedulerMode mode;
+  u32 pending_steps;
+  RewindBuffer* rewind;
+  bool rewinding;
+  bool idle_waiting;
+
+  std::mutex wake_mutex;
+  std::condition_variable wake_condition;
+  bool woken;
+
+  const Clock::duration frame_period;
+  // Start of the clock and frames run or skipped since then
+  Clock::time_point epoch;
+  u64 scheduled_frames;
+  u64 emulated_frames;
+  u64 overshoot_samples;
+  double total_overshoot_ms;
+
+  SchedulerStatistics statistics;
+
+  bool run_frame();
+  void wait_for_input();
+};
+
+#endif
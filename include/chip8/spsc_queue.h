@@ -0,0 +1,56 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <array>
+#include <atomic>
+
+#include "chip8_types.h"
+
+/*
+    SpscQueue class:
+    Bounded FIFO of CAPACITY (a power of two) values of type T from one
+    producer thread to one consumer thread. Like the AudioRing, each side
+    only stores its own position, so push and pop never wait, lock or
+    allocate; push fails if the queue is full.
+*/
+
+template <typename T, u32 CAPACITY>
+class SpscQueue {
+  static_assert((CAPACITY & (CAPACITY - 1)) == 0,
+                "The capacity must be a power of two");
+
+ public:
+  SpscQueue() : pushed(0), popped(0) {}
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  // Producer
+  bool push(const T& value) {
+    const u32 pushed = this->pushed.load(std::memory_order_relaxed);
+    if (pushed - this->popped.load(std::memory_order_acquire) == CAPACITY) {
+      return false;
+    }
+    this->values[pushed & (CAPACITY - 1)] = value;
+    this->pushed.store(pushed + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer: false if the queue is empty
+  bool pop(T& value) {
+    const u32 popped = this->popped.load(std::memory_order_relaxed);
+    if (popped == this->pushed.load(std::memory_order_acquire)) {
+      return false;
+    }
+    value = this->values[popped & (CAPACITY - 1)];
+    this->popped.store(popped + 1, std::memory_order_release);
+    return true;
+  }
+
+ private:
+  std::array<T, CAPACITY> values;
+  alignas(64) std::atomic<u32> pushed;
+  alignas(64) std::atomic<u32> popped;
+};
+
+#endif
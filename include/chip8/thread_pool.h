@@ -0,0 +1,68 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "chip8_types.h"
+
+/*
+    ThreadPool class:
+    Fixed set of worker threads with one task queue each. parallel_for
+    deals the tasks out round-robin, every worker runs the tasks of its own
+    queue and steals from the other queues when it runs dry, so tasks of
+    very different length still keep all workers busy.
+    Queued tasks carry the generation (call of parallel_for) they belong
+    to, a worker only takes tasks of the generation it started, so one
+    that is late to leave a call never runs the tasks of the next one.
+*/
+
+class ThreadPool {
+ public:
+  // 0 threads = one per hardware thread
+  explicit ThreadPool(u32 threads = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  u32 get_thread_count() { return this->workers.size(); }
+
+  // Run task(0) ... task(count - 1) on the workers and wait for all of them
+  void parallel_for(u32 count, const std::function<void(u32)>& task);
+
+ private:
+  struct QueuedTask {
+    u64 generation;
+    u32 index;
+  };
+
+  struct Worker {
+    std::mutex mutex;
+    std::deque<QueuedTask> tasks;
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<std::thread> threads;
+
+  std::mutex mutex;
+  std::condition_variable work_available;
+  std::condition_variable work_done;
+  const std::function<void(u32)>* task;
+  u64 generation;
+  bool stopping;
+  // Workers between taking up a generation and running out of its tasks
+  u32 active;
+  std::atomic<u32> remaining;
+
+  void work(u32 worker);
+  bool take_task(u32 worker, u64 generation, u32& index);
+};
+
+#endif
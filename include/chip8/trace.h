@@ -0,0 +1,92 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <array>
+#include <atomic>
+#include <string>
+
+#include "buffered_writer.h"
+#include "chip8.h"
+#include "chip8_types.h"
+
+// An executed instruction and the registers it started with (the changes
+// it made are the difference to the next entry)
+struct TraceEntry {
+  u16 program_counter;  // Address of the instruction
+  u16 opcode;
+  u16 index_register;
+  u8 stack_pointer;
+  u8 delay_timer;
+  std::array<u8, 16> registers;  // V0 - VF
+};
+
+static_assert(sizeof(TraceEntry) == 24, "Binary traces store TraceEntry as is");
+
+// Start of a binary trace, followed by entry_count TraceEntry (oldest
+// first). All values in host byte order.
+struct TraceHeader {
+  char magic[4];  // "C8TR"
+  u32 version;    // ExecutionTrace::VERSION
+  u32 entry_count;
+  u32 fault;   // Chip8Fault of the machine when the trace was written
+  u64 cycles;  // Instructions executed by then
+  TraceEntry current;  // Registers after the newest entry
+};
+
+/*
+    ExecutionTrace class:
+    Ring of the last CAPACITY instructions of a Chip8 (see Chip8::set_trace).
+    The Interpreter appends one TraceEntry per fetched instruction, also for
+    an instruction that faults, without allocating or locking: the ring has
+    a single writer, and readers on other threads copy it with copy_entries,
+    which drops entries overwritten while it copied them.
+
+    The trace is written as text (with the mnemonics and the registers every
+    instruction changed) or in binary (TraceHeader), e.g. when the Chip8
+    faults, on request with a signal (see request_dump_on_signal) or
+    whenever the API is called.
+*/
+
+class ExecutionTrace {
+ public:
+  static const u32 CAPACITY = 1024;  // Power of two
+  static const u32 VERSION = 1;
+
+  ExecutionTrace() : written(0) {}
+
+  void append(const Chip8State& state, u16 address, u16 opcode) {
+    const u64 index = this->written.load(std::memory_order_relaxed);
+    TraceEntry& entry = this->entries[index & (CAPACITY - 1)];
+    entry.program_counter = address;
+    entry.opcode = opcode;
+    entry.index_register = state.index_register;
+    entry.stack_pointer = state.stack_pointer;
+    entry.delay_timer = state.delay_timer;
+    entry.registers = state.general_purpose_variable_registers;
+    this->written.store(index + 1, std::memory_order_release);
+  }
+
+  void clear() { this->written.store(0, std::memory_order_release); }
+  // Instructions recorded since the last clear (the ring keeps CAPACITY)
+  u64 get_written() { return this->written.load(std::memory_order_acquire); }
+
+  // Copy the recorded entries into entries (room for CAPACITY), oldest
+  // first, and return their number
+  u32 copy_entries(TraceEntry* entries);
+
+  // state is the Chip8 the trace belongs to, for the changes made by the
+  // newest instruction and the fault
+  void write_text(BufferedWriter& out, const Chip8State& state);
+  bool write_binary(const std::string& filename, const Chip8State& state);
+
+  // The signal (e.g. SIGUSR1) sets a flag instead of terminating the
+  // process, take_dump_request returns and clears it
+  static bool request_dump_on_signal(int signal);
+  static bool take_dump_request();
+
+ private:
+  std::array<TraceEntry, CAPACITY> entries;
+  std::atomic<u64> written;
+};
+
+#endif
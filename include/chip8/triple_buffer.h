@@ -0,0 +1,59 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <array>
+#include <atomic>
+
+#include "chip8_types.h"
+
+/*
+    TripleBuffer class:
+    Hands the newest value of type T from one producer thread to one
+    consumer thread without either of them ever waiting. Each side owns one
+    of three slots, the third one is in the middle: the producer fills its
+    back slot and swaps it with the middle one (publish), the consumer
+    swaps its front slot with the middle one if the middle holds a value
+    it has not seen yet (update). Values published while the consumer did
+    not look are overwritten, the consumer always gets the newest one.
+*/
+
+template <typename T>
+class TripleBuffer {
+ public:
+  TripleBuffer() : back(0), middle(1), front(2) {}
+
+  TripleBuffer(const TripleBuffer&) = delete;
+  TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+  // Producer: the slot to fill, then hand it to the consumer with publish
+  T& get_back() { return this->slots[this->back]; }
+  void publish() {
+    this->back =
+        this->middle.exchange(this->back | FRESH, std::memory_order_acq_rel) &
+        INDEX;
+  }
+
+  // Consumer: take the newest published value into the front slot, false
+  // if nothing was published since the last update
+  bool update() {
+    if ((this->middle.load(std::memory_order_relaxed) & FRESH) == 0) {
+      return false;
+    }
+    this->front =
+        this->middle.exchange(this->front, std::memory_order_acq_rel) & INDEX;
+    return true;
+  }
+  T& get_front() { return this->slots[this->front]; }
+
+ private:
+  // The middle index is marked fresh by publish until update takes it
+  static const u8 INDEX = 3;
+  static const u8 FRESH = 4;
+
+  std::array<T, 3> slots;
+  u8 back;  // Only used by the producer
+  alignas(64) std::atomic<u8> middle;
+  alignas(64) u8 front;  // Only used by the consumer
+};
+
+#endif
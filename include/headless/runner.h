@@ -0,0 +1,109 @@
+#ifndef HEADLESS_RUNNER_H
+#define HEADLESS_RUNNER_H
+
+#include <string>
+
+#include "chip8/audio.h"
+#include "chip8/chip8.h"
+#include "chip8/rewind.h"
+#include "chip8/rom.h"
+#include "chip8/trace.h"
+
+struct HeadlessOptions {
+  std::string program_file;
+
+  // Stop after this many instructions (0 = use frames instead)
+  u64 cycles = 0;
+
+  // Stop after this many frames of cycles_per_frame instructions each
+  u64 frames = 0;
+  u32 cycles_per_frame = 10;
+  // Frames tick the timers once (60 Hz of emulated time), unless they
+  // should tick per instruction like the runs of --cycles
+  bool instruction_timers = false;
+  // Pace the frames at 60 per second with the Scheduler
+  bool realtime = false;
+
+  Chip8Engine engine = kInterpreterEngine;
+  // Execute idle loops instead of skipping them (see Chip8::skip_idle_loop)
+  bool idle_skipping = true;
+  // Quirk profile of the program, from the quirks.txt next to it unless
+  // given (see RomLibrary::find_quirks)
+  bool automatic_quirks = true;
+  Chip8Quirks quirks = kDefaultQuirks;
+  // Seed of the random numbers (instances of a batch use one stream each)
+  u64 seed = Random::DEFAULT_SEED;
+
+  // Run this many instances in parallel instead of one (0 = single run)
+  u32 batch = 0;
+  u32 threads = 0;  // 0 = one per hardware thread
+  // Repeat the batch run with 1, 2, 4, ... threads up to threads
+  bool scaling = false;
+  // Run the batch on one thread with the vectorized lockstep engine
+  bool lockstep = false;
+
+  // Start from a save state instead of the reset state of the program
+  std::string load_state_file;
+  // Replay a movie (recorded with --record) as fast as possible and check
+  // its final state hash
+  std::string replay_file;
+
+  // Optional outputs
+  std::string save_state_file;
+  std::string record_file;  // Movie of the --frames run (without input)
+  std::string framebuffer_file;
+  bool print_state_hash = false;
+  // Record every frame in a RewindBuffer, then report its size and step back
+  // through it
+  bool rewind = false;
+  // Profile the run into PREFIX.json and PREFIX.folded (only in builds with
+  // CHIP8_PROFILER, see Profiler)
+  std::string profile_prefix;
+  // Keep the last instructions in an ExecutionTrace and write it to this
+  // file (and as text to stderr) when the Chip-8 faults or on SIGUSR1
+  std::string trace_file;
+  // Generate the sound of the frames into a NullAudioSink and report it
+  bool audio = false;
+};
+
+/*
+    HeadlessRunner class:
+    Runs a program on the Chip-8 core without any window, input or frame
+    limiter (unless paced with --realtime). Used on machines without SDL
+    and to measure the raw speed of the core (emulated instructions per
+    second).
+*/
+
+class HeadlessRunner {
+ public:
+  explicit HeadlessRunner(HeadlessOptions const& options);
+
+  static bool parse_arguments(int argc, char** argv, HeadlessOptions& options);
+  static void print_usage(const char* program_name);
+
+  bool load_program();
+  int run();
+
+ private:
+  HeadlessOptions options;
+  Chip8 chip8;
+  RomFile rom;
+  Profiler profiler;
+  ExecutionTrace trace;
+  AudioGenerator audio;
+  NullAudioSink audio_sink;
+
+  int run_single();
+  int run_batch();
+  int run_lockstep();
+  int run_realtime();
+  int run_replay();
+  bool dump_framebuffer();
+  bool write_profile();
+  void report_fault();
+  bool write_trace();
+  void report_rewind(RewindBuffer& rewind);
+  void report_audio();
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef RECOMPILER_H
+#define RECOMPILER_H
+
+#include <array>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "chip8/chip8_types.h"
+#include "chip8/decoder.h"
+
+// A basic block found by control flow discovery
+struct RecompiledBlock {
+  u16 start_address;
+  u16 end_address;  // One past the last byte of the block
+  u16 cycles;
+  bool loops;  // Ends with a jump back to its own start
+};
+
+/*
+    Recompiler class:
+    Static recompiler that translates a Chip-8 program into a C++ source
+    file for the AotEngine. Starting at 0x200 it follows jumps, calls,
+    returns and both sides of skip instructions to find all reachable
+    basic blocks, and emits one function per block. Computed jumps (Bnnn)
+    end a block, their targets are resolved at run time.
+*/
+
+class Recompiler {
+ public:
+  Recompiler();
+
+  bool load_program(const std::string& filename);
+  void discover();
+  bool write_source(const std::string& filename);
+
+  u16 get_block_count() { return this->blocks.size(); }
+
+ private:
+  // Blocks end after this many instructions even without a branch
+  static const u16 MAXIMUM_BLOCK_SIZE = 64;
+
+  std::string program_name;
+  std::vector<u8> rom;
+  std::array<u8, 4096> memory;
+  std::map<u16, RecompiledBlock> blocks;
+
+  u16 get_opcode(u16 address);
+  void write_block(std::ostream& out, const RecompiledBlock& block);
+
+  static bool is_interpreted(Operation operation);
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef SDL_AUDIO_H
+#define SDL_AUDIO_H
+
+#include <SDL.h>
+
+#include "chip8/audio.h"
+
+/*
+    AudioDevice class:
+    Plays the samples of an AudioGenerator on the SDL audio device. The
+    callback runs on the audio thread of SDL and only reads the AudioRing
+    of the generator: it never locks or allocates. It waits with silence
+    until half of the latency is buffered, and fills the rest of a request
+    with silence when the ring runs empty (an underrun), after which it
+    waits for half of the latency again.
+*/
+
+class AudioDevice {
+ public:
+  explicit AudioDevice(AudioGenerator& generator);
+  ~AudioDevice();
+
+  AudioDevice(const AudioDevice&) = delete;
+  AudioDevice& operator=(const AudioDevice&) = delete;
+
+  // Opens and starts the device (SDL_Init must have initialized the audio
+  // subsystem), false if the host has no suitable device
+  bool open();
+
+ private:
+  AudioRing& ring;
+  const AudioSettings settings;
+  SDL_AudioDeviceID device;
+  // Samples buffered before playback starts
+  u32 start_level;
+  // Only accessed by the callback
+  bool playing;
+
+  static void callback(void* userdata, Uint8* stream, int length);
+  void fill(i16* samples, u32 count);
+};
+
+#endif
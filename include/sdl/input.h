@@ -0,0 +1,50 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <SDL.h>
+
+#include <array>
+#include <string>
+#include <unordered_map>
+
+#include "chip8/chip8_types.h"
+
+/*
+    InputMap class:
+    Translates SDL key codes and game controller buttons into keys of the
+    keypad (0 - F). The tables are built once, from the default layout (see
+    Keypad) or from set_keys and set_buttons, and every host key or button
+    maps to one keypad key or none, so unrelated host keys never press the
+    same keypad key.
+*/
+
+class InputMap {
+ public:
+  static const u8 NO_KEY = 0xFF;
+
+  InputMap();
+
+  // The host key of every keypad key 0 - F, e.g. "x123qweasdzc4rfv" (the
+  // default: key 0 is X, key 1 is 1, ...), false if not 16 keys
+  bool set_keys(const std::string& keys);
+  // The keypad key (hex digit) or - (none) of every controller button in
+  // the order of SDL: A, B, X, Y, Back, Guide, Start, left stick, right
+  // stick, left shoulder, right shoulder, up, down, left, right
+  bool set_buttons(const std::string& buttons);
+
+  u8 get_key(SDL_Keycode key) const {
+    const auto entry = this->keys.find(key);
+    return entry != this->keys.end() ? entry->second : NO_KEY;
+  }
+  u8 get_button_key(int button) const {
+    return button >= 0 && button < SDL_CONTROLLER_BUTTON_MAX
+               ? this->buttons[button]
+               : NO_KEY;
+  }
+
+ private:
+  std::unordered_map<SDL_Keycode, u8> keys;
+  std::array<u8, SDL_CONTROLLER_BUTTON_MAX> buttons;
+};
+
+#endif
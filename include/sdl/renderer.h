@@ -3,6 +3,8 @@
 
 #include <SDL.h>
 
+#include <vector>
+
 #include "chip8/display.h"
 
 struct WindowProperties {
@@ -19,16 +21,22 @@ class Renderer {
   bool is_current_display_mode_valid();
 
   bool initialize();
+  // Uploads the changed rows of the display and presents the frame, does
+  // nothing if no row changed since the last call
   void draw(Display& display);
 
   void set_color(u8 red, u8 green, u8 blue) {
     this->pixel_color.r = red;
     this->pixel_color.g = green;
     this->pixel_color.b = blue;
+    this->expand_all_rows = true;
   }
 
  private:
   SDL_Color pixel_color = {0xD2, 0xA2, 0x4C, 0xFF};
+  // Pixels of the second XO-CHIP plane alone and of both planes
+  SDL_Color second_plane_color = {0x4C, 0x8C, 0xD2, 0xFF};
+  SDL_Color both_planes_color = {0xF0, 0xF0, 0xF0, 0xFF};
   SDL_Color grid_line_color = {0x1C, 0x1C, 0x1C, 0xFF};
 
   SDL_Window* window;
@@ -41,7 +49,22 @@ class Renderer {
 
   WindowProperties window_properties;
 
-  void draw_pixel(int x, int y, int scale);
+  // The framebuffer at one texel per pixel, scaled to the window by the
+  // copy, and the grid lines baked into a transparent window sized overlay
+  SDL_Texture* screen;
+  SDL_Texture* grid;
+  // Pixels per row of the textures (recreated when the resolution changes)
+  int texture_width;
+
+  // ARGB8888 copy of the framebuffer. Locked texture memory is write-only,
+  // so changed rows are expanded here and the whole frame is uploaded.
+  std::vector<u32> frame;
+  bool expand_all_rows;
+
+  bool create_textures(Display& display);
+  void destroy_textures();
+  void expand_row(Display& display, int y, u32* texels);
+  static u32 to_argb(SDL_Color color);
 };
 
 #endif
\ No newline at end of file
@@ -1,15 +1,58 @@
 #ifndef VIRTUALMACHINE_H
 #define VIRTUALMACHINE_H
 
+#include <atomic>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include "chip8/audio.h"
 #include "chip8/chip8.h"
 #include "chip8/disassembler.h"
 #include "chip8/keypad.h"
+#include "chip8/movie.h"
+#include "chip8/rewind.h"
+#include "chip8/rom.h"
+#include "chip8/scheduler.h"
+#include "chip8/spsc_queue.h"
+#include "chip8/trace.h"
+#include "chip8/triple_buffer.h"
+#include "sdl/audio.h"
+#include "sdl/input.h"
 #include "sdl/renderer.h"
 
 enum VirtualMachineState { kRomLoading = 1 << 0, kRomLoaded = 1 << 1 };
 
+// A key or button event polled on the SDL thread, applied by the
+// emulation thread before the next frame (the cycle the movie records)
+struct KeyEvent {
+  SDL_Keycode key;  // Host key, 0 for a controller button
+  u8 keypad_key;    // Mapped by the InputMap (InputMap::NO_KEY if none)
+  bool pressed;
+  bool repeat;
+  u64 timestamp;  // Nanoseconds of the steady clock when it was polled
+};
+
+// A display published by the emulation thread, number counts the
+// publications so the renderer notices the frames it never saw
+struct DisplayFrame {
+  Display display;
+  u64 number;
+  // Timestamp of the oldest key applied since the last publication (0 if
+  // none), for the latency measurement
+  u64 input_timestamp;
+};
+
+/*
+    VirtualMachine class:
+    Runs a program in a window on two threads. The emulation thread runs
+    the Scheduler and publishes every changed display into a triple buffer,
+    the SDL thread (the one that calls run) polls the input and renders the
+    newest published display. Neither waits for the other: key events
+    travel to the emulation thread through a wait-free queue and are
+    applied between frames, a slow present only skips displays.
+*/
+
 class VirtualMachine {
  public:
   VirtualMachine();
@@ -17,31 +60,134 @@ class VirtualMachine {
 
   bool boot();
   bool load_program(const std::string& program_file);
-  void flash_program(char* data);
-  void disassemble_program(char* data);
+  bool flash_program(const void* data, u32 size);
+  void disassemble_program(const void* data, u32 size);
+  // Starts the emulation thread, then renders and polls the input until
+  // the window is closed or the Chip8 faults
   void run();
   void process_input();
+  void report_fault();
+  // The last instructions as text to stderr (and to the --trace file)
+  void write_trace();
+  void report_statistics();
+  // Stops and joins the emulation thread, reports the session, writes the
+  // movie and closes the audio device (safe to call more than once)
   void shutdown_systems();
 
+  void set_instructions_per_second(u32 instructions_per_second) {
+    this->scheduler.set_instructions_per_second(instructions_per_second);
+  }
+  void set_random_seed(u64 seed) { this->chip8.set_random_seed(seed); }
+  // Run every program with quirks instead of the profile in the quirks.txt
+  // of its directory (see RomLibrary::find_quirks)
+  void set_quirks(Chip8Quirks quirks) {
+    this->automatic_quirks = false;
+    this->quirks = quirks;
+  }
+  // Record the keypad input of the session into a movie file (written on
+  // exit, replay it with --headless --replay)
+  void record_movie(const std::string& movie_file) {
+    this->movie_file = movie_file;
+  }
+  // Also write the trace in binary to trace_file
+  void set_trace_file(const std::string& trace_file) {
+    this->trace_file = trace_file;
+  }
+
+  // Sound output (applied by boot): the most sound buffered ahead of the
+  // audio device, the samples it requests at a time and the volume in
+  // percent of the full scale (0 = no audio device)
+  void set_audio_latency(u32 milliseconds) {
+    this->audio_settings.latency_ms = milliseconds;
+  }
+  void set_audio_buffer(u32 samples) {
+    this->audio_settings.device_samples = samples;
+  }
+  void set_volume(u32 percent) {
+    this->audio_settings.amplitude =
+        32767 * (percent > 100 ? 100 : percent) / 100;
+  }
+
+  // Host keys of the keypad keys and keypad keys of the controller
+  // buttons (see InputMap), false if malformed
+  bool set_keys(const std::string& keys) { return this->input.set_keys(keys); }
+  bool set_buttons(const std::string& buttons) {
+    return this->input.set_buttons(buttons);
+  }
+  // Measure the time from every key event to the presentation of the
+  // first display published after it was applied (reported on exit)
+  void measure_input_latency() { this->measuring_latency = true; }
+
   void change_game_color(u8 red, u8 green, u8 blue) {
     this->renderer->set_color(red, green, blue);
   }
 
  private:
-  bool is_running;
+  // Cleared by either thread to stop both
+  std::atomic<bool> is_running;
   u8 emu_state_{0};
   inline void ToggleState(u8 state) { emu_state_ ^= state; }
   inline bool CheckState(u8 state) { return emu_state_ & state; }
 
-  // Frame Rate
-  const int FPS = 500;
-  const int frame_delay = 1000 / FPS;
-  Uint32 frame_start;
-  int frame_time;
-
   Renderer* renderer;
   Chip8 chip8;
+  // History of the last frames for rewinding (held Backspace)
+  RewindBuffer rewind;
+  // Runs the Chip8 in 60 Hz frames (declared after chip8, which it uses)
+  Scheduler scheduler;
   Disassembler disassembler;
+  // The programs of the directory of the loaded program
+  RomLibrary library;
+  u32 program_index;
+  bool automatic_quirks;
+  Chip8Quirks quirks;
+
+  u64 program_hash;
+  std::string movie_file;
+  Movie movie;
+
+  // The last instructions, written when the Chip8 faults or on SIGUSR1
+  ExecutionTrace trace;
+  std::string trace_file;
+
+  // The sound of the frames, played by the audio device (both nullptr
+  // without sound)
+  AudioSettings audio_settings;
+  AudioGenerator* audio;
+  AudioDevice* audio_device;
+
+  std::thread emulation_thread;
+  // Emulation thread to SDL thread: the newest changed display
+  TripleBuffer<DisplayFrame> displays;
+  u64 published_displays;  // Emulation thread
+  u64 rendered_display;    // SDL thread
+  // SDL thread to emulation thread (a stalled emulation drops further keys)
+  SpscQueue<KeyEvent, 256> key_events;
+  InputMap input;
+  std::vector<SDL_GameController*> controllers;
+
+  bool measuring_latency;
+  u64 input_timestamp;  // Emulation thread, see DisplayFrame
+  std::vector<double> input_latencies_ms;  // SDL thread
+
+  // Body of the emulation thread
+  void emulate();
+  // Copy the display of the Chip8 into the triple buffer
+  void publish_display();
+  // A polled key on the emulation thread: control key or keypad
+  void handle_key_event(const KeyEvent& event);
+  // Host keys that control the scheduler instead of the keypad
+  bool process_control_key(SDL_Keycode key);
+  // Load the program step entries after the current one in the library
+  // (0 restarts the current program)
+  void switch_program(int step);
+  // Flash the program of a library entry with its quirk profile
+  bool flash_entry(const RomEntry& entry);
+  // Key of the keypad, recorded into the movie
+  void set_key(u8 key, bool pressed);
+  void push_key_event(SDL_Keycode key, u8 keypad_key, bool pressed,
+                      bool repeat);
+  void report_input_latency();
 };
 
 #endif
\ No newline at end of file
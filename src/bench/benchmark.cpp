@@ -0,0 +1,393 @@
+#include "bench/benchmark.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+#include "chip8/decoder.h"
+#include "chip8/interpreter.h"
+#include "chip8/rom.h"
+
+namespace fs = std::filesystem;
+
+#define CHIP8_OPERATION_NAME(name, handler) #name,
+static const char* const OPERATION_NAMES[kOperationCount] = {
+    "Unknown", CHIP8_OPERATIONS(CHIP8_OPERATION_NAME)};
+#undef CHIP8_OPERATION_NAME
+
+// An instruction of every operation. V0 holds a pressed key (for Ex9E,
+// ExA1 and Fx0A), V0 and V1 are the position of sprites and I points to
+// the sprite data at 0x300 at the start of every round.
+static const u16 HANDLER_OPCODES[kOperationCount] = {
+    0x0000,  // kUnknown (not benchmarked)
+    0x00E0, 0x00EE, 0x1200, 0x2200, 0x3005, 0x4005, 0x5010, 0x6042,
+    0x7001, 0x8010, 0x8011, 0x8012, 0x8013, 0x8014, 0x8015, 0x8016,
+    0x8017, 0x801E, 0x9010, 0xA300, 0xB200, 0xC0FF, 0xD015, 0xE09E,
+    0xE0A1, 0xF007, 0xF00A, 0xF015, 0xF018, 0xF01E, 0xF029, 0xF033,
+    0xF555, 0xF565, 0x00C4, 0x00D4, 0x00FB, 0x00FC, 0x00FE, 0x00FF,
+    0xD010, 0xF101};
+
+static const u8 PRESSED_KEY = 5;
+static const u16 SPRITE_ADDRESS = 0x300;
+
+static const char* get_engine_name(Chip8Engine engine) {
+  switch (engine) {
+    case kInterpreterEngine:
+      return "interpreter";
+    case kBlockCacheEngine:
+      return "blocks";
+    case kJitEngine:
+      return "jit";
+    case kAotEngine:
+      return "aot";
+  }
+  return "unknown";
+}
+
+static std::string format_number(double value) {
+  char text[32];
+  std::snprintf(text, sizeof(text), "%.3f", value);
+  return text;
+}
+
+Benchmark::Benchmark(const std::string& filter, double seconds)
+    : filter(filter), seconds(seconds), program_cycles(0) {}
+
+void Benchmark::run_handlers() {
+  for (u32 operation = 1; operation < kOperationCount; operation++) {
+    const Instruction& instruction =
+        Decoder::decode(HANDLER_OPCODES[operation]);
+    if (instruction.operation != operation) {
+      std::cerr << "No instruction for handler "
+                << OPERATION_NAMES[operation] << '\n';
+      continue;
+    }
+
+    // A fresh machine for every handler, 00EE returns from a full stack
+    Chip8 chip8;
+    Chip8State& state = chip8.state;
+    state.general_purpose_variable_registers[0] = PRESSED_KEY;
+    state.general_purpose_variable_registers[1] = 8;
+    state.stack.fill(0x200);
+    state.keypad.set_key(PRESSED_KEY, true);
+    std::memset(&state.memory[SPRITE_ADDRESS], 0xA5, 15);
+    const u16 stack_pointer =
+        operation == kReturnFromSubroutine ? state.stack.size() : 0;
+
+    const std::string name =
+        std::string("handler/") + OPERATION_NAMES[operation];
+    this->measure(name, [&]() {
+      return execute_rounds(chip8, instruction, stack_pointer, 1024);
+    });
+  }
+}
+
+void Benchmark::run_display() {
+  // Sprites at the start of a byte of the row, across two bytes and
+  // clipped at the right and bottom edges of the display
+  struct Position {
+    const char* name;
+    u8 x;
+    u8 y;
+  };
+  static const Position POSITIONS[] = {
+      {"aligned", 8, 8}, {"unaligned", 13, 8}, {"clipped", 60, 28}};
+  static const u8 HEIGHTS[] = {1, 5, 8, 15};
+
+  for (const Position& position : POSITIONS) {
+    for (u8 height : HEIGHTS) {
+      Chip8 chip8;
+      Chip8State& state = chip8.state;
+      state.general_purpose_variable_registers[0] = position.x;
+      state.general_purpose_variable_registers[1] = position.y;
+      std::memset(&state.memory[SPRITE_ADDRESS], 0xA5, 15);
+      const Instruction& instruction = Decoder::decode(0xD010 | height);
+
+      const std::string name = std::string("draw/") + position.name + "/h" +
+                               std::to_string(height);
+      this->measure(name, [&]() {
+        return execute_rounds(chip8, instruction, 0, 1024);
+      });
+    }
+  }
+
+  // clear_screen only writes the rows that are not empty
+  const Instruction& clear = Decoder::decode(0x00E0);
+  {
+    Chip8 chip8;
+    this->measure("clear/empty",
+                  [&]() { return execute_rounds(chip8, clear, 0, 1024); });
+  }
+  {
+    Chip8 chip8;
+    Interpreter interpreter(chip8);
+    Display full;
+    const u8 sprite[15] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                           0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    for (u8 y = 0; y < full.get_height(); y += 8) {
+      for (u8 x = 0; x < full.get_width(); x += 8) {
+        full.draw_sprite(x, y, sprite, 8);
+      }
+    }
+
+    // Includes copying the full display (32 rows) before every clear
+    this->measure("clear/full", [&]() {
+      for (u32 i = 0; i < 1024; i++) {
+        chip8.state.display = full;
+        interpreter.execute_fetched(clear);
+      }
+      return 1024u;
+    });
+  }
+
+  // The extended display: 8x15 and 16x16 sprites across two words of the
+  // 128x64 display and scrolling it as a whole (one operation is one
+  // scroll of every row)
+  {
+    Chip8 chip8;
+    Chip8State& state = chip8.state;
+    state.display.set_high_resolution(true);
+    state.general_purpose_variable_registers[0] = 61;
+    state.general_purpose_variable_registers[1] = 8;
+    std::memset(&state.memory[SPRITE_ADDRESS], 0xA5, 32);
+    const Instruction& small = Decoder::decode(0xD01F);
+    const Instruction& large = Decoder::decode(0xD010);
+    this->measure("draw/high/h15", [&]() {
+      return execute_rounds(chip8, small, 0, 1024);
+    });
+    this->measure("draw/high/large", [&]() {
+      return execute_rounds(chip8, large, 0, 1024);
+    });
+  }
+  {
+    Display display;
+    display.set_high_resolution(true);
+    const u8 sprite[15] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                           0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    for (u8 y = 0; y < display.get_height(); y += 8) {
+      for (u8 x = 0; x < display.get_width(); x += 8) {
+        display.draw_sprite(x, y, sprite, 8);
+      }
+    }
+
+    // The content does not change the time of a scroll
+    this->measure("scroll/down", [&]() {
+      for (u32 i = 0; i < 1024; i++) {
+        display.scroll_down(1);
+      }
+      return 1024u;
+    });
+    this->measure("scroll/up", [&]() {
+      for (u32 i = 0; i < 1024; i++) {
+        display.scroll_up(1);
+      }
+      return 1024u;
+    });
+    this->measure("scroll/right", [&]() {
+      for (u32 i = 0; i < 1024; i++) {
+        display.scroll_right();
+      }
+      return 1024u;
+    });
+    this->measure("scroll/left", [&]() {
+      for (u32 i = 0; i < 1024; i++) {
+        display.scroll_left();
+      }
+      return 1024u;
+    });
+  }
+}
+
+void Benchmark::run_programs(const std::vector<std::string>& programs,
+                             u32 cycles, Chip8Engine engine) {
+  this->engine_name = get_engine_name(engine);
+  this->program_cycles = cycles;
+
+  for (const std::string& program : programs) {
+    const std::string name = "program/" + fs::path(program).stem().string();
+    if (!this->is_selected(name)) {
+      continue;
+    }
+    RomFile rom;
+    if (!rom.open(program)) {
+      continue;
+    }
+
+    // Every run starts from the reset state (creating the machine and
+    // loading the program is part of the time), without input. Idle loops
+    // are executed, the benchmark measures the engine.
+    try {
+      this->measure(name, [&]() {
+        Chip8 chip8;
+        chip8.set_engine(engine);
+        chip8.set_idle_skipping(false);
+        chip8.save_rom(rom.get_data(), rom.get_size());
+        u32 executed = 0;
+        while (executed < cycles) {
+          const u32 done = chip8.run(cycles - executed);
+          executed += done;
+          if (chip8.get_fault() != kNoFault) {
+            break;
+          }
+        }
+        return executed;
+      });
+    } catch (const std::exception& exception) {
+      std::cerr << name << ": halted: " << exception.what() << '\n';
+    }
+  }
+}
+
+u32 Benchmark::execute_rounds(Chip8& chip8, const Instruction& instruction,
+                              u16 stack_pointer, u32 count) {
+  Interpreter interpreter(chip8);
+  Chip8State& state = chip8.state;
+  u32 executed = 0;
+  while (executed < count) {
+    // As if the instruction was fetched from 0x200
+    state.program_counter = 0x202;
+    state.index_register = SPRITE_ADDRESS;
+    state.stack_pointer = stack_pointer;
+    for (u32 i = 0; i < ROUND_SIZE; i++) {
+      interpreter.execute_fetched(instruction);
+    }
+    executed += ROUND_SIZE;
+  }
+  return executed;
+}
+
+void Benchmark::print_result(const BenchmarkResult& result) {
+  char line[128];
+  std::snprintf(line, sizeof(line), "%-32s %10.3f ns %10.3f ns median\n",
+                result.name.c_str(), result.nanoseconds,
+                result.median_nanoseconds);
+  std::cout << line << std::flush;
+}
+
+void Benchmark::write_json(BufferedWriter& out) {
+  // One benchmark per line, read_json depends on it
+  out << "{\n  \"version\": " << u64(VERSION) << ",\n  \"samples\": "
+      << u64(SAMPLES) << ",\n  \"engine\": \"" << this->engine_name
+      << "\",\n  \"program_cycles\": " << u64(this->program_cycles)
+      << ",\n  \"benchmarks\": [";
+  for (size_t i = 0; i < this->results.size(); i++) {
+    const BenchmarkResult& result = this->results[i];
+    out << (i > 0 ? ",\n" : "\n") << "    {\"name\": \"" << result.name
+        << "\", \"operations\": " << result.operations
+        << ", \"nanoseconds\": " << format_number(result.nanoseconds)
+        << ", \"median_nanoseconds\": "
+        << format_number(result.median_nanoseconds) << '}';
+  }
+  out << "\n  ]\n}\n";
+}
+
+// The value after "key": on line (0 if missing)
+static double read_number(const std::string& line, const char* key) {
+  const std::string field = std::string("\"") + key + "\": ";
+  const size_t position = line.find(field);
+  if (position == std::string::npos) {
+    return 0;
+  }
+  return std::strtod(line.c_str() + position + field.size(), nullptr);
+}
+
+bool Benchmark::read_json(const std::string& filename,
+                          std::vector<BenchmarkResult>& results) {
+  std::ifstream file(filename);
+  if (!file) {
+    std::cerr << "Unable to read: " << filename << '\n';
+    return false;
+  }
+
+  const std::string name_field = "{\"name\": \"";
+  bool versioned = false;
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.find("\"version\": ") != std::string::npos) {
+      versioned = read_number(line, "version") == VERSION;
+      continue;
+    }
+
+    const size_t name_start = line.find(name_field);
+    if (name_start == std::string::npos) {
+      continue;
+    }
+    const size_t begin = name_start + name_field.size();
+    const size_t end = line.find('"', begin);
+    if (end == std::string::npos) {
+      continue;
+    }
+    results.push_back(BenchmarkResult{
+        line.substr(begin, end - begin),
+        static_cast<u64>(read_number(line, "operations")),
+        read_number(line, "nanoseconds"),
+        read_number(line, "median_nanoseconds")});
+  }
+
+  if (!versioned) {
+    std::cerr << filename << " is not a chip8-bench result (version "
+              << VERSION << ")\n";
+    return false;
+  }
+  return true;
+}
+
+u32 Benchmark::compare(const std::vector<BenchmarkResult>& before,
+                       const std::vector<BenchmarkResult>& after,
+                       double threshold, BufferedWriter& out) {
+  std::map<std::string, const BenchmarkResult*> after_of_name;
+  for (const BenchmarkResult& result : after) {
+    after_of_name[result.name] = &result;
+  }
+
+  char line[160];
+  std::snprintf(line, sizeof(line), "%-32s %10s %10s %9s\n", "benchmark",
+                "before ns", "after ns", "change");
+  out << line;
+
+  u32 compared = 0;
+  u32 slower = 0;
+  for (const BenchmarkResult& old_result : before) {
+    const auto found = after_of_name.find(old_result.name);
+    if (found == after_of_name.end()) {
+      std::snprintf(line, sizeof(line), "%-32s %10.3f %10s\n",
+                    old_result.name.c_str(), old_result.nanoseconds, "-");
+      out << line;
+      continue;
+    }
+
+    const BenchmarkResult& new_result = *found->second;
+    after_of_name.erase(found);
+    const double change =
+        old_result.nanoseconds > 0
+            ? (new_result.nanoseconds / old_result.nanoseconds - 1) * 100
+            : 0;
+    const bool regressed = change > threshold;
+    std::snprintf(line, sizeof(line), "%-32s %10.3f %10.3f %+8.1f%%%s\n",
+                  old_result.name.c_str(), old_result.nanoseconds,
+                  new_result.nanoseconds, change,
+                  regressed ? "  slower" : "");
+    out << line;
+    compared++;
+    slower += regressed;
+  }
+
+  // Benchmarks that only exist in the new results, in their order
+  for (const BenchmarkResult& result : after) {
+    if (after_of_name.count(result.name) != 0) {
+      std::snprintf(line, sizeof(line), "%-32s %10s %10.3f\n",
+                    result.name.c_str(), "-", result.nanoseconds);
+      out << line;
+    }
+  }
+
+  std::snprintf(line, sizeof(line),
+                "%u of %u benchmarks slower by more than %g%%\n", slower,
+                compared, threshold);
+  out << line;
+  return slower;
+}
@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bench/benchmark.h"
+#include "chip8/arguments.h"
+#include "chip8/buffered_writer.h"
+
+namespace fs = std::filesystem;
+
+static void print_usage(const char* program_name) {
+  std::cout << "Usage: " << program_name << " [options] [directory]\n"
+            << "       " << program_name
+            << " --compare BEFORE AFTER [--threshold P]\n\n"
+            << "  -o FILE          write the results as JSON to FILE\n"
+            << "  --filter S       run the benchmarks whose name contains S\n"
+            << "  --time S         seconds per benchmark (default 0.25)\n"
+            << "  --cycles N       instructions per program (default "
+               "2000000)\n"
+            << "  --engine E       engine of the programs: interpreter "
+               "(default),\n"
+            << "                   blocks or jit\n"
+            << "  --compare B A    compare two result files, fails if a "
+               "benchmark\n"
+            << "                   got slower by more than --threshold "
+               "percent\n"
+            << "                   (default 5)\n\n"
+            << "The programs are the *.ch8 files of directory (default "
+               "public/roms).\n";
+}
+
+// The *.ch8 and *.c8 files of a directory, sorted
+static std::vector<std::string> find_programs(const std::string& directory) {
+  std::vector<std::string> programs;
+  std::error_code error;
+  for (const fs::directory_entry& entry :
+       fs::directory_iterator(directory, error)) {
+    const std::string extension = entry.path().extension().string();
+    if (entry.is_regular_file(error) &&
+        (extension == ".ch8" || extension == ".c8")) {
+      programs.push_back(entry.path().string());
+    }
+  }
+  if (error) {
+    std::cerr << "Unable to read directory: " << directory << '\n';
+  }
+  std::sort(programs.begin(), programs.end());
+  return programs;
+}
+
+static int compare_files(const std::string& before_file,
+                         const std::string& after_file, double threshold) {
+  std::vector<BenchmarkResult> before;
+  std::vector<BenchmarkResult> after;
+  if (!Benchmark::read_json(before_file, before) ||
+      !Benchmark::read_json(after_file, after)) {
+    return 1;
+  }
+
+  BufferedWriter out(stdout);
+  const u32 slower = Benchmark::compare(before, after, threshold, out);
+  out.flush();
+  return slower == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+  std::string output_file;
+  std::string filter;
+  std::string directory = "public/roms";
+  std::string before_file;
+  std::string after_file;
+  double seconds = 0.25;
+  double threshold = 5;
+  u32 cycles = 2000000;
+  Chip8Engine engine = kInterpreterEngine;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string argument = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (argument == "-o" && has_value) {
+      output_file = argv[++i];
+    } else if (argument == "--filter" && has_value) {
+      filter = argv[++i];
+    } else if (argument == "--time" && has_value) {
+      if (!parse_option(argument, argv[++i], seconds, 0.001, 3600)) {
+        print_usage(argv[0]);
+        return 1;
+      }
+    } else if (argument == "--cycles" && has_value) {
+      if (!parse_option(argument, argv[++i], cycles, 1)) {
+        print_usage(argv[0]);
+        return 1;
+      }
+    } else if (argument == "--engine" && has_value) {
+      const std::string name = argv[++i];
+      if (name == "interpreter") {
+        engine = kInterpreterEngine;
+      } else if (name == "blocks") {
+        engine = kBlockCacheEngine;
+      } else if (name == "jit") {
+        engine = kJitEngine;
+      } else {
+        std::cerr << "Unknown engine: " << name << '\n';
+        return 1;
+      }
+    } else if (argument == "--compare" && i + 2 < argc) {
+      before_file = argv[++i];
+      after_file = argv[++i];
+    } else if (argument == "--threshold" && has_value) {
+      if (!parse_option(argument, argv[++i], threshold, 0, 1000)) {
+        print_usage(argv[0]);
+        return 1;
+      }
+    } else if (argument[0] != '-') {
+      directory = argument;
+    } else {
+      std::cerr << "Unknown argument: " << argument << '\n';
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (!before_file.empty()) {
+    return compare_files(before_file, after_file, threshold);
+  }
+  if (seconds <= 0 || cycles == 0) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  Benchmark benchmark(filter, seconds);
+  benchmark.run_handlers();
+  benchmark.run_display();
+  benchmark.run_programs(find_programs(directory), cycles, engine);
+
+  if (output_file.empty()) {
+    return 0;
+  }
+  std::FILE* file = std::fopen(output_file.c_str(), "wb");
+  if (file == nullptr) {
+    std::cerr << "Unable to write: " << output_file << '\n';
+    return 1;
+  }
+  bool written;
+  {
+    BufferedWriter out(file);
+    benchmark.write_json(out);
+    written = out.flush();
+  }
+  written &= std::fclose(file) == 0;
+  if (!written) {
+    std::cerr << "Unable to write: " << output_file << '\n';
+    return 1;
+  }
+  std::cout << benchmark.get_results().size() << " results written to "
+            << output_file << '\n';
+  return 0;
+}
@@ -0,0 +1,174 @@
+#include "chip8/aot.h"
+
+#include <cstring>
+
+#include "chip8/chip8.h"
+#include "chip8/interpreter.h"
+
+const u16 PROGRAM_START = 0x200;
+const u16 PROGRAM_AREA_SIZE = 4096 - PROGRAM_START;
+
+AotContext::AotContext(Chip8& chip8)
+    : v(chip8.state.general_purpose_variable_registers.data()),
+      stack(chip8.state.stack.data()),
+      index_register(chip8.state.index_register),
+      program_counter(chip8.state.program_counter),
+      stack_pointer(chip8.state.stack_pointer),
+      chip8(chip8) {}
+
+void AotContext::tick(u32 ticks) {
+  // Timers ticking per frame are updated by Chip8::run_frame
+  if (this->chip8.timer_mode != kInstructionTimers) {
+    return;
+  }
+  this->chip8.state.delay_timer =
+      this->chip8.state.delay_timer > ticks ? this->chip8.state.delay_timer - ticks : 0;
+  this->chip8.state.sound_timer =
+      this->chip8.state.sound_timer > ticks ? this->chip8.state.sound_timer - ticks : 0;
+}
+
+u8 AotContext::get_delay_timer(u32 pending_ticks) {
+  if (this->chip8.timer_mode != kInstructionTimers) {
+    return this->chip8.state.delay_timer;
+  }
+  return this->chip8.state.delay_timer > pending_ticks
+             ? this->chip8.state.delay_timer - pending_ticks
+             : 0;
+}
+
+bool AotContext::is_key_pressed(u8 key) {
+  return this->chip8.state.keypad.is_pressed(key);
+}
+
+void AotContext::interpret(u16 address) {
+  Interpreter interpreter(this->chip8);
+  this->chip8.state.program_counter = address;
+  interpreter.execute(1);
+}
+
+AotEngine::AotEngine(Chip8& chip8) : chip8(chip8) { this->flush(); }
+
+u32 AotEngine::run(u32 cycles) {
+  Interpreter interpreter(this->chip8);
+  AotContext context(this->chip8);
+  u32 executed = 0;
+
+  if (this->chip8.memory_written) {
+    this->invalidate_written_memory();
+  }
+
+  if (this->program == nullptr) {
+    return interpreter.execute(cycles);
+  }
+
+  while (executed < cycles && this->chip8.state.fault == kNoFault) {
+    if (this->chip8.memory_written) {
+      this->invalidate_written_memory();
+    }
+
+    const u16 address = this->chip8.state.program_counter;
+    const AotBlock* block = address < 4096 ? this->block_at[address] : nullptr;
+    if (block != nullptr && block->cycles <= cycles - executed) {
+      executed += block->function(context, cycles - executed);
+    } else {
+      executed += interpreter.execute(1);
+    }
+
+    // Fx0A without a pressed key executes itself again, and the keys do not
+    // change before we return
+    if (this->chip8.state.program_counter == address && address < 0x0FFF &&
+        Decoder::decode(this->chip8.state.memory[address] << 8 |
+                        this->chip8.state.memory[address + 1])
+                .operation == kWaitForKeyPressed) {
+      executed += interpreter.execute(cycles - executed);
+    }
+  }
+
+  return executed;
+}
+
+void AotEngine::flush() {
+  this->program = nullptr;
+  this->block_at.fill(nullptr);
+  this->attach();
+}
+
+bool AotEngine::register_program(const AotProgram& program) {
+  programs().push_back(program);
+  return true;
+}
+
+const AotProgram* AotEngine::find_program(const u8* rom, u32 size) {
+  for (const AotProgram& program : programs()) {
+    if (program.rom_size > size ||
+        std::memcmp(program.rom, rom, program.rom_size) != 0) {
+      continue;
+    }
+
+    bool padded_with_zeros = true;
+    for (u32 i = program.rom_size; i < size && padded_with_zeros; i++) {
+      padded_with_zeros = rom[i] == 0;
+    }
+    if (padded_with_zeros) {
+      return &program;
+    }
+  }
+
+  return nullptr;
+}
+
+void AotEngine::attach() {
+  this->program = find_program(&this->chip8.state.memory[PROGRAM_START],
+                               PROGRAM_AREA_SIZE);
+  this->block_at.fill(nullptr);
+  if (this->program == nullptr) {
+    return;
+  }
+
+  for (u16 i = 0; i < this->program->block_count; i++) {
+    const AotBlock& block = this->program->blocks[i];
+    this->block_at[block.start_address] = &block;
+  }
+}
+
+void AotEngine::invalidate_written_memory() {
+  const u16 begin = this->chip8.memory_written_begin;
+  const u16 end = this->chip8.memory_written_end;
+  this->chip8.memory_written = false;
+
+  // A new program was loaded (or none is attached yet)
+  if (this->program == nullptr || (begin <= PROGRAM_START && end == 4096)) {
+    this->attach();
+    return;
+  }
+
+  // Blocks whose code was changed are interpreted until it is restored
+  for (u16 i = 0; i < this->program->block_count; i++) {
+    const AotBlock& block = this->program->blocks[i];
+    if (block.start_address < end && begin < block.end_address) {
+      this->block_at[block.start_address] =
+          this->is_unmodified(block) ? &block : nullptr;
+    }
+  }
+}
+
+bool AotEngine::is_unmodified(const AotBlock& block) {
+  for (u16 address = block.start_address; address < block.end_address;
+       address++) {
+    const u16 offset = address - PROGRAM_START;
+    const u8 original =
+        offset < this->program->rom_size ? this->program->rom[offset] : 0;
+    if (this->chip8.state.memory[address] != original) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+std::vector<AotProgram>& AotEngine::programs() {
+  // Function local, so generated sources can register their programs during
+  // static initialization
+  static std::vector<AotProgram> registered;
+  return registered;
+}
@@ -0,0 +1,64 @@
+#include "chip8/arguments.h"
+
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+bool parse_number(const std::string& text, u64& value, int base) {
+  // strtoull also skips spaces and accepts a sign (negating the value)
+  if (text.empty() || !std::isdigit(static_cast<unsigned char>(text[0]))) {
+    return false;
+  }
+
+  char* end;
+  errno = 0;
+  const unsigned long long number = std::strtoull(text.c_str(), &end, base);
+  if (errno != 0 || end != text.c_str() + text.size()) {
+    return false;
+  }
+  value = number;
+  return true;
+}
+
+bool parse_number(const std::string& text, double& value) {
+  if (text.empty() || std::isspace(static_cast<unsigned char>(text[0]))) {
+    return false;
+  }
+
+  char* end;
+  errno = 0;
+  const double number = std::strtod(text.c_str(), &end);
+  if (errno != 0 || end != text.c_str() + text.size() ||
+      !std::isfinite(number)) {
+    return false;
+  }
+  value = number;
+  return true;
+}
+
+bool parse_option(const std::string& option, const std::string& text,
+                  u64& value, u64 minimum, u64 maximum, int base) {
+  u64 number;
+  if (!parse_number(text, number, base) || number < minimum ||
+      number > maximum) {
+    std::cerr << "Invalid value of " << option << ": " << text << " (a number"
+              << " from " << minimum << " to " << maximum << ")\n";
+    return false;
+  }
+  value = number;
+  return true;
+}
+
+bool parse_option(const std::string& option, const std::string& text,
+                  double& value, double minimum, double maximum) {
+  double number;
+  if (!parse_number(text, number) || number < minimum || number > maximum) {
+    std::cerr << "Invalid value of " << option << ": " << text << " (a number"
+              << " from " << minimum << " to " << maximum << ")\n";
+    return false;
+  }
+  value = number;
+  return true;
+}
@@ -0,0 +1,105 @@
+#include "chip8/audio.h"
+
+#include <algorithm>
+#include <cstring>
+
+AudioRing::AudioRing(u32 capacity)
+    : written(0), consumed(0), overruns(0), underruns(0) {
+  u32 size = 1;
+  while (size < capacity) {
+    size <<= 1;
+  }
+  this->samples.assign(size, 0);
+  this->mask = size - 1;
+}
+
+u32 AudioRing::write(const i16* samples, u32 count) {
+  const u64 written = this->written.load(std::memory_order_relaxed);
+  const u64 consumed = this->consumed.load(std::memory_order_acquire);
+  count = std::min<u64>(count, this->get_capacity() - (written - consumed));
+
+  // At most two copies, before and after the end of the ring
+  const u32 start = written & this->mask;
+  const u32 first = std::min(count, this->get_capacity() - start);
+  std::memcpy(&this->samples[start], samples, first * sizeof(i16));
+  std::memcpy(&this->samples[0], samples + first,
+              (count - first) * sizeof(i16));
+
+  // Publishes the samples to the consumer
+  this->written.store(written + count, std::memory_order_release);
+  return count;
+}
+
+u32 AudioRing::read(i16* samples, u32 count) {
+  const u64 consumed = this->consumed.load(std::memory_order_relaxed);
+  const u64 written = this->written.load(std::memory_order_acquire);
+  count = std::min<u64>(count, written - consumed);
+
+  const u32 start = consumed & this->mask;
+  const u32 first = std::min(count, this->get_capacity() - start);
+  std::memcpy(samples, &this->samples[start], first * sizeof(i16));
+  std::memcpy(samples + first, &this->samples[0],
+              (count - first) * sizeof(i16));
+
+  // Hands the room back to the producer
+  this->consumed.store(consumed + count, std::memory_order_release);
+  return count;
+}
+
+AudioGenerator::AudioGenerator(const AudioSettings& settings)
+    : settings(settings),
+      ring(settings.get_latency_samples()),
+      latency_samples(settings.get_latency_samples()),
+      frame(settings.sample_rate / FRAMES_PER_SECOND + 1),
+      remainder(0),
+      phase(0),
+      samples(0) {}
+
+void AudioGenerator::run_frame(bool sound) {
+  // sample_rate / 60 samples, with the fraction carried to the next frame
+  const u32 sixtieths = this->settings.sample_rate + this->remainder;
+  const u32 count = sixtieths / FRAMES_PER_SECOND;
+  this->remainder = sixtieths % FRAMES_PER_SECOND;
+  this->samples += count;
+
+  if (this->ring.get_size() + count > this->latency_samples) {
+    this->ring.record_overrun();
+    return;
+  }
+
+  i16* frame = this->frame.data();
+  if (!sound) {
+    std::fill(frame, frame + count, 0);
+    this->phase = 0;
+  } else {
+    // The phase advances by tone_frequency per sample, the first half of
+    // every period of sample_rate is high
+    const u32 rate = this->settings.sample_rate;
+    const u32 half = rate / 2;
+    const i16 amplitude = this->settings.amplitude;
+    for (u32 i = 0; i < count; i++) {
+      frame[i] = this->phase < half ? amplitude : -amplitude;
+      this->phase += this->settings.tone_frequency;
+      if (this->phase >= rate) {
+        this->phase -= rate;
+      }
+    }
+  }
+
+  this->ring.write(frame, count);
+}
+
+void NullAudioSink::drain(AudioRing& ring) {
+  i16 buffer[512];
+  u32 count;
+  while ((count = ring.read(buffer, 512)) > 0) {
+    const u8* bytes = reinterpret_cast<const u8*>(buffer);
+    for (u32 i = 0; i < count * sizeof(i16); i++) {
+      this->hash = (this->hash ^ bytes[i]) * 0x100000001B3ull;
+    }
+    for (u32 i = 0; i < count; i++) {
+      this->tone_samples += buffer[i] != 0;
+    }
+    this->samples += count;
+  }
+}
@@ -0,0 +1,93 @@
+#include "chip8/batch.h"
+
+#include <vector>
+
+Chip8Batch::Chip8Batch(u32 size, u32 threads)
+    : count(size),
+      instances(new Chip8[size]),
+      cycles_per_frame(new u32[size]),
+      halted(new bool[size]),
+      pool(threads) {
+  for (u32 i = 0; i < size; i++) {
+    this->cycles_per_frame[i] = 10;
+    this->halted[i] = false;
+  }
+}
+
+bool Chip8Batch::load_program(const void* source, u32 size) {
+  for (u32 i = 0; i < this->count; i++) {
+    if (!this->instances[i].save_rom(source, size)) {
+      return false;
+    }
+    this->halted[i] = false;
+  }
+  return true;
+}
+
+void Chip8Batch::set_engine(Chip8Engine engine) {
+  for (u32 i = 0; i < this->count; i++) {
+    this->instances[i].set_engine(engine);
+  }
+}
+
+void Chip8Batch::set_timer_mode(Chip8TimerMode mode) {
+  for (u32 i = 0; i < this->count; i++) {
+    this->instances[i].set_timer_mode(mode);
+  }
+}
+
+void Chip8Batch::set_quirks(Chip8Quirks quirks) {
+  for (u32 i = 0; i < this->count; i++) {
+    this->instances[i].set_quirks(quirks);
+  }
+}
+
+void Chip8Batch::set_random_seed(u64 seed) {
+  for (u32 i = 0; i < this->count; i++) {
+    this->instances[i].set_random_seed(seed, i);
+  }
+}
+
+void Chip8Batch::set_frame_budget(u32 index, u32 cycles_per_frame) {
+  this->cycles_per_frame[index] = cycles_per_frame;
+}
+
+u64 Chip8Batch::run_frames(u32 frames) {
+  const u32 tasks = (this->count + INSTANCES_PER_TASK - 1) / INSTANCES_PER_TASK;
+
+  // One counter per task, so the workers never write to a shared total
+  std::vector<u64> executed(tasks, 0);
+
+  this->pool.parallel_for(tasks, [&](u32 task) {
+    const u32 first = task * INSTANCES_PER_TASK;
+    const u32 last = first + INSTANCES_PER_TASK < this->count
+                         ? first + INSTANCES_PER_TASK
+                         : this->count;
+
+    u64 total = 0;
+    for (u32 i = first; i < last; i++) {
+      if (this->halted[i]) {
+        continue;
+      }
+
+      Chip8& chip8 = this->instances[i];
+      const u32 budget = this->cycles_per_frame[i];
+      // run_frame stops early only if the instance faults
+      for (u32 frame = 0; frame < frames; frame++) {
+        const u32 done = chip8.run_frame(budget);
+        total += done;
+        if (done < budget) {
+          this->halted[i] = true;
+          break;
+        }
+      }
+    }
+    executed[task] = total;
+  });
+
+  u64 total = 0;
+  for (u64 count : executed) {
+    total += count;
+  }
+  return total;
+}
@@ -0,0 +1,182 @@
+#include "chip8/block_cache.h"
+
+#include "chip8/chip8.h"
+#include "chip8/interpreter.h"
+
+BlockCache::BlockCache(Chip8& chip8) : chip8(chip8) { this->flush(); }
+
+u32 BlockCache::run(u32 cycles) {
+  return run_interpreter(this->chip8, [this, cycles](auto& interpreter) {
+    return interpreter.execute_blocks(*this, cycles);
+  });
+}
+
+void BlockCache::flush() {
+  this->block_at.fill(0);
+  this->blocks.clear();
+  this->instructions.clear();
+  this->code_pages = 0;
+}
+
+u16 BlockCache::translate(u16 address) {
+  if (this->instructions.size() > MAXIMUM_INSTRUCTIONS) {
+    this->flush();
+  }
+
+  Block block;
+  block.start_address = address;
+  block.cycles = 0;
+  block.size = 0;
+  block.first_instruction = this->instructions.size();
+  block.successor = 0;
+  block.valid = true;
+
+  const Decoder::Table& decoded = Decoder::table();
+  while (block.cycles < MAXIMUM_BLOCK_SIZE && address < 0x0FFF) {
+    const u16 opcode =
+        this->chip8.state.memory[address] << 8 | this->chip8.state.memory[address + 1];
+    const Instruction& instruction = decoded[opcode];
+
+    // Unknown opcodes are never part of a block, so they trap in the
+    // interpreter exactly where they are executed
+    if (instruction.operation == kUnknown) {
+      break;
+    }
+
+    address += 2;
+    block.cycles++;
+
+    if (block.size == 0 || !fuse(this->instructions.back(), instruction)) {
+      BlockInstruction single;
+      single.operation = instruction.operation;
+      single.cycles = 1;
+      single.first = instruction;
+      single.second = instruction;
+      this->instructions.push_back(single);
+      block.size++;
+    }
+
+    BlockInstruction& last = this->instructions.back();
+    last.opcode = opcode;
+    last.next_address = address;
+    last.synchronize_timers = synchronizes_timers(last.operation);
+
+    if (ends_block(instruction.operation)) {
+      break;
+    }
+  }
+
+  if (block.size == 0) {
+    return 0;
+  }
+
+  block.end_address = address;
+
+  // Mark all 64 byte pages covered by the block
+  block.pages = 0;
+  for (u16 page = block.start_address >> 6; page <= (address - 1) >> 6;
+       page++) {
+    block.pages |= 1ull << page;
+  }
+  this->code_pages |= block.pages;
+
+  this->blocks.push_back(block);
+  this->block_at[block.start_address] = this->blocks.size();
+
+  return this->blocks.size();
+}
+
+bool BlockCache::invalidate_written_memory() {
+  const u16 begin = this->chip8.memory_written_begin;
+  const u16 end = this->chip8.memory_written_end;
+  this->chip8.memory_written = false;
+
+  u64 written_pages = 0;
+  for (u16 page = begin >> 6; page <= (end - 1) >> 6; page++) {
+    written_pages |= 1ull << page;
+  }
+
+  // Fast path: the program only wrote to data
+  if ((written_pages & this->code_pages) == 0) {
+    return false;
+  }
+
+  this->code_pages = 0;
+  for (Block& block : this->blocks) {
+    if (!block.valid) {
+      continue;
+    }
+
+    if (block.start_address < end && begin < block.end_address) {
+      block.valid = false;
+      this->block_at[block.start_address] = 0;
+    } else {
+      this->code_pages |= block.pages;
+    }
+  }
+
+  return true;
+}
+
+bool BlockCache::ends_block(Operation operation) {
+  // Skip instructions do not end a block: when the skip is taken the
+  // program counter differs from the next address of the instruction and
+  // the block is left early (see BasicInterpreter::execute_blocks)
+  switch (operation) {
+    // Instructions that always change the program counter
+    case kReturnFromSubroutine:
+    case kJumpToLocation:
+    case kCallSubroutine:
+    case kJumpToExtendedLocation:
+    case kWaitForKeyPressed:
+    // Instructions that write to memory (and may modify the block itself)
+    case kStoreBinaryCodedDecimal:
+    case kStoreRegisters:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool BlockCache::synchronizes_timers(u8 operation) {
+  switch (operation) {
+    case kSetVxToDelayTimer:
+    case kSetDelayTimer:
+    case kSetSoundTimer:
+    case kDrawSprite:
+    case kDrawLargeSprite:
+    case kSetIndexRegisterAndDraw:
+    case kLoadDelayTimerAndSkipIfEqual:
+    case kLoadDelayTimerAndSkipIfNotEqual:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool BlockCache::fuse(BlockInstruction& previous, const Instruction& next) {
+  if (previous.cycles != 1) {
+    return false;
+  }
+
+  u8 fused = previous.operation;
+  if (previous.operation == kSetVx && next.operation == kSetVx) {
+    fused = kSetTwoRegisters;
+  } else if (previous.operation == kSetIndexRegister &&
+             next.operation == kDrawSprite) {
+    fused = kSetIndexRegisterAndDraw;
+  } else if (previous.operation == kSetVxToDelayTimer &&
+             next.operation == kSkipIfEqual) {
+    fused = kLoadDelayTimerAndSkipIfEqual;
+  } else if (previous.operation == kSetVxToDelayTimer &&
+             next.operation == kSkipIfNotEqual) {
+    fused = kLoadDelayTimerAndSkipIfNotEqual;
+  } else {
+    return false;
+  }
+
+  previous.operation = fused;
+  previous.cycles = 2;
+  previous.second = next;
+  return true;
+}
@@ -0,0 +1,95 @@
+#include "chip8/buffered_writer.h"
+
+#include <cstring>
+
+BufferedWriter::BufferedWriter(std::FILE* file, size_t capacity)
+    : file(file), buffer(capacity), used(0), line_start(0), failed(false) {}
+
+BufferedWriter::~BufferedWriter() { this->flush(); }
+
+void BufferedWriter::write(const char* data, size_t size) {
+  if (this->used + size > this->buffer.size()) {
+    this->flush();
+    if (size > this->buffer.size()) {
+      this->failed |= std::fwrite(data, 1, size, this->file) != size;
+      return;
+    }
+  }
+
+  std::memcpy(this->buffer.data() + this->used, data, size);
+  this->used += size;
+  for (size_t i = size; i > 0; i--) {
+    if (data[i - 1] == '\n') {
+      this->line_start = this->used - size + i;
+      break;
+    }
+  }
+}
+
+BufferedWriter& BufferedWriter::operator<<(char character) {
+  if (this->used == this->buffer.size()) {
+    this->flush();
+  }
+  this->buffer[this->used++] = character;
+  if (character == '\n') {
+    this->line_start = this->used;
+  }
+  return *this;
+}
+
+BufferedWriter& BufferedWriter::operator<<(const char* text) {
+  this->write(text, std::strlen(text));
+  return *this;
+}
+
+BufferedWriter& BufferedWriter::operator<<(const std::string& text) {
+  this->write(text.data(), text.size());
+  return *this;
+}
+
+BufferedWriter& BufferedWriter::operator<<(u64 value) {
+  char digits[20];
+  int count = 0;
+  do {
+    digits[count++] = '0' + value % 10;
+    value /= 10;
+  } while (value != 0);
+  while (count > 0) {
+    *this << digits[--count];
+  }
+  return *this;
+}
+
+void BufferedWriter::write_hex(u32 value, int digits) {
+  static const char HEX_DIGITS[] = "0123456789ABCDEF";
+  char text[8];
+  int count = 0;
+  do {
+    text[count++] = HEX_DIGITS[value & 0xF];
+    value >>= 4;
+  } while (value != 0 || count < digits);
+  while (count > 0) {
+    *this << text[--count];
+  }
+}
+
+void BufferedWriter::pad_to(size_t column) {
+  // Lines are only padded while they are still in the buffer, which holds
+  // far more than a line
+  while (this->used >= this->line_start &&
+         this->used - this->line_start < column) {
+    *this << ' ';
+  }
+}
+
+bool BufferedWriter::flush() {
+  if (this->used > 0) {
+    this->failed |=
+        std::fwrite(this->buffer.data(), 1, this->used, this->file) !=
+        this->used;
+    this->used = 0;
+  }
+  this->line_start = 0;
+  this->failed |= std::fflush(this->file) != 0;
+  return !this->failed;
+}
@@ -3,164 +3,347 @@
 #include <cstring>
 #include <iostream>
 
+#include "chip8/aot.h"
+#include "chip8/audio.h"
+#include "chip8/block_cache.h"
 #include "chip8/fontset.h"
 #include "chip8/interpreter.h"
+#include "chip8/jit.h"
 
 const int START_LOCATION_IN_MEMORY = 0x200;
 
 Chip8::Chip8() {
   this->draw_flag = true;
-  this->display = new Display();
+  this->state.fault = kNoFault;
+  this->engine = kInterpreterEngine;
+  this->timer_mode = kInstructionTimers;
+  this->quirks = kDefaultQuirks;
+  this->block_cache = nullptr;
+  this->jit = nullptr;
+  this->aot = nullptr;
+  this->trace = nullptr;
+  this->profiler = nullptr;
+  this->audio = nullptr;
+  this->idle_skipping = true;
+  this->skipped_cycles = 0;
+  this->memory_written = false;
+  this->memory_written_begin = 0;
+  this->memory_written_end = 0;
 
-  this->current_opcode = 0;
-  this->delay_timer = 0;
-  this->index_register = 0;
+  this->state.current_opcode = 0;
+  this->state.cycles = 0;
+  this->state.delay_timer = 0;
+  this->state.index_register = 0;
 
   // Program counter starts at 0x200 (Start adress program)
-  this->program_counter = START_LOCATION_IN_MEMORY;
+  this->state.program_counter = START_LOCATION_IN_MEMORY;
 
-  this->sound_timer = 0;
-  this->stack_pointer = 0;
+  this->state.sound_timer = 0;
+  this->state.stack_pointer = 0;
 
   // Apply zero to all elements in the containers
-  this->general_purpose_variable_registers.fill(0);
-  this->memory.fill(0);
-  this->stack.fill(0);
+  this->state.general_purpose_variable_registers.fill(0);
+  this->state.memory.fill(0);
+  this->state.stack.fill(0);
 
   // Load and store fontset (= 80 bytes)
   // @ memory locations 0x00 (location 0) to 0x4F (location 79)
-  memcpy(this->memory.data(), FONTSET.data(), FONTSET.size());
-
-  this->bind_instructions();
+  memcpy(this->state.memory.data(), FONTSET.data(), FONTSET.size());
 }
 
 Chip8::~Chip8() {
   // free up memories
-  delete this->display;
+  delete this->block_cache;
+  delete this->jit;
+  delete this->aot;
 }
 
-void Chip8::save_rom(const void* source) {
+bool Chip8::save_rom(const void* source, u32 size) {
+  const u32 program_area = this->state.memory.size() - START_LOCATION_IN_MEMORY;
+  if (size > program_area) {
+    std::cerr << "Program too large: " << size << " bytes (at most "
+              << program_area << ")\n";
+    return false;
+  }
+
   // 0x200 (512) Start of most Chip-8 programs
-  memcpy(this->memory.data() + START_LOCATION_IN_MEMORY, source,
-         this->memory.size() - START_LOCATION_IN_MEMORY);
+  u8* program = this->state.memory.data() + START_LOCATION_IN_MEMORY;
+  memcpy(program, source, size);
+  memset(program + size, 0, program_area - size);
+  this->mark_memory_written(START_LOCATION_IN_MEMORY, program_area);
+  return true;
+}
+
+void Chip8::cycle() { this->run(1); }
+
+u32 Chip8::run(u32 cycles) {
+  // Fetch, decode and execute up to the given number of operation codes.
+  // Decoding is a lookup in the shared table of the Decoder class and every
+  // operation jumps directly to the next one (see Interpreter::execute).
+  // Execution stops early if the Chip8 faults (e.g. on an unknown opcode).
+  // A traced Chip8 runs on the interpreter, which records the instructions.
+  // Compiled code only implements the default quirks.
+  if (this->idle_skipping && this->trace == nullptr &&
+      this->profiler == nullptr && this->state.fault == kNoFault) {
+    const u32 skipped = this->skip_idle_loop(cycles);
+    if (skipped > 0) {
+      this->state.cycles += skipped;
+      this->skipped_cycles += skipped;
+      return skipped;
+    }
+  }
+
+  Chip8Engine engine =
+      this->trace != nullptr ? kInterpreterEngine : this->engine;
+  if (this->quirks != kDefaultQuirks &&
+      (engine == kJitEngine || engine == kAotEngine)) {
+    engine = kInterpreterEngine;
+  }
+  u32 executed;
+  if (engine == kBlockCacheEngine) {
+    executed = this->block_cache->run(cycles);
+  } else if (engine == kJitEngine) {
+    executed = this->jit->run(cycles);
+  } else if (engine == kAotEngine) {
+    executed = this->aot->run(cycles);
+  } else {
+    executed = run_interpreter(*this, [cycles](auto& interpreter) {
+      return interpreter.execute(cycles);
+    });
+  }
+
+  this->state.cycles += executed;
+  return executed;
+}
+
+u32 Chip8::run_frame(u32 cycles) {
+  const u32 executed = this->run(cycles);
+  // The tone sounds in every frame that ends with a non-zero sound timer
+  if (this->audio != nullptr) {
+    this->audio->run_frame(this->state.sound_timer > 0);
+  }
+  if (this->timer_mode == kFrameTimers && this->state.fault == kNoFault) {
+    this->tick_timers();
+  }
+  return executed;
+}
+
+u32 Chip8::skip_idle_loop(u32 cycles) {
+  const u16 pc = this->state.program_counter;
+  const u16 opcode = this->read_opcode(pc);
+  if (cycles == 0 || pc > 0x0FFF) {
+    return 0;
+  }
+
+  // The loop starts at address with length instructions, the program
+  // counter is at instruction position of it
+  u16 address = pc;
+  u32 length = 1;
+  u32 position = 0;
+  u8 x = 0;
+  if ((opcode & 0xF0FF) == 0xF00A) {
+    if (this->state.keypad.get_keys() != 0) {
+      return 0;
+    }
+  } else if (opcode != (0x1000 | pc)) {
+    // The delay timer only ticks between runs with frame timers, so the
+    // loop reads the same value until the run ends
+    if (this->timer_mode != kFrameTimers || this->state.delay_timer == 0) {
+      return 0;
+    }
+    for (position = 0; position < 3; position++) {
+      address = pc - position * 2;
+      const u16 load = this->read_opcode(address);
+      x = load >> 8 & 0xF;
+      if ((load & 0xF0FF) == 0xF007 && address <= 0x0FFA &&
+          this->read_opcode(address + 2) == (0x3000 | x << 8) &&
+          this->read_opcode(address + 4) == (0x1000 | address)) {
+        break;
+      }
+    }
+    // 3x00 leaves the loop if Vx was not loaded from the delay timer
+    if (position == 3 ||
+        (position == 1 &&
+         this->state.general_purpose_variable_registers[x] == 0)) {
+      return 0;
+    }
+    length = 3;
+    // Fx07 runs as instruction (3 - position) % 3 of the run
+    if ((3 - position) % 3 < cycles) {
+      this->state.general_purpose_variable_registers[x] =
+          this->state.delay_timer;
+    }
+  }
+
+  // Instruction timers tick once per skipped instruction (the loops read
+  // them only with frame timers)
+  if (this->timer_mode == kInstructionTimers) {
+    this->state.delay_timer =
+        this->state.delay_timer > cycles ? this->state.delay_timer - cycles : 0;
+    this->state.sound_timer =
+        this->state.sound_timer > cycles ? this->state.sound_timer - cycles : 0;
+  }
+  this->state.current_opcode =
+      this->read_opcode(address + (position + cycles - 1) % length * 2);
+  this->state.program_counter = address + (position + cycles) % length * 2;
+  return cycles;
 }
 
-void Chip8::cycle() {
-  // Fetch the current operation code
-  this->current_opcode = this->memory[this->program_counter] << 8 |
-                         this->memory[this->program_counter + 1];
-
-  // Increment program counter before execution
-  this->program_counter += 2;
-
-  // Decode and execute the current operation code:
-  // We can declare four instruction groups, that share the same first nibble
-  // and therefore can be distinguished with a switch statement (0x0, 0x8, 0xE
-  // and 0xF). These four groups have more than one instruction and get further
-  // distinguished with the last nibble (0x0, 0x8 and 0xE) or the last byte
-  // (0xF). This last distinction is our instruction_subset.
-  // If the main switch statement does not match any of the upper four cases we
-  // call the default case, which will select the last instruction group. This
-  // group is a collective of instructions, that only have one instruction each
-  // which gets distinguished by the first nibble.
-  // Here the label 0x1 is used for this last group, although one of the
-  // following labels could just as well be used: 0x2, 0x3, 0x4, 0x5, 0x6, 0x7,
-  // 0x9, 0xA, 0xB, 0xC or 0xD.
-  switch ((this->current_opcode & 0xF000u) >> 12u) {
-    case 0x0:
-      instructions[0x0][(this->current_opcode & 0x000Fu)]();
-      break;
-    case 0x8:
-      instructions[0x8][(this->current_opcode & 0x000Fu)]();
-      break;
-    case 0xE:
-      instructions[0xE][(this->current_opcode & 0x000Fu)]();
-      break;
-    case 0xF:
-      instructions[0xF][(this->current_opcode & 0x00FFu)]();
-      break;
-    default: {
-      instructions[0x1][((this->current_opcode & 0xF000u) >> 12u)]();
+bool Chip8::is_waiting_for_input() {
+  const u16 pc = this->state.program_counter;
+  const u16 opcode = this->read_opcode(pc);
+  return this->state.fault == kNoFault && this->state.delay_timer == 0 &&
+         this->state.sound_timer == 0 && pc <= 0x0FFF &&
+         (((opcode & 0xF0FF) == 0xF00A &&
+           this->state.keypad.get_keys() == 0) ||
+          opcode == (0x1000 | pc));
+}
+
+const char* Chip8::get_fault_name(Chip8Fault fault) {
+  switch (fault) {
+    case kNoFault:
+      return "no fault";
+    case kUnknownOpcode:
+      return "unknown opcode";
+    case kStackOverflow:
+      return "stack overflow";
+    case kStackUnderflow:
+      return "stack underflow";
+  }
+  return "unknown fault";
+}
+
+const char* Chip8::get_quirks_name(Chip8Quirks quirks) {
+  switch (quirks) {
+    case kDefaultQuirks:
+      return "default";
+    case kCosmacVipQuirks:
+      return "vip";
+    case kChip48Quirks:
+      return "chip48";
+    case kSuperChipQuirks:
+      return "schip";
+  }
+  return "unknown";
+}
+
+bool Chip8::parse_quirks(const std::string& name, Chip8Quirks& quirks) {
+  for (Chip8Quirks candidate : {kDefaultQuirks, kCosmacVipQuirks,
+                                kChip48Quirks, kSuperChipQuirks}) {
+    if (name == get_quirks_name(candidate)) {
+      quirks = candidate;
+      return true;
     }
   }
+  return false;
+}
+
+void Chip8::restore(const Chip8State& state) {
+  this->state = state;
+  this->mark_memory_written(0, this->state.memory.size());
+  this->state.display.mark_all_rows_dirty();
+  this->draw_flag = true;
+}
+
+void Chip8::set_timer_mode(Chip8TimerMode mode) {
+  // Compiled code reads the delay timer depending on the mode
+  if (mode != this->timer_mode && this->jit != nullptr) {
+    this->jit->flush();
+  }
+  this->timer_mode = mode;
+}
 
-  // Update timers
-  // Decrement the delay timer if it's been set
-  if (this->delay_timer > 0) {
-    --this->delay_timer;
+void Chip8::set_engine(Chip8Engine engine) {
+  if (engine == kBlockCacheEngine && this->block_cache == nullptr) {
+    this->block_cache = new BlockCache(*this);
+  }
+  if (engine == kJitEngine && this->jit == nullptr) {
+    this->jit = new Jit(*this);
+  }
+  if (engine == kAotEngine && this->aot == nullptr) {
+    this->aot = new AotEngine(*this);
   }
 
-  // Decrement the sound timer if it's been set
-  if (this->sound_timer > 0) {
-    --this->sound_timer;
+  // Only the active engine tracks writes to memory, so the caches of an
+  // engine that was inactive for a while may be stale
+  if (engine != this->engine) {
+    if (engine == kBlockCacheEngine) {
+      this->block_cache->flush();
+    } else if (engine == kJitEngine) {
+      this->jit->flush();
+    } else if (engine == kAotEngine) {
+      this->aot->flush();
+    }
   }
+
+  this->engine = engine;
 }
 
 void Chip8::reset() {
   // Clear out rom data from memory
-  memset(this->memory.data() + START_LOCATION_IN_MEMORY, 0,
-         this->memory.size() - START_LOCATION_IN_MEMORY);
-  this->general_purpose_variable_registers.fill(0);
-  this->stack.fill(0);
-  this->index_register = 0;
-  this->program_counter = START_LOCATION_IN_MEMORY;
-  this->stack_pointer = 0;
-  this->delay_timer = 0;
-  this->sound_timer = 0;
-
-  display->clear_screen();
+  memset(this->state.memory.data() + START_LOCATION_IN_MEMORY, 0,
+         this->state.memory.size() - START_LOCATION_IN_MEMORY);
+  this->mark_memory_written(START_LOCATION_IN_MEMORY,
+                            this->state.memory.size() - START_LOCATION_IN_MEMORY);
+  this->state.general_purpose_variable_registers.fill(0);
+  this->state.stack.fill(0);
+  this->state.index_register = 0;
+  this->state.program_counter = START_LOCATION_IN_MEMORY;
+  this->state.stack_pointer = 0;
+  this->state.delay_timer = 0;
+  this->state.sound_timer = 0;
+  this->state.fault = kNoFault;
+  this->state.cycles = 0;
+  this->state.rand.reset();
+
+  this->state.display.select_planes(1);
+  this->state.display.set_high_resolution(false);
 }
 
-void Chip8::bind_instructions() {
-  Interpreter i(*this);
-
-  instructions[0x0][0x00] = std::bind(&Interpreter::clear_screen, i);
-  instructions[0x0][0x0E] = std::bind(&Interpreter::return_from_subroutine, i);
-  instructions[0x1][0x01] = std::bind(&Interpreter::jump_to_location, i);
-  instructions[0x1][0x02] = std::bind(&Interpreter::call_subroutine, i);
-  instructions[0x1][0x03] =
-      std::bind(&Interpreter::skip_next_instruction_if_equal, i);
-  instructions[0x1][0x04] =
-      std::bind(&Interpreter::skip_next_instruction_if_not_equal, i);
-  instructions[0x1][0x05] =
-      std::bind(&Interpreter::skip_next_instruction_if_vx_equal_vy, i);
-  instructions[0x1][0x06] =
-      std::bind(&Interpreter::set_general_purpose_variable_registers, i);
-  instructions[0x1][0x07] =
-      std::bind(&Interpreter::add_to_general_purpose_variable_registers, i);
-  instructions[0x1][0x09] =
-      std::bind(&Interpreter::skip_next_instruction_if_vx_not_equal_vy, i);
-  instructions[0x1][0x0A] = std::bind(&Interpreter::set_index_register, i);
-  instructions[0x1][0x0B] =
-      std::bind(&Interpreter::jump_to_extended_v0_location, i);
-  instructions[0x1][0x0C] = std::bind(&Interpreter::generate_random_number, i);
-  instructions[0x1][0x0D] = std::bind(&Interpreter::draw_sprite, i);
-  instructions[0x8][0x00] = std::bind(&Interpreter::load_vy_in_vx, i);
-  instructions[0x8][0x01] =
-      std::bind(&Interpreter::set_vx_to_bitwise_or_of_vx_and_vy, i);
-  instructions[0x8][0x02] =
-      std::bind(&Interpreter::set_vx_to_bitwise_and_of_vx_and_vy, i);
-  instructions[0x8][0x03] =
-      std::bind(&Interpreter::set_vx_to_bitwise_xor_of_vx_and_vy, i);
-  instructions[0x8][0x04] = std::bind(&Interpreter::add_vy_to_vx, i);
-  instructions[0x8][0x05] = std::bind(&Interpreter::subtract_vy_from_vx, i);
-  instructions[0x8][0x06] =
-      std::bind(&Interpreter::shift_vx_by_one_to_right, i);
-  instructions[0x8][0x07] = std::bind(&Interpreter::set_vx_to_vy_minus_vx, i);
-  instructions[0x8][0x0E] = std::bind(&Interpreter::shift_vx_by_one_to_left, i);
-  instructions[0xE][0x01] =
-      std::bind(&Interpreter::skip_instruction_if_key_is_not_pressed, i);
-  instructions[0xE][0x0E] =
-      std::bind(&Interpreter::skip_instruction_if_key_pressed, i);
-  instructions[0xF][0x07] = std::bind(&Interpreter::set_vx_to_delay_timer, i);
-  instructions[0xF][0x0A] = std::bind(&Interpreter::wait_for_key_pressed, i);
-  instructions[0xF][0x15] = std::bind(&Interpreter::set_delay_timer_to_vx, i);
-  instructions[0xF][0x18] = std::bind(&Interpreter::set_sound_timer_to_vx, i);
-  instructions[0xF][0x1E] = std::bind(&Interpreter::add_i_to_vx, i);
-  instructions[0xF][0x29] =
-      std::bind(&Interpreter::set_i_to_sprite_character_in_vx, i);
-  instructions[0xF][0x33] =
-      std::bind(&Interpreter::store_binary_coded_decimal_of_vx, i);
-  instructions[0xF][0x55] = std::bind(&Interpreter::store_registers_at_i, i);
-  instructions[0xF][0x65] = std::bind(&Interpreter::load_registers_from_i, i);
+u64 Chip8::get_state_hash(bool random_state) {
+  // 64-bit FNV-1a
+  u64 hash = 0xCBF29CE484222325ull;
+  auto add = [&hash](const void* data, size_t size) {
+    const u8* bytes = static_cast<const u8*>(data);
+    for (size_t i = 0; i < size; i++) {
+      hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+    }
+  };
+
+  add(this->state.memory.data(), this->state.memory.size());
+  add(this->state.general_purpose_variable_registers.data(),
+      this->state.general_purpose_variable_registers.size());
+  add(this->state.stack.data(), this->state.stack.size() * sizeof(u16));
+  add(&this->state.stack_pointer, sizeof(this->state.stack_pointer));
+  add(&this->state.program_counter, sizeof(this->state.program_counter));
+  add(&this->state.index_register, sizeof(this->state.index_register));
+  add(&this->state.delay_timer, sizeof(this->state.delay_timer));
+  add(&this->state.sound_timer, sizeof(this->state.sound_timer));
+  if (random_state) {
+    const u64 random = this->state.rand.get_state();
+    add(&random, sizeof(random));
+  }
+
+  // The rows of the basic 64x32 display, then everything else if the
+  // program used the extended display (hashes of basic states stay the
+  // same as before the extensions, so older movies still match)
+  Display& display = this->state.display;
+  for (int y = 0; y < 32; y++) {
+    const u64 row = display.get_row(y);
+    add(&row, sizeof(row));
+  }
+  if (!display.is_basic()) {
+    const u8 mode[2] = {display.is_high_resolution(),
+                        display.get_selected_planes()};
+    add(mode, sizeof(mode));
+    for (int plane = 0; plane < Display::PLANES; plane++) {
+      for (int y = 0; y < 64; y++) {
+        const u64 row[2] = {display.get_row(y, 0, plane),
+                            display.get_row(y, 1, plane)};
+        add(row, sizeof(row));
+      }
+    }
+  }
+
+  return hash;
 }
@@ -0,0 +1,148 @@
+#include "chip8/decoder.h"
+
+const Decoder::Table& Decoder::table() {
+  // Built on first use and shared by every Chip8 instance afterwards
+  static const Table* const kTable = [] {
+    Table* table = new Table();
+    for (u32 opcode = 0; opcode < table->size(); opcode++) {
+      (*table)[opcode] = decode_opcode(opcode);
+    }
+    return table;
+  }();
+
+  return *kTable;
+}
+
+Instruction Decoder::decode_opcode(u16 opcode) {
+  Instruction instruction;
+  instruction.operation = kUnknown;
+  instruction.x = (opcode & 0x0F00u) >> 8;
+  instruction.y = (opcode & 0x00F0u) >> 4;
+  instruction.n = opcode & 0x000Fu;
+  instruction.nn = opcode & 0x00FFu;
+  instruction.nnn = opcode & 0x0FFFu;
+
+  // Operations that are not listed here (e.g. 0nnn, 5xy1 or 8xy8) stay
+  // kUnknown and will trap when executed
+  switch ((opcode & 0xF000u) >> 12u) {
+    case 0x0:
+      if (opcode == 0x00E0) instruction.operation = kClearScreen;
+      if (opcode == 0x00EE) instruction.operation = kReturnFromSubroutine;
+      if ((opcode & 0xFFF0u) == 0x00C0) instruction.operation = kScrollDown;
+      if ((opcode & 0xFFF0u) == 0x00D0) instruction.operation = kScrollUp;
+      if (opcode == 0x00FB) instruction.operation = kScrollRight;
+      if (opcode == 0x00FC) instruction.operation = kScrollLeft;
+      if (opcode == 0x00FE) instruction.operation = kLowResolution;
+      if (opcode == 0x00FF) instruction.operation = kHighResolution;
+      break;
+    case 0x1:
+      instruction.operation = kJumpToLocation;
+      break;
+    case 0x2:
+      instruction.operation = kCallSubroutine;
+      break;
+    case 0x3:
+      instruction.operation = kSkipIfEqual;
+      break;
+    case 0x4:
+      instruction.operation = kSkipIfNotEqual;
+      break;
+    case 0x5:
+      if (instruction.n == 0x0) instruction.operation = kSkipIfVxEqualVy;
+      break;
+    case 0x6:
+      instruction.operation = kSetVx;
+      break;
+    case 0x7:
+      instruction.operation = kAddToVx;
+      break;
+    case 0x8:
+      switch (instruction.n) {
+        case 0x0:
+          instruction.operation = kLoadVyInVx;
+          break;
+        case 0x1:
+          instruction.operation = kOrVxVy;
+          break;
+        case 0x2:
+          instruction.operation = kAndVxVy;
+          break;
+        case 0x3:
+          instruction.operation = kXorVxVy;
+          break;
+        case 0x4:
+          instruction.operation = kAddVyToVx;
+          break;
+        case 0x5:
+          instruction.operation = kSubtractVyFromVx;
+          break;
+        case 0x6:
+          instruction.operation = kShiftRight;
+          break;
+        case 0x7:
+          instruction.operation = kSetVxToVyMinusVx;
+          break;
+        case 0xE:
+          instruction.operation = kShiftLeft;
+          break;
+      }
+      break;
+    case 0x9:
+      if (instruction.n == 0x0) instruction.operation = kSkipIfVxNotEqualVy;
+      break;
+    case 0xA:
+      instruction.operation = kSetIndexRegister;
+      break;
+    case 0xB:
+      instruction.operation = kJumpToExtendedLocation;
+      break;
+    case 0xC:
+      instruction.operation = kGenerateRandomNumber;
+      break;
+    case 0xD:
+      instruction.operation =
+          instruction.n == 0x0 ? kDrawLargeSprite : kDrawSprite;
+      break;
+    case 0xE:
+      if (instruction.nn == 0x9E) instruction.operation = kSkipIfKeyPressed;
+      if (instruction.nn == 0xA1) instruction.operation = kSkipIfKeyNotPressed;
+      break;
+    case 0xF:
+      switch (instruction.nn) {
+        case 0x01:
+          // Fn01: the plane mask n is in the place of x
+          if (instruction.x < 4) instruction.operation = kSelectPlanes;
+          break;
+        case 0x07:
+          instruction.operation = kSetVxToDelayTimer;
+          break;
+        case 0x0A:
+          instruction.operation = kWaitForKeyPressed;
+          break;
+        case 0x15:
+          instruction.operation = kSetDelayTimer;
+          break;
+        case 0x18:
+          instruction.operation = kSetSoundTimer;
+          break;
+        case 0x1E:
+          instruction.operation = kAddVxToI;
+          break;
+        case 0x29:
+          instruction.operation = kSetIToSpriteCharacter;
+          break;
+        case 0x33:
+          instruction.operation = kStoreBinaryCodedDecimal;
+          break;
+        case 0x55:
+          instruction.operation = kStoreRegisters;
+          break;
+        case 0x65:
+          instruction.operation = kLoadRegisters;
+          break;
+      }
+      break;
+  }
+
+  return instruction;
+}
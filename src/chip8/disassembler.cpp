@@ -1,33 +1,738 @@
 #include "chip8/disassembler.h"
 
-#include <fstream>
 #include <iostream>
+#include <set>
 
-Disassembler::Disassembler() : PROGRAM_STARTING_LOCATION(0x0200) {
-  this->program_counter = 0;
-  this->maximum_address_count = 0;
+#include "chip8/rom.h"
+
+// Bytes of data per line of the listing
+static const u16 DATA_PER_LINE = 8;
+// Columns of the listing: address, bytes, mnemonic, comment
+static const size_t BYTES_COLUMN = 9;
+static const size_t MNEMONIC_COLUMN = 15;
+static const size_t COMMENT_COLUMN = 44;
+
+Disassembler::Disassembler() : program_size(0) {
+  this->memory.fill(0);
+  this->bytes.fill(kUnreachedByte);
+  this->labels.fill(0);
+}
+
+bool Disassembler::load_program(const std::string& filename) {
+  RomFile rom;
+  if (!rom.open(filename)) {
+    return false;
+  }
+
+  // Name of the program: file name without directory
+  const size_t slash = filename.find_last_of("/\\");
+  this->load_program(rom.get_data(), rom.get_size(),
+                     filename.substr(slash == std::string::npos ? 0 : slash + 1));
+  this->program_size = rom.get_size();
+  return true;
+}
+
+void Disassembler::load_program(const void* program, u32 size,
+                                const std::string& name) {
+  const u8* source = static_cast<const u8*>(program);
+  if (size > 4096 - PROGRAM_START) {
+    size = 4096 - PROGRAM_START;
+  }
+  while (size > 0 && source[size - 1] == 0) {
+    size--;
+  }
+
+  this->program_name = name;
+  this->program_size = size;
+  this->memory.fill(0);
+  std::copy(source, source + size, this->memory.begin() + PROGRAM_START);
+  this->bytes.fill(kUnreachedByte);
+  this->labels.fill(0);
+  this->blocks.clear();
+}
+
+void Disassembler::analyze() {
+  this->bytes.fill(kUnreachedByte);
+  this->labels.fill(0);
+  this->blocks.clear();
+
+  this->labels[PROGRAM_START] |= kJumpLabel;
+  this->trace(PROGRAM_START);
+  this->find_blocks();
+}
+
+void Disassembler::trace(u16 entry) {
+  // Recursive descent: follow every path. The value of I is carried along
+  // each path, so code reached again with another value of I (e.g. both
+  // sides of a skip over an Annn) is walked again for the data it uses, up
+  // to MAXIMUM_INDEX_VALUES times.
+  std::vector<std::pair<u16, u16>> pending = {{entry, UNKNOWN_INDEX}};
+  std::set<std::pair<u16, u16>> visited;
+  std::array<u8, 4096> visits{};
+  const u16 end = this->get_program_end();
+
+  while (!pending.empty()) {
+    u16 address = pending.back().first;
+    u16 index = pending.back().second;
+    pending.pop_back();
+
+    for (;;) {
+      // Outside the program (e.g. the fontset), in the middle of an
+      // instruction traced before, or already traced with this value of I
+      if (address < PROGRAM_START || address + 2 > end ||
+          this->bytes[address] == kOperandByte ||
+          (this->bytes[address] != kCodeByte &&
+           this->bytes[address + 1] == kCodeByte)) {
+        break;
+      }
+      if (this->bytes[address] == kCodeByte &&
+          (visits[address] >= MAXIMUM_INDEX_VALUES ||
+           !visited.insert({address, index}).second)) {
+        break;
+      }
+      if (this->bytes[address] != kCodeByte) {
+        visited.insert({address, index});
+      }
+      visits[address]++;
+      this->bytes[address] = kCodeByte;
+      this->bytes[address + 1] = kOperandByte;
+
+      const Instruction& instruction = Decoder::decode(this->get_opcode(address));
+      const u16 next = address + 2;
+      bool ended = false;
+      switch (instruction.operation) {
+        case kUnknown:
+        case kReturnFromSubroutine:
+          ended = true;
+          break;
+        case kJumpToLocation:
+          this->labels[instruction.nnn] |= kJumpLabel;
+          address = instruction.nnn;
+          continue;
+        case kCallSubroutine:
+          this->labels[instruction.nnn] |= kCallLabel;
+          pending.push_back({instruction.nnn, index});
+          pending.push_back({next, UNKNOWN_INDEX});
+          ended = true;
+          break;
+        case kJumpToExtendedLocation:
+          // A jump table: the target and the jumps following it
+          this->labels[instruction.nnn] |= kJumpLabel;
+          for (u16 target = instruction.nnn; target + 2 <= end; target += 2) {
+            pending.push_back({target, UNKNOWN_INDEX});
+            if (Decoder::decode(this->get_opcode(target)).operation !=
+                kJumpToLocation) {
+              break;
+            }
+          }
+          ended = true;
+          break;
+        case kSkipIfEqual:
+        case kSkipIfNotEqual:
+        case kSkipIfVxEqualVy:
+        case kSkipIfVxNotEqualVy:
+        case kSkipIfKeyPressed:
+        case kSkipIfKeyNotPressed:
+          pending.push_back({next + 2, index});
+          break;
+        case kSetIndexRegister:
+          index = instruction.nnn;
+          this->labels[index] |= kDataLabel;
+          break;
+        case kAddVxToI:
+        case kSetIToSpriteCharacter:
+          index = UNKNOWN_INDEX;
+          break;
+        case kDrawSprite:
+          this->mark_data(index, instruction.n, kSpriteByte);
+          break;
+        case kDrawLargeSprite:
+          // 16 rows of two bytes (of the first plane)
+          this->mark_data(index, 32, kSpriteByte);
+          break;
+        case kStoreBinaryCodedDecimal:
+          this->mark_data(index, 3, kDataByte);
+          break;
+        case kStoreRegisters:
+        case kLoadRegisters:
+          this->mark_data(index, instruction.x + 1, kDataByte);
+          break;
+        default:
+          break;
+      }
+
+      if (ended) {
+        break;
+      }
+      address = next;
+    }
+  }
+}
+
+void Disassembler::mark_data(u16 address, u16 length, DisassembledByte kind) {
+  if (address == UNKNOWN_INDEX) {
+    return;
+  }
+
+  // Code found later takes the bytes back (see trace), sprites win over
+  // other data
+  const u16 end = this->get_program_end();
+  for (u16 i = address; i < address + length && i < end; i++) {
+    if (i >= PROGRAM_START && (this->bytes[i] == kUnreachedByte ||
+                               (this->bytes[i] == kDataByte &&
+                                kind == kSpriteByte))) {
+      this->bytes[i] = kind;
+    }
+  }
+}
+
+void Disassembler::find_blocks() {
+  // Blocks start at the entry point and at every target of a branch (skips
+  // at the end of memory mark up to 4 bytes beyond it)
+  std::array<bool, 4096 + 4> leaders{};
+  leaders[PROGRAM_START] = true;
+  for (u16 address = PROGRAM_START; address < this->get_program_end();
+       address++) {
+    if (!this->is_code(address)) {
+      continue;
+    }
+    const Instruction& instruction = Decoder::decode(this->get_opcode(address));
+    switch (instruction.operation) {
+      case kJumpToLocation:
+        leaders[instruction.nnn] = true;
+        break;
+      case kCallSubroutine:
+        leaders[instruction.nnn] = true;
+        leaders[address + 2] = true;
+        break;
+      case kJumpToExtendedLocation:
+        for (u16 target = instruction.nnn; this->is_code(target); target += 2) {
+          leaders[target] = true;
+          if (Decoder::decode(this->get_opcode(target)).operation !=
+              kJumpToLocation) {
+            break;
+          }
+        }
+        break;
+      case kSkipIfEqual:
+      case kSkipIfNotEqual:
+      case kSkipIfVxEqualVy:
+      case kSkipIfVxNotEqualVy:
+      case kSkipIfKeyPressed:
+      case kSkipIfKeyNotPressed:
+        leaders[address + 2] = true;
+        leaders[address + 4] = true;
+        break;
+      default:
+        break;
+    }
+  }
+
+  for (u16 start = PROGRAM_START; start < this->get_program_end(); start++) {
+    if (!leaders[start] || !this->is_code(start)) {
+      continue;
+    }
+
+    DisassembledBlock block = {start, start, 0, {}};
+    u16 address = start;
+    for (;;) {
+      const Instruction& instruction =
+          Decoder::decode(this->get_opcode(address));
+      const u16 next = address + 2;
+      block.instructions++;
+      block.end_address = next;
+
+      bool ended = true;
+      switch (instruction.operation) {
+        case kUnknown:
+        case kReturnFromSubroutine:
+          break;
+        case kJumpToLocation:
+          block.successors.push_back({instruction.nnn, kJumpEdge});
+          break;
+        case kCallSubroutine:
+          block.successors.push_back({instruction.nnn, kCallEdge});
+          block.successors.push_back({next, kReturnEdge});
+          break;
+        case kJumpToExtendedLocation:
+          for (u16 target = instruction.nnn; this->is_code(target);
+               target += 2) {
+            block.successors.push_back({target, kTableEdge});
+            if (Decoder::decode(this->get_opcode(target)).operation !=
+                kJumpToLocation) {
+              break;
+            }
+          }
+          break;
+        case kSkipIfEqual:
+        case kSkipIfNotEqual:
+        case kSkipIfVxEqualVy:
+        case kSkipIfVxNotEqualVy:
+        case kSkipIfKeyPressed:
+        case kSkipIfKeyNotPressed:
+          block.successors.push_back({next, kFallThroughEdge});
+          block.successors.push_back({static_cast<u16>(next + 2), kSkipEdge});
+          break;
+        default:
+          ended = !this->is_code(next) || leaders[next];
+          if (ended && this->is_code(next)) {
+            block.successors.push_back({next, kFallThroughEdge});
+          }
+          break;
+      }
+
+      if (ended) {
+        break;
+      }
+      address = next;
+    }
+
+    this->blocks[start] = block;
+  }
+}
+
+u32 Disassembler::get_instruction_count() {
+  return this->get_byte_count(kCodeByte);
+}
+
+u32 Disassembler::get_byte_count(DisassembledByte kind) {
+  u32 count = 0;
+  for (u16 address = PROGRAM_START; address < this->get_program_end();
+       address++) {
+    count += this->bytes[address] == kind;
+  }
+  return count;
 }
 
-Disassembler::~Disassembler() {}
+void Disassembler::write_listing(BufferedWriter& out) {
+  out << "; " << this->program_name << ": "
+      << static_cast<u64>(this->program_size) << " bytes, "
+      << static_cast<u64>(this->get_instruction_count()) << " instructions in "
+      << static_cast<u64>(this->get_block_count()) << " blocks\n"
+      << "; " << static_cast<u64>(this->get_byte_count(kSpriteByte))
+      << " bytes of sprites, "
+      << static_cast<u64>(this->get_byte_count(kDataByte))
+      << " bytes of data, "
+      << static_cast<u64>(this->get_byte_count(kUnreachedByte))
+      << " bytes not reached\n";
+
+  const u16 end = this->get_program_end();
+  u16 address = PROGRAM_START;
+  while (address < end) {
+    if (this->labels[address] != 0) {
+      out << '\n';
+      this->write_label(out, address);
+      out << ":\n";
+    }
 
-void Disassembler::load_program(std::string filename) {
-  // create variable of type ifstream and connect it to our input file
-  std::ifstream program_file(filename,
-                             std::ios::in | std::ios::binary | std::ios::ate);
+    out << "  0x";
+    out.write_hex(address, 3);
+    out.pad_to(BYTES_COLUMN);
 
-  // check if the file is open and associated with this stream object
-  if (!program_file.is_open()) {
-    throw std::string("Unable to load program. ");
+    if (this->bytes[address] == kCodeByte) {
+      const u16 opcode = this->get_opcode(address);
+      out.write_hex(opcode, 4);
+      out.pad_to(MNEMONIC_COLUMN);
+      this->write_instruction(out, opcode);
+      if (Decoder::decode(opcode).operation == kUnknown) {
+        out.pad_to(COMMENT_COLUMN);
+        out << "; unknown instruction";
+      }
+      out << '\n';
+      address += 2;
+      continue;
+    }
+
+    // Data up to the next label, the next code or a change of kind
+    const DisassembledByte kind = this->bytes[address];
+    u16 data_end = address + 1;
+    while (data_end < end && data_end - address < DATA_PER_LINE &&
+           this->bytes[data_end] == kind && this->labels[data_end] == 0 &&
+           !(kind == kSpriteByte || kind == kOperandByte)) {
+      data_end++;
+    }
+    // Linear sweep: unreached words are shown with the instruction they
+    // would be, two bytes per line
+    if (kind == kUnreachedByte) {
+      data_end = address + 2 <= end && this->bytes[address + 1] == kind &&
+                         this->labels[address + 1] == 0
+                     ? address + 2
+                     : address + 1;
+    }
+    this->write_data(out, address, data_end);
+    address = data_end;
   }
+}
 
-  // get size of the program
-  this->program_size = program_file.tellg();
-  this->maximum_address_count = PROGRAM_STARTING_LOCATION + this->program_size;
+void Disassembler::write_data(BufferedWriter& out, u16 address, u16 end) {
+  for (u16 i = address; i < end; i++) {
+    out.write_hex(this->memory[i], 2);
+  }
+  out.pad_to(MNEMONIC_COLUMN);
+  out << "db    ";
+  for (u16 i = address; i < end; i++) {
+    out << (i == address ? "0x" : ", 0x");
+    out.write_hex(this->memory[i], 2);
+  }
 
-  std::cout << ";------------------------------------" << std::endl;
-  std::cout << "; Program: " << filename << std::endl;
-  std::cout << "; Size: " << this->program_size << " Bytes" << std::endl;
-  std::cout << ";------------------------------------" << std::endl;
+  switch (this->bytes[address]) {
+    case kSpriteByte:
+      // The pixels of the sprite row
+      out.pad_to(COMMENT_COLUMN);
+      out << "; ";
+      for (int bit = 7; bit >= 0; bit--) {
+        out << ((this->memory[address] >> bit) & 1 ? '#' : '.');
+      }
+      break;
+    case kUnreachedByte:
+      if (end - address == 2 &&
+          Decoder::decode(this->get_opcode(address)).operation != kUnknown) {
+        out.pad_to(COMMENT_COLUMN);
+        out << "; ";
+        this->write_instruction(out, this->get_opcode(address));
+      }
+      break;
+    case kOperandByte:
+      // Only reached by a jump into the middle of an instruction
+      out.pad_to(COMMENT_COLUMN);
+      out << "; inside an instruction";
+      break;
+    default:
+      break;
+  }
+  out << '\n';
+}
 
-  program_file.close();
+void Disassembler::write_label(BufferedWriter& out, u16 address) {
+  const u8 label = this->labels[address];
+  if (address == PROGRAM_START) {
+    out << "start";
+    return;
+  }
+  if (label & kCallLabel) {
+    out << "sub_";
+  } else if ((label & kJumpLabel) || this->bytes[address] == kCodeByte) {
+    out << "L_";
+  } else {
+    out << (this->bytes[address] == kSpriteByte ? "sprite_" : "data_");
+  }
+  out.write_hex(address, 3);
+}
+
+void Disassembler::write_address(BufferedWriter& out, u16 address) {
+  // Labels are only written inside the program
+  if (address >= PROGRAM_START && address < this->get_program_end() &&
+      this->labels[address] != 0) {
+    this->write_label(out, address);
+    return;
+  }
+  out << "0x";
+  out.write_hex(address, 3);
+}
+
+void Disassembler::write_instruction(BufferedWriter& out, u16 opcode) {
+  const Instruction& instruction = Decoder::decode(opcode);
+  auto mnemonic = [&out](const char* name) {
+    out << name;
+    for (size_t length = std::char_traits<char>::length(name); length < 6;
+         length++) {
+      out << ' ';
+    }
+  };
+  auto vx = [&]() {
+    out << 'V';
+    out.write_hex(instruction.x, 1);
+  };
+  auto vy = [&]() {
+    out << 'V';
+    out.write_hex(instruction.y, 1);
+  };
+  auto nn = [&]() {
+    out << "0x";
+    out.write_hex(instruction.nn, 2);
+  };
+
+  switch (instruction.operation) {
+    case kClearScreen:
+      out << "CLS";
+      break;
+    case kReturnFromSubroutine:
+      out << "RET";
+      break;
+    case kJumpToLocation:
+      mnemonic("JP");
+      this->write_address(out, instruction.nnn);
+      break;
+    case kCallSubroutine:
+      mnemonic("CALL");
+      this->write_address(out, instruction.nnn);
+      break;
+    case kSkipIfEqual:
+      mnemonic("SE");
+      vx();
+      out << ", ";
+      nn();
+      break;
+    case kSkipIfNotEqual:
+      mnemonic("SNE");
+      vx();
+      out << ", ";
+      nn();
+      break;
+    case kSkipIfVxEqualVy:
+      mnemonic("SE");
+      vx();
+      out << ", ";
+      vy();
+      break;
+    case kSetVx:
+      mnemonic("LD");
+      vx();
+      out << ", ";
+      nn();
+      break;
+    case kAddToVx:
+      mnemonic("ADD");
+      vx();
+      out << ", ";
+      nn();
+      break;
+    case kLoadVyInVx:
+      mnemonic("LD");
+      vx();
+      out << ", ";
+      vy();
+      break;
+    case kOrVxVy:
+      mnemonic("OR");
+      vx();
+      out << ", ";
+      vy();
+      break;
+    case kAndVxVy:
+      mnemonic("AND");
+      vx();
+      out << ", ";
+      vy();
+      break;
+    case kXorVxVy:
+      mnemonic("XOR");
+      vx();
+      out << ", ";
+      vy();
+      break;
+    case kAddVyToVx:
+      mnemonic("ADD");
+      vx();
+      out << ", ";
+      vy();
+      break;
+    case kSubtractVyFromVx:
+      mnemonic("SUB");
+      vx();
+      out << ", ";
+      vy();
+      break;
+    case kShiftRight:
+      mnemonic("SHR");
+      vx();
+      break;
+    case kSetVxToVyMinusVx:
+      mnemonic("SUBN");
+      vx();
+      out << ", ";
+      vy();
+      break;
+    case kShiftLeft:
+      mnemonic("SHL");
+      vx();
+      break;
+    case kSkipIfVxNotEqualVy:
+      mnemonic("SNE");
+      vx();
+      out << ", ";
+      vy();
+      break;
+    case kSetIndexRegister:
+      mnemonic("LD");
+      out << "I, ";
+      this->write_address(out, instruction.nnn);
+      break;
+    case kJumpToExtendedLocation:
+      mnemonic("JP");
+      out << "V0, ";
+      this->write_address(out, instruction.nnn);
+      break;
+    case kGenerateRandomNumber:
+      mnemonic("RND");
+      vx();
+      out << ", ";
+      nn();
+      break;
+    case kDrawSprite:
+      mnemonic("DRW");
+      vx();
+      out << ", ";
+      vy();
+      out << ", " << static_cast<u64>(instruction.n);
+      break;
+    case kSkipIfKeyPressed:
+      mnemonic("SKP");
+      vx();
+      break;
+    case kSkipIfKeyNotPressed:
+      mnemonic("SKNP");
+      vx();
+      break;
+    case kSetVxToDelayTimer:
+      mnemonic("LD");
+      vx();
+      out << ", DT";
+      break;
+    case kWaitForKeyPressed:
+      mnemonic("LD");
+      vx();
+      out << ", K";
+      break;
+    case kSetDelayTimer:
+      mnemonic("LD");
+      out << "DT, ";
+      vx();
+      break;
+    case kSetSoundTimer:
+      mnemonic("LD");
+      out << "ST, ";
+      vx();
+      break;
+    case kAddVxToI:
+      mnemonic("ADD");
+      out << "I, ";
+      vx();
+      break;
+    case kSetIToSpriteCharacter:
+      mnemonic("LD");
+      out << "F, ";
+      vx();
+      break;
+    case kStoreBinaryCodedDecimal:
+      mnemonic("LD");
+      out << "B, ";
+      vx();
+      break;
+    case kStoreRegisters:
+      mnemonic("LD");
+      out << "[I], ";
+      vx();
+      break;
+    case kLoadRegisters:
+      mnemonic("LD");
+      vx();
+      out << ", [I]";
+      break;
+    case kScrollDown:
+      mnemonic("SCD");
+      out << static_cast<u64>(instruction.n);
+      break;
+    case kScrollUp:
+      mnemonic("SCU");
+      out << static_cast<u64>(instruction.n);
+      break;
+    case kScrollRight:
+      out << "SCR";
+      break;
+    case kScrollLeft:
+      out << "SCL";
+      break;
+    case kLowResolution:
+      out << "LOW";
+      break;
+    case kHighResolution:
+      out << "HIGH";
+      break;
+    case kDrawLargeSprite:
+      mnemonic("DRW");
+      vx();
+      out << ", ";
+      vy();
+      out << ", 0";
+      break;
+    case kSelectPlanes:
+      mnemonic("PLANE");
+      out << static_cast<u64>(instruction.x);
+      break;
+    default:
+      // 0nnn (machine code routine of the COSMAC VIP) and invalid codes
+      if ((opcode & 0xF000) == 0) {
+        mnemonic("SYS");
+        out << "0x";
+        out.write_hex(opcode, 3);
+      } else {
+        mnemonic("DW");
+        out << "0x";
+        out.write_hex(opcode, 4);
+      }
+      break;
+  }
+}
+
+void Disassembler::write_graph(BufferedWriter& out,
+                               DisassemblerGraphFormat format) {
+  static const char* const EDGE_NAMES[] = {"fallthrough", "skip",   "jump",
+                                           "call",        "return", "table"};
+
+  if (format == kDotGraph) {
+    out << "digraph \"" << this->program_name << "\" {\n"
+        << "  node [shape=box, fontname=\"monospace\"];\n";
+    for (const auto& entry : this->blocks) {
+      const DisassembledBlock& block = entry.second;
+      out << "  b";
+      out.write_hex(block.start_address, 3);
+      out << " [label=\"";
+      if (this->labels[block.start_address] != 0) {
+        this->write_label(out, block.start_address);
+        out << ":\\l";
+      }
+      for (u16 address = block.start_address; address < block.end_address;
+           address += 2) {
+        out << "0x";
+        out.write_hex(address, 3);
+        out << "  ";
+        this->write_instruction(out, this->get_opcode(address));
+        out << "\\l";
+      }
+      out << "\"];\n";
+      for (const auto& successor : block.successors) {
+        out << "  b";
+        out.write_hex(block.start_address, 3);
+        out << " -> b";
+        out.write_hex(successor.first, 3);
+        out << " [label=\"" << EDGE_NAMES[successor.second] << "\"];\n";
+      }
+    }
+    out << "}\n";
+    return;
+  }
+
+  out << "{\n  \"program\": \"" << this->program_name << "\",\n"
+      << "  \"size\": " << static_cast<u64>(this->program_size) << ",\n"
+      << "  \"blocks\": [";
+  bool first = true;
+  for (const auto& entry : this->blocks) {
+    const DisassembledBlock& block = entry.second;
+    out << (first ? "\n" : ",\n") << "    {\"start\": "
+        << static_cast<u64>(block.start_address)
+        << ", \"end\": " << static_cast<u64>(block.end_address)
+        << ", \"instructions\": " << static_cast<u64>(block.instructions)
+        << ", \"label\": \"";
+    this->write_label(out, block.start_address);
+    out << "\", \"successors\": [";
+    for (size_t i = 0; i < block.successors.size(); i++) {
+      out << (i == 0 ? "" : ", ") << "{\"address\": "
+          << static_cast<u64>(block.successors[i].first) << ", \"edge\": \""
+          << EDGE_NAMES[block.successors[i].second] << "\"}";
+    }
+    out << "]}";
+    first = false;
+  }
+  out << "\n  ]\n}\n";
 }
@@ -0,0 +1,141 @@
+#include "chip8/display.h"
+
+#include <cstring>
+
+void Display::set_high_resolution(bool enabled) {
+  this->high_resolution = enabled;
+  this->rows = {};
+  this->mark_all_rows_dirty();
+}
+
+bool Display::is_valid() const {
+  // The bytes of the bool, loading an invalid bool is undefined
+  u8 high_resolution;
+  std::memcpy(&high_resolution, &this->high_resolution, 1);
+  return high_resolution <= 1 && this->planes < (1u << PLANES);
+}
+
+bool Display::draw_planes(u8 x, u8 y, const u8* sprite, u8 height,
+                          u8 width) {
+  const int display_height = this->get_height();
+  x %= this->get_width();
+  y %= display_height;
+  const u8 visible_rows =
+      height > display_height - y ? display_height - y : height;
+
+  u64 collision = 0;
+  for (int plane = 0; plane < PLANES; plane++) {
+    if ((this->planes & (1u << plane)) == 0) {
+      continue;
+    }
+
+    for (u8 row = 0; row < visible_rows; row++) {
+      // The sprite row at the left edge of a 128 pixel row, shifted to x
+      // across both words (the second word is clipped in low resolution)
+      const u8* bytes = sprite + row * width;
+      const u64 pixels = width == 2
+                             ? static_cast<u64>(bytes[0] << 8 | bytes[1]) << 48
+                             : static_cast<u64>(bytes[0]) << 56;
+      const u64 left = x < 64 ? pixels >> x : 0;
+      u64 right = 0;
+      if (this->high_resolution && x > 0) {
+        right = x < 64 ? pixels << (64 - x) : pixels >> (x - 64);
+      }
+
+      std::array<u64, 2>& line = this->rows[plane][y + row];
+      collision |= (line[0] & left) | (line[1] & right);
+      line[0] ^= left;
+      line[1] ^= right;
+      if ((left | right) != 0) {
+        this->dirty_rows |= 1ull << (y + row);
+      }
+    }
+
+    // The data of the next plane follows the whole sprite
+    sprite += height * width;
+  }
+
+  return collision != 0;
+}
+
+void Display::scroll_down(u8 count) {
+  const int height = this->get_height();
+  if (count > height) {
+    count = height;
+  }
+  for (int plane = 0; plane < PLANES; plane++) {
+    if ((this->planes & (1u << plane)) != 0) {
+      // One move of the rows that stay on the display
+      std::array<u64, 2>* rows = this->rows[plane].data();
+      std::memmove(rows + count, rows, (height - count) * sizeof(*rows));
+      std::memset(rows, 0, count * sizeof(*rows));
+    }
+  }
+  this->mark_all_rows_dirty();
+}
+
+void Display::scroll_up(u8 count) {
+  const int height = this->get_height();
+  if (count > height) {
+    count = height;
+  }
+  for (int plane = 0; plane < PLANES; plane++) {
+    if ((this->planes & (1u << plane)) != 0) {
+      std::array<u64, 2>* rows = this->rows[plane].data();
+      std::memmove(rows, rows + count, (height - count) * sizeof(*rows));
+      std::memset(rows + height - count, 0, count * sizeof(*rows));
+    }
+  }
+  this->mark_all_rows_dirty();
+}
+
+void Display::scroll_right() {
+  const int height = this->get_height();
+  for (int plane = 0; plane < PLANES; plane++) {
+    if ((this->planes & (1u << plane)) == 0) {
+      continue;
+    }
+    // Independent shifts of every row, which the compiler vectorizes
+    std::array<std::array<u64, 2>, HIGH_RES_HEIGHT>& rows = this->rows[plane];
+    if (this->high_resolution) {
+      for (int y = 0; y < height; y++) {
+        rows[y][1] = rows[y][1] >> 4 | rows[y][0] << 60;
+        rows[y][0] >>= 4;
+      }
+    } else {
+      for (int y = 0; y < height; y++) {
+        rows[y][0] >>= 4;
+      }
+    }
+  }
+  this->mark_all_rows_dirty();
+}
+
+void Display::scroll_left() {
+  const int height = this->get_height();
+  for (int plane = 0; plane < PLANES; plane++) {
+    if ((this->planes & (1u << plane)) == 0) {
+      continue;
+    }
+    std::array<std::array<u64, 2>, HIGH_RES_HEIGHT>& rows = this->rows[plane];
+    if (this->high_resolution) {
+      for (int y = 0; y < height; y++) {
+        rows[y][0] = rows[y][0] << 4 | rows[y][1] >> 60;
+        rows[y][1] <<= 4;
+      }
+    } else {
+      for (int y = 0; y < height; y++) {
+        rows[y][0] <<= 4;
+      }
+    }
+  }
+  this->mark_all_rows_dirty();
+}
+
+bool Display::is_plane_empty(int plane) {
+  u64 pixels = 0;
+  for (const std::array<u64, 2>& row : this->rows[plane]) {
+    pixels |= row[0] | row[1];
+  }
+  return pixels == 0;
+}
@@ -1,280 +1,743 @@
 #include "chip8/interpreter.h"
 
-u8 Interpreter::get_x() { return (chip8.current_opcode & 0x0F00u) >> 8; }
-u8 Interpreter::get_y() { return (chip8.current_opcode & 0x00F0u) >> 4; }
+#include "chip8/trace.h"
 
-void Interpreter::clear_screen() {
-  chip8.display->clear_screen();
+template <typename Quirks>
+u32 BasicInterpreter<Quirks>::execute(u32 cycles) {
+  // The loop without a trace does not even check for one
+  return chip8.trace != nullptr ? this->execute_instructions<true>(cycles)
+                                : this->execute_instructions<false>(cycles);
+}
+
+template <typename Quirks>
+template <bool kTraced>
+u32 BasicInterpreter<Quirks>::execute_instructions(u32 cycles) {
+  const Instruction* const decoded = Decoder::table().data();
+  u32 executed = 0;
+
+  if (chip8.state.fault != kNoFault) {
+    return executed;
+  }
+
+#if defined(__GNUC__)
+  // Direct threading (GCC/Clang labels as values): after executing an
+  // operation we fetch the next operation code and jump straight to the
+  // label of its handler, without going back to a central switch statement.
+#define CHIP8_DISPATCH_LABEL(name, handler) &&execute_##handler,
+  static void* const kDispatchTable[kOperationCount] = {
+      &&execute_unknown, CHIP8_OPERATIONS(CHIP8_DISPATCH_LABEL)};
+#undef CHIP8_DISPATCH_LABEL
+
+#define CHIP8_DISPATCH()                   \
+  if (executed == cycles) return executed; \
+  this->fetch<kTraced>(decoded);           \
+  goto* kDispatchTable[this->instruction->operation]
+
+#define CHIP8_DISPATCH_HANDLER(name, handler)                \
+  execute_##handler:                                         \
+  this->handler();                                           \
+  if (can_fault(k##name) && chip8.state.fault != kNoFault) { \
+    return executed;                                         \
+  }                                                          \
+  this->update_timers();                                     \
+  ++executed;                                                \
+  CHIP8_DISPATCH();
+
+  CHIP8_DISPATCH();
+  CHIP8_OPERATIONS(CHIP8_DISPATCH_HANDLER)
+
+execute_unknown:
+  this->trap_unknown_opcode();
+  return executed;
+
+#undef CHIP8_DISPATCH_HANDLER
+#undef CHIP8_DISPATCH
+#else
+  // Portable fallback: a single switch statement over the decoded operation
+#define CHIP8_DISPATCH_CASE(name, handler) \
+  case k##name:                            \
+    this->handler();                       \
+    break;
+
+  while (executed < cycles) {
+    this->fetch<kTraced>(decoded);
+    switch (this->instruction->operation) {
+      CHIP8_OPERATIONS(CHIP8_DISPATCH_CASE)
+      default:
+        this->trap_unknown_opcode();
+        return executed;
+    }
+    if (chip8.state.fault != kNoFault) {
+      return executed;
+    }
+    this->update_timers();
+    ++executed;
+  }
+  return executed;
+
+#undef CHIP8_DISPATCH_CASE
+#endif
+}
+
+template <typename Quirks>
+u32 BasicInterpreter<Quirks>::execute_blocks(BlockCache& cache, u32 cycles) {
+  // Timer updates are collected and only applied before instructions that
+  // need up to date timers (see BlockInstruction::synchronize_timers),
+  // before falling back to the interpreter and when returning
+  u16 pending_ticks = 0;
+  u32 executed = 0;
+  u16 previous = 0;
+  const BlockInstruction* i = nullptr;
+  const BlockInstruction* last = nullptr;
+
+  if (chip8.state.fault != kNoFault) {
+    return executed;
+  }
+
+#define CHIP8_BLOCK_PROLOGUE()               \
+  if (i->synchronize_timers) {               \
+    this->update_timers(pending_ticks);      \
+    pending_ticks = 0;                       \
+  }                                          \
+  chip8.state.program_counter = i->next_address; \
+  this->instruction = &i->first
+
+// Side exit: leave the block early if a skip instruction was taken
+#define CHIP8_BLOCK_EPILOGUE()                                  \
+  pending_ticks += i->cycles;                                   \
+  executed += i->cycles;                                        \
+  if (i == last || chip8.state.program_counter != i->next_address) { \
+    goto exit_block;                                            \
+  }                                                             \
+  i++
+
+#define CHIP8_SUPERINSTRUCTIONS(SUPERINSTRUCTION)                           \
+  SUPERINSTRUCTION(SetTwoRegisters, set_general_purpose_variable_registers, \
+                   set_general_purpose_variable_registers)                  \
+  SUPERINSTRUCTION(SetIndexRegisterAndDraw, set_index_register,             \
+                   draw_sprite)                                             \
+  SUPERINSTRUCTION(LoadDelayTimerAndSkipIfEqual, set_vx_to_delay_timer,     \
+                   skip_next_instruction_if_equal)                          \
+  SUPERINSTRUCTION(LoadDelayTimerAndSkipIfNotEqual,                         \
+                   set_vx_to_delay_timer, skip_next_instruction_if_not_equal)
+
+#if defined(__GNUC__)
+  // Direct threading, same as in execute_instructions
+#define CHIP8_BLOCK_LABEL(name, handler) &&block_##name,
+#define CHIP8_BLOCK_FUSED_LABEL(name, first_handler, second_handler) \
+  &&block_##name,
+  static void* const kDispatchTable[] = {
+      &&exit_block, CHIP8_OPERATIONS(CHIP8_BLOCK_LABEL)
+                        CHIP8_SUPERINSTRUCTIONS(CHIP8_BLOCK_FUSED_LABEL)};
+#undef CHIP8_BLOCK_FUSED_LABEL
+#undef CHIP8_BLOCK_LABEL
+#endif
+
+  while (executed < cycles) {
+    if (chip8.memory_written && cache.invalidate_written_memory()) {
+      previous = 0;
+    }
+
+    // Blocks are linked to the block executed after them, so most of the
+    // time this does not even need to look at block_at
+    const u16 index = cache.find(chip8.state.program_counter, previous);
+    if (index == 0 || cache.get_block(index).cycles > cycles - executed) {
+      // No block (e.g. unknown opcode ahead) or not enough cycles left to
+      // run the whole block: fall back to a single interpreted instruction
+      this->update_timers(pending_ticks);
+      pending_ticks = 0;
+      executed += this->execute(1);
+      previous = 0;
+
+      if (chip8.state.fault != kNoFault) {
+        break;
+      }
+      continue;
+    }
+
+    const Block& block = cache.get_block(index);
+    i = cache.get_instructions(block);
+    last = i + block.size - 1;
+    previous = index;
+
+#if defined(__GNUC__)
+#define CHIP8_BLOCK_DISPATCH() \
+  CHIP8_BLOCK_PROLOGUE();      \
+  goto* kDispatchTable[i->operation]
+
+#define CHIP8_BLOCK_HANDLER(name, handler) \
+  block_##name:                            \
+  this->handler();                         \
+  CHIP8_BLOCK_EPILOGUE();                  \
+  CHIP8_BLOCK_DISPATCH();
+
+#define CHIP8_BLOCK_FUSED_HANDLER(name, first_handler, second_handler) \
+  block_##name:                                                        \
+  this->first_handler();                                               \
+  this->instruction = &i->second;                                      \
+  this->second_handler();                                              \
+  CHIP8_BLOCK_EPILOGUE();                                              \
+  CHIP8_BLOCK_DISPATCH();
+
+    CHIP8_BLOCK_DISPATCH();
+    CHIP8_OPERATIONS(CHIP8_BLOCK_HANDLER)
+    CHIP8_SUPERINSTRUCTIONS(CHIP8_BLOCK_FUSED_HANDLER)
+
+#undef CHIP8_BLOCK_FUSED_HANDLER
+#undef CHIP8_BLOCK_HANDLER
+#undef CHIP8_BLOCK_DISPATCH
+#else
+#define CHIP8_BLOCK_CASE(name, handler) \
+  case k##name:                         \
+    this->handler();                    \
+    break;
+
+#define CHIP8_BLOCK_FUSED_CASE(name, first_handler, second_handler) \
+  case k##name:                                                     \
+    this->first_handler();                                          \
+    this->instruction = &i->second;                                 \
+    this->second_handler();                                         \
+    break;
+
+    for (;;) {
+      CHIP8_BLOCK_PROLOGUE();
+      switch (i->operation) {
+        CHIP8_OPERATIONS(CHIP8_BLOCK_CASE)
+        CHIP8_SUPERINSTRUCTIONS(CHIP8_BLOCK_FUSED_CASE)
+      }
+      CHIP8_BLOCK_EPILOGUE();
+    }
+
+#undef CHIP8_BLOCK_FUSED_CASE
+#undef CHIP8_BLOCK_CASE
+#endif
+
+  exit_block:
+    chip8.state.current_opcode = i->opcode;
+    if (chip8.state.fault != kNoFault) {
+      // The faulting instruction was not executed
+      pending_ticks -= i->cycles;
+      executed -= i->cycles;
+      break;
+    }
+  }
+
+#undef CHIP8_SUPERINSTRUCTIONS
+#undef CHIP8_BLOCK_EPILOGUE
+#undef CHIP8_BLOCK_PROLOGUE
+
+  this->update_timers(pending_ticks);
+  return executed;
+}
+
+template <typename Quirks>
+void BasicInterpreter<Quirks>::execute_fetched(const Instruction& instruction) {
+  this->instruction = &instruction;
+
+#define CHIP8_FETCHED_CASE(name, handler) \
+  case k##name:                           \
+    this->handler();                      \
+    break;
+
+  switch (instruction.operation) {
+    CHIP8_OPERATIONS(CHIP8_FETCHED_CASE)
+    default:
+      this->trap_unknown_opcode();
+      break;
+  }
+
+#undef CHIP8_FETCHED_CASE
+}
+
+template <typename Quirks>
+template <bool kTraced>
+void BasicInterpreter<Quirks>::fetch(const Instruction* decoded) {
+  // The address space is 4 KB, so we never read outside of the memory
+  const u16 address = chip8.state.program_counter & 0x0FFFu;
+  chip8.state.current_opcode =
+      chip8.state.memory[address] << 8 | chip8.state.memory[(address + 1) & 0x0FFFu];
+  if (kTraced) {
+    chip8.trace->append(chip8.state, address, chip8.state.current_opcode);
+  }
+
+  // Increment program counter before execution
+  chip8.state.program_counter += 2;
+
+  this->instruction = &decoded[chip8.state.current_opcode];
+  CHIP8_PROFILE(chip8,
+                count_instruction(address, this->instruction->operation));
+}
+
+template <typename Quirks>
+void BasicInterpreter<Quirks>::update_timers() {
+  // Timers ticking per frame are updated by Chip8::run_frame
+  if (chip8.timer_mode != kInstructionTimers) {
+    return;
+  }
+
+  // Decrement the delay timer if it's been set
+  if (chip8.state.delay_timer > 0) {
+    --chip8.state.delay_timer;
+  }
+
+  // Decrement the sound timer if it's been set
+  if (chip8.state.sound_timer > 0) {
+    --chip8.state.sound_timer;
+  }
+}
+
+template <typename Quirks>
+void BasicInterpreter<Quirks>::update_timers(u16 ticks) {
+  if (chip8.timer_mode != kInstructionTimers) {
+    return;
+  }
+  chip8.state.delay_timer = chip8.state.delay_timer > ticks ? chip8.state.delay_timer - ticks : 0;
+  chip8.state.sound_timer = chip8.state.sound_timer > ticks ? chip8.state.sound_timer - ticks : 0;
+}
+
+template <typename Quirks>
+void BasicInterpreter<Quirks>::trap_unknown_opcode() {
+  this->trap(kUnknownOpcode);
+}
+
+template <typename Quirks>
+void BasicInterpreter<Quirks>::trap(Chip8Fault fault) {
+  // Point the program counter back to the offending operation code, so it
+  // can be inspected (and the Chip8 stays halted until it is reset)
+  chip8.state.program_counter -= 2;
+  chip8.state.fault = fault;
+}
+
+template <typename Quirks>
+void BasicInterpreter<Quirks>::clear_screen() {
+  chip8.state.display.clear_screen();
   chip8.draw_flag = true;
 }
 
-void Interpreter::return_from_subroutine() {
-  // TODO: Why --chip8.stack_pointer and not chip8.stack_pointer--
-  chip8.program_counter = chip8.stack[--chip8.stack_pointer];
+template <typename Quirks>
+void BasicInterpreter<Quirks>::return_from_subroutine() {
+  if (chip8.state.stack_pointer == 0) {
+    this->trap(kStackUnderflow);
+    return;
+  }
+  CHIP8_PROFILE(chip8, leave_subroutine());
+  // The stack pointer points to the next free level of the stack
+  chip8.state.program_counter = chip8.state.stack[--chip8.state.stack_pointer];
 }
 
-void Interpreter::jump_to_location() {
-  const u16 address = chip8.current_opcode & 0x0FFFu;
-  chip8.program_counter = address;
+template <typename Quirks>
+void BasicInterpreter<Quirks>::jump_to_location() {
+  const u16 address = this->get_nnn();
+  chip8.state.program_counter = address;
 }
 
-void Interpreter::call_subroutine() {
-  const u16 address = chip8.current_opcode & 0x0FFFu;
-  chip8.stack[chip8.stack_pointer++] = chip8.program_counter;
-  chip8.program_counter = address;
+template <typename Quirks>
+void BasicInterpreter<Quirks>::call_subroutine() {
+  const u16 address = this->get_nnn();
+  if (chip8.state.stack_pointer == chip8.state.stack.size()) {
+    this->trap(kStackOverflow);
+    return;
+  }
+  chip8.state.stack[chip8.state.stack_pointer++] = chip8.state.program_counter;
+  chip8.state.program_counter = address;
+  CHIP8_PROFILE(chip8, enter_subroutine(address));
 }
 
-void Interpreter::skip_next_instruction_if_equal() {
+template <typename Quirks>
+void BasicInterpreter<Quirks>::skip_next_instruction_if_equal() {
   const u8 Vx = this->get_x();
-  const u8 byte = chip8.current_opcode & 0x00FFu;
-  if (chip8.general_purpose_variable_registers[Vx] == byte) {
-    chip8.program_counter += 2;
+  const u8 byte = this->get_nn();
+  if (chip8.state.general_purpose_variable_registers[Vx] == byte) {
+    chip8.state.program_counter += 2;
   }
 }
 
-void Interpreter::skip_next_instruction_if_not_equal() {
+template <typename Quirks>
+void BasicInterpreter<Quirks>::skip_next_instruction_if_not_equal() {
   const u8 Vx = this->get_x();
-  const u8 byte = chip8.current_opcode & 0x00FFu;
-  if (chip8.general_purpose_variable_registers[Vx] != byte) {
-    chip8.program_counter += 2;
+  const u8 byte = this->get_nn();
+  if (chip8.state.general_purpose_variable_registers[Vx] != byte) {
+    chip8.state.program_counter += 2;
   }
 }
 
-void Interpreter::skip_next_instruction_if_vx_equal_vy() {
+template <typename Quirks>
+void BasicInterpreter<Quirks>::skip_next_instruction_if_vx_equal_vy() {
   const u8 Vx = this->get_x();
   const u8 Vy = this->get_y();
-  if (chip8.general_purpose_variable_registers[Vx] ==
-      chip8.general_purpose_variable_registers[Vy]) {
-    chip8.program_counter += 2;
+  if (chip8.state.general_purpose_variable_registers[Vx] ==
+      chip8.state.general_purpose_variable_registers[Vy]) {
+    chip8.state.program_counter += 2;
   }
 }
 
-void Interpreter::set_general_purpose_variable_registers() {
+template <typename Quirks>
+void BasicInterpreter<Quirks>::set_general_purpose_variable_registers() {
   const u8 Vx = this->get_x();
-  const u8 byte = chip8.current_opcode & 0x00FFu;
-  chip8.general_purpose_variable_registers[Vx] = byte;
+  const u8 byte = this->get_nn();
+  chip8.state.general_purpose_variable_registers[Vx] = byte;
 }
 
-void Interpreter::add_to_general_purpose_variable_registers() {
+template <typename Quirks>
+void BasicInterpreter<Quirks>::add_to_general_purpose_variable_registers() {
   const u8 Vx = this->get_x();
-  const u8 byte = chip8.current_opcode & 0x00FFu;
-  chip8.general_purpose_variable_registers[Vx] += byte;
+  const u8 byte = this->get_nn();
+  chip8.state.general_purpose_variable_registers[Vx] += byte;
 }
 
-void Interpreter::load_vy_in_vx() {
+template <typename Quirks>
+void BasicInterpreter<Quirks>::load_vy_in_vx() {
   const u8 Vx = this->get_x();
   const u8 Vy = this->get_y();
-  chip8.general_purpose_variable_registers[Vx] =
-      chip8.general_purpose_variable_registers[Vy];
+  chip8.state.general_purpose_variable_registers[Vx] =
+      chip8.state.general_purpose_variable_registers[Vy];
 }
 
-void Interpreter::set_vx_to_bitwise_or_of_vx_and_vy() {
+template <typename Quirks>
+void BasicInterpreter<Quirks>::set_vx_to_bitwise_or_of_vx_and_vy() {
   const u8 Vx = this->get_x();
   const u8 Vy = this->get_y();
-  chip8.general_purpose_variable_registers[Vx] |=
-      chip8.general_purpose_variable_registers[Vy];
+  chip8.state.general_purpose_variable_registers[Vx] |=
+      chip8.state.general_purpose_variable_registers[Vy];
+  if (Quirks::LOGIC_RESETS_VF) {
+    chip8.state.general_purpose_variable_registers[0xF] = 0;
+  }
 }
 
-void Interpreter::set_vx_to_bitwise_and_of_vx_and_vy() {
+template <typename Quirks>
+void BasicInterpreter<Quirks>::set_vx_to_bitwise_and_of_vx_and_vy() {
   const u8 Vx = this->get_x();
   const u8 Vy = this->get_y();
-  chip8.general_purpose_variable_registers[Vx] &=
-      chip8.general_purpose_variable_registers[Vy];
+  chip8.state.general_purpose_variable_registers[Vx] &=
+      chip8.state.general_purpose_variable_registers[Vy];
+  if (Quirks::LOGIC_RESETS_VF) {
+    chip8.state.general_purpose_variable_registers[0xF] = 0;
+  }
 }
 
-void Interpreter::set_vx_to_bitwise_xor_of_vx_and_vy() {
+template <typename Quirks>
+void BasicInterpreter<Quirks>::set_vx_to_bitwise_xor_of_vx_and_vy() {
   const u8 Vx = this->get_x();
   const u8 Vy = this->get_y();
-  chip8.general_purpose_variable_registers[Vx] ^=
-      chip8.general_purpose_variable_registers[Vy];
+  chip8.state.general_purpose_variable_registers[Vx] ^=
+      chip8.state.general_purpose_variable_registers[Vy];
+  if (Quirks::LOGIC_RESETS_VF) {
+    chip8.state.general_purpose_variable_registers[0xF] = 0;
+  }
 }
 
-void Interpreter::add_vy_to_vx() {
+template <typename Quirks>
+void BasicInterpreter<Quirks>::add_vy_to_vx() {
   const u8 Vx = this->get_x();
   const u8 Vy = this->get_y();
-  const u16 sum = chip8.general_purpose_variable_registers[Vy] +
-                  chip8.general_purpose_variable_registers[Vx];
+  const u16 sum = chip8.state.general_purpose_variable_registers[Vy] +
+                  chip8.state.general_purpose_variable_registers[Vx];
 
-  chip8.general_purpose_variable_registers[0xF] = (sum > 255) ? 1 : 0;
-  chip8.general_purpose_variable_registers[Vx] = sum & 0xFF;
+  chip8.state.general_purpose_variable_registers[0xF] = (sum > 255) ? 1 : 0;
+  chip8.state.general_purpose_variable_registers[Vx] = sum & 0xFF;
 }
 
-void Interpreter::subtract_vy_from_vx() {
+template <typename Quirks>
+void BasicInterpreter<Quirks>::subtract_vy_from_vx() {
   const u8 Vx = this->get_x();
   const u8 Vy = this->get_y();
 
-  chip8.general_purpose_variable_registers[0xF] =
-      (chip8.general_purpose_variable_registers[Vx] >
-       chip8.general_purpose_variable_registers[Vy])
+  chip8.state.general_purpose_variable_registers[0xF] =
+      (chip8.state.general_purpose_variable_registers[Vx] >
+       chip8.state.general_purpose_variable_registers[Vy])
           ? 1
           : 0;
 
-  chip8.general_purpose_variable_registers[Vx] -=
-      chip8.general_purpose_variable_registers[Vy];
+  chip8.state.general_purpose_variable_registers[Vx] -=
+      chip8.state.general_purpose_variable_registers[Vy];
 }
 
-void Interpreter::shift_vx_by_one_to_right() {
+template <typename Quirks>
+void BasicInterpreter<Quirks>::shift_vx_by_one_to_right() {
   const u8 Vx = get_x();
 
+  if (Quirks::SHIFT_VY) {
+    // Vy shifted into Vx, VF written last
+    const u8 value = chip8.state.general_purpose_variable_registers[get_y()];
+    chip8.state.general_purpose_variable_registers[Vx] = value >> 1;
+    chip8.state.general_purpose_variable_registers[0xF] = value & 0x1u;
+    return;
+  }
+
   // get the least-significant bit of Vx
-  chip8.general_purpose_variable_registers[0xF] =
-      (chip8.general_purpose_variable_registers[Vx] & 0x1u);
+  chip8.state.general_purpose_variable_registers[0xF] =
+      (chip8.state.general_purpose_variable_registers[Vx] & 0x1u);
 
   // shift Vx one to the right
-  chip8.general_purpose_variable_registers[Vx] >>= 1;
+  chip8.state.general_purpose_variable_registers[Vx] >>= 1;
 }
 
-void Interpreter::set_vx_to_vy_minus_vx() {
+template <typename Quirks>
+void BasicInterpreter<Quirks>::set_vx_to_vy_minus_vx() {
   const u8 Vx = this->get_x();
   const u8 Vy = this->get_y();
 
-  chip8.general_purpose_variable_registers[0xF] =
-      (chip8.general_purpose_variable_registers[Vy] >
-       chip8.general_purpose_variable_registers[Vx])
+  chip8.state.general_purpose_variable_registers[0xF] =
+      (chip8.state.general_purpose_variable_registers[Vy] >
+       chip8.state.general_purpose_variable_registers[Vx])
           ? 1
           : 0;
 
-  chip8.general_purpose_variable_registers[Vx] =
-      chip8.general_purpose_variable_registers[Vy] -
-      chip8.general_purpose_variable_registers[Vx];
+  chip8.state.general_purpose_variable_registers[Vx] =
+      chip8.state.general_purpose_variable_registers[Vy] -
+      chip8.state.general_purpose_variable_registers[Vx];
 }
 
-void Interpreter::shift_vx_by_one_to_left() {
+template <typename Quirks>
+void BasicInterpreter<Quirks>::shift_vx_by_one_to_left() {
   const u8 Vx = get_x();
 
+  if (Quirks::SHIFT_VY) {
+    // Vy shifted into Vx, VF written last
+    const u8 value = chip8.state.general_purpose_variable_registers[get_y()];
+    chip8.state.general_purpose_variable_registers[Vx] = value << 1;
+    chip8.state.general_purpose_variable_registers[0xF] = value >> 7u;
+    return;
+  }
+
   // get the most-significant bit of Vx
-  chip8.general_purpose_variable_registers[0xF] =
-      (chip8.general_purpose_variable_registers[Vx] & 0x80u) >> 7u;
+  chip8.state.general_purpose_variable_registers[0xF] =
+      (chip8.state.general_purpose_variable_registers[Vx] & 0x80u) >> 7u;
 
   // shift Vx one to the left
-  chip8.general_purpose_variable_registers[Vx] <<= 1;
+  chip8.state.general_purpose_variable_registers[Vx] <<= 1;
 }
 
-void Interpreter::skip_next_instruction_if_vx_not_equal_vy() {
+template <typename Quirks>
+void BasicInterpreter<Quirks>::skip_next_instruction_if_vx_not_equal_vy() {
   const u8 Vx = this->get_x();
   const u8 Vy = this->get_y();
-  if (chip8.general_purpose_variable_registers[Vx] !=
-      chip8.general_purpose_variable_registers[Vy]) {
-    chip8.program_counter += 2;
+  if (chip8.state.general_purpose_variable_registers[Vx] !=
+      chip8.state.general_purpose_variable_registers[Vy]) {
+    chip8.state.program_counter += 2;
   }
 }
 
-void Interpreter::set_index_register() {
-  const u16 address = chip8.current_opcode & 0x0FFFu;
-  chip8.index_register = address;
+template <typename Quirks>
+void BasicInterpreter<Quirks>::set_index_register() {
+  const u16 address = this->get_nnn();
+  chip8.state.index_register = address;
 }
 
-void Interpreter::jump_to_extended_v0_location() {
-  const u16 address = chip8.current_opcode & 0x0FFFu;
-  chip8.program_counter = chip8.general_purpose_variable_registers[0] + address;
+template <typename Quirks>
+void BasicInterpreter<Quirks>::jump_to_extended_v0_location() {
+  const u16 address = this->get_nnn();
+  // Bxnn: relative to Vx, where x is the first digit of the address
+  const u8 V = Quirks::JUMP_VX ? this->get_x() : 0;
+  chip8.state.program_counter = chip8.state.general_purpose_variable_registers[V] + address;
 }
 
-void Interpreter::generate_random_number() {
+template <typename Quirks>
+void BasicInterpreter<Quirks>::generate_random_number() {
   const u8 Vx = this->get_x();
-  const u8 byte = chip8.current_opcode & 0x00FFu;
-  chip8.general_purpose_variable_registers[Vx] =
-      chip8.rand.get_random_number() & byte;
-}
-
-void Interpreter::draw_sprite() {
-  const u16 Vx = chip8.general_purpose_variable_registers[this->get_x()];
-  const u16 Vy = chip8.general_purpose_variable_registers[this->get_y()];
-  const u16 height = chip8.current_opcode & 0x000F;
-  u16 pixel;
-
-  chip8.general_purpose_variable_registers[0xF] = 0;
-
-  for (size_t y = 0; y < height; y++) {
-    pixel = chip8.memory[chip8.index_register + y];
-    for (size_t x = 0; x < 8; x++) {
-      if (pixel & (0x80u >> x)) {
-        u32 loc = x + Vx + (y + Vy) * chip8.display->get_width();
-        if (chip8.display->operator[](loc)) {
-          chip8.general_purpose_variable_registers[0xF] = 1;
-        }
-        chip8.display->operator[](loc) ^= 1;
-      }
-    }
+  const u8 byte = this->get_nn();
+  chip8.state.general_purpose_variable_registers[Vx] =
+      chip8.state.rand.get_random_number() & byte;
+}
+
+template <typename Quirks>
+void BasicInterpreter<Quirks>::draw_sprite() {
+  const u8 Vx = chip8.state.general_purpose_variable_registers[this->get_x()];
+  const u8 Vy = chip8.state.general_purpose_variable_registers[this->get_y()];
+  const u8 height = this->get_n();
+
+  // Sprite data wraps around the end of the memory like the fetch (height
+  // bytes for each selected plane)
+  u8 sprite[15 * Display::PLANES];
+  const u8 size = chip8.state.display.get_selected_planes() == 1
+                      ? height
+                      : height * this->count_selected_planes();
+  for (u8 y = 0; y < size; y++) {
+    sprite[y] = chip8.state.memory[(chip8.state.index_register + y) & 0x0FFFu];
   }
+  CHIP8_PROFILE(chip8, count_read(chip8.state.index_register, size));
+
+  chip8.state.general_purpose_variable_registers[0xF] =
+      chip8.state.display.draw_sprite(Vx, Vy, sprite, height) ? 1 : 0;
   chip8.draw_flag = true;
 }
 
-void Interpreter::skip_instruction_if_key_pressed() {
+template <typename Quirks>
+void BasicInterpreter<Quirks>::skip_instruction_if_key_pressed() {
   const u8 Vx = this->get_x();
-  if (chip8.keypad.is_pressed(chip8.general_purpose_variable_registers[Vx])) {
-    chip8.program_counter += 2;
+  if (chip8.state.keypad.is_pressed(chip8.state.general_purpose_variable_registers[Vx])) {
+    chip8.state.program_counter += 2;
   }
 }
 
-void Interpreter::skip_instruction_if_key_is_not_pressed() {
+template <typename Quirks>
+void BasicInterpreter<Quirks>::skip_instruction_if_key_is_not_pressed() {
   const u8 Vx = this->get_x();
-  if (!chip8.keypad.is_pressed(chip8.general_purpose_variable_registers[Vx])) {
-    chip8.program_counter += 2;
+  if (!chip8.state.keypad.is_pressed(chip8.state.general_purpose_variable_registers[Vx])) {
+    chip8.state.program_counter += 2;
   }
 }
 
-void Interpreter::set_vx_to_delay_timer() {
+template <typename Quirks>
+void BasicInterpreter<Quirks>::set_vx_to_delay_timer() {
   const u8 Vx = this->get_x();
-  chip8.general_purpose_variable_registers[Vx] = chip8.delay_timer;
+  chip8.state.general_purpose_variable_registers[Vx] = chip8.state.delay_timer;
 }
 
-void Interpreter::wait_for_key_pressed() {
+template <typename Quirks>
+void BasicInterpreter<Quirks>::wait_for_key_pressed() {
   bool key_pressed = false;
   const u8 Vx = this->get_x();
-  for (u8 i = 0; i < chip8.keypad.size(); i++) {
-    if (chip8.keypad.is_pressed(i)) {
-      chip8.general_purpose_variable_registers[Vx] = i;
+  for (u8 i = 0; i < chip8.state.keypad.size(); i++) {
+    if (chip8.state.keypad.is_pressed(i)) {
+      chip8.state.general_purpose_variable_registers[Vx] = i;
       key_pressed = true;
     }
   }
 
   if (!key_pressed) {
-    chip8.program_counter -= 2;
+    chip8.state.program_counter -= 2;
   }
 }
 
-void Interpreter::set_delay_timer_to_vx() {
+template <typename Quirks>
+void BasicInterpreter<Quirks>::set_delay_timer_to_vx() {
   const u8 Vx = this->get_x();
-  chip8.delay_timer = chip8.general_purpose_variable_registers[Vx];
+  chip8.state.delay_timer = chip8.state.general_purpose_variable_registers[Vx];
 }
 
-void Interpreter::set_sound_timer_to_vx() {
+template <typename Quirks>
+void BasicInterpreter<Quirks>::set_sound_timer_to_vx() {
   const u8 Vx = this->get_x();
-  chip8.sound_timer = chip8.general_purpose_variable_registers[Vx];
+  chip8.state.sound_timer = chip8.state.general_purpose_variable_registers[Vx];
 }
 
-void Interpreter::add_i_to_vx() {
+template <typename Quirks>
+void BasicInterpreter<Quirks>::add_i_to_vx() {
   const u8 Vx = this->get_x();
-  chip8.index_register += chip8.general_purpose_variable_registers[Vx];
+  chip8.state.index_register += chip8.state.general_purpose_variable_registers[Vx];
 }
 
-void Interpreter::set_i_to_sprite_character_in_vx() {
+template <typename Quirks>
+void BasicInterpreter<Quirks>::set_i_to_sprite_character_in_vx() {
   const u8 Vx = this->get_x();
-  chip8.index_register = chip8.general_purpose_variable_registers[Vx] * 5;
+  chip8.state.index_register = chip8.state.general_purpose_variable_registers[Vx] * 5;
 }
 
-void Interpreter::store_binary_coded_decimal_of_vx() {
+template <typename Quirks>
+void BasicInterpreter<Quirks>::store_binary_coded_decimal_of_vx() {
+  // Like sprite data, the bytes wrap around the end of the memory
   const u8 Vx = this->get_x();
-  chip8.memory[chip8.index_register] =
-      chip8.general_purpose_variable_registers[Vx] / 100;
-  chip8.memory[chip8.index_register + 1] =
-      (chip8.general_purpose_variable_registers[Vx] / 10) % 10;
-  chip8.memory[chip8.index_register + 2] =
-      (chip8.general_purpose_variable_registers[Vx] % 100) % 10;
-}
-
-void Interpreter::store_registers_at_i() {
+  const u16 address = chip8.state.index_register;
+  chip8.mark_memory_written(address, 3);
+  CHIP8_PROFILE(chip8, count_write(address, 3));
+  chip8.state.memory[address & 0x0FFFu] =
+      chip8.state.general_purpose_variable_registers[Vx] / 100;
+  chip8.state.memory[(address + 1) & 0x0FFFu] =
+      (chip8.state.general_purpose_variable_registers[Vx] / 10) % 10;
+  chip8.state.memory[(address + 2) & 0x0FFFu] =
+      (chip8.state.general_purpose_variable_registers[Vx] % 100) % 10;
+}
+
+template <typename Quirks>
+void BasicInterpreter<Quirks>::store_registers_at_i() {
   const u8 Vx = this->get_x();
+  chip8.mark_memory_written(chip8.state.index_register, Vx + 1);
+  CHIP8_PROFILE(chip8, count_write(chip8.state.index_register, Vx + 1));
   for (u8 i = 0; i <= Vx; ++i) {
-    chip8.memory[chip8.index_register + i] =
-        chip8.general_purpose_variable_registers[i];
+    chip8.state.memory[(chip8.state.index_register + i) & 0x0FFFu] =
+        chip8.state.general_purpose_variable_registers[i];
   }
+  this->advance_index_register(Vx);
 }
 
-void Interpreter::load_registers_from_i() {
+template <typename Quirks>
+void BasicInterpreter<Quirks>::load_registers_from_i() {
   const u8 Vx = this->get_x();
+  CHIP8_PROFILE(chip8, count_read(chip8.state.index_register, Vx + 1));
   for (u8 i = 0; i <= Vx; ++i) {
-    chip8.general_purpose_variable_registers[i] =
-        chip8.memory[chip8.index_register + i];
+    chip8.state.general_purpose_variable_registers[i] =
+        chip8.state.memory[(chip8.state.index_register + i) & 0x0FFFu];
+  }
+  this->advance_index_register(Vx);
+}
+
+template <typename Quirks>
+void BasicInterpreter<Quirks>::scroll_down() {
+  chip8.state.display.scroll_down(this->get_n());
+  chip8.draw_flag = true;
+}
+
+template <typename Quirks>
+void BasicInterpreter<Quirks>::scroll_up() {
+  chip8.state.display.scroll_up(this->get_n());
+  chip8.draw_flag = true;
+}
+
+template <typename Quirks>
+void BasicInterpreter<Quirks>::scroll_right() {
+  chip8.state.display.scroll_right();
+  chip8.draw_flag = true;
+}
+
+template <typename Quirks>
+void BasicInterpreter<Quirks>::scroll_left() {
+  chip8.state.display.scroll_left();
+  chip8.draw_flag = true;
+}
+
+template <typename Quirks>
+void BasicInterpreter<Quirks>::disable_high_resolution() {
+  chip8.state.display.set_high_resolution(false);
+  chip8.draw_flag = true;
+}
+
+template <typename Quirks>
+void BasicInterpreter<Quirks>::enable_high_resolution() {
+  chip8.state.display.set_high_resolution(true);
+  chip8.draw_flag = true;
+}
+
+template <typename Quirks>
+void BasicInterpreter<Quirks>::draw_large_sprite() {
+  const u8 Vx = chip8.state.general_purpose_variable_registers[this->get_x()];
+  const u8 Vy = chip8.state.general_purpose_variable_registers[this->get_y()];
+
+  // 32 bytes for each selected plane
+  u8 sprite[32 * Display::PLANES];
+  const u8 size = 32 * this->count_selected_planes();
+  for (u8 y = 0; y < size; y++) {
+    sprite[y] = chip8.state.memory[(chip8.state.index_register + y) & 0x0FFFu];
+  }
+  CHIP8_PROFILE(chip8, count_read(chip8.state.index_register, size));
+
+  chip8.state.general_purpose_variable_registers[0xF] =
+      chip8.state.display.draw_large_sprite(Vx, Vy, sprite) ? 1 : 0;
+  chip8.draw_flag = true;
+}
+
+template <typename Quirks>
+void BasicInterpreter<Quirks>::select_planes() {
+  chip8.state.display.select_planes(this->get_x());
+}
+
+template <typename Quirks>
+u8 BasicInterpreter<Quirks>::count_selected_planes() {
+  const u8 planes = chip8.state.display.get_selected_planes();
+  return (planes & 1u) + (planes >> 1 & 1u);
+}
+
+template <typename Quirks>
+void BasicInterpreter<Quirks>::advance_index_register(u8 x) {
+  if (Quirks::LOAD_STORE_INDEX == kIndexPlusX) {
+    chip8.state.index_register += x;
+  } else if (Quirks::LOAD_STORE_INDEX == kIndexPlusXPlusOne) {
+    chip8.state.index_register += x + 1;
   }
-}
\ No newline at end of file
+}
+
+// Every quirk profile is a complete interpreter of its own
+template class BasicInterpreter<DefaultQuirks>;
+template class BasicInterpreter<CosmacVipQuirks>;
+template class BasicInterpreter<Chip48Quirks>;
+template class BasicInterpreter<SuperChipQuirks>;
\ No newline at end of file
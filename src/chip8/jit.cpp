@@ -0,0 +1,787 @@
+#include "chip8/jit.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <type_traits>
+
+#include "chip8/chip8.h"
+#include "chip8/decoder.h"
+#include "chip8/interpreter.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define CHIP8_JIT_SUPPORTED 1
+#include <sys/mman.h>
+#else
+#define CHIP8_JIT_SUPPORTED 0
+#endif
+
+#if CHIP8_JIT_SUPPORTED
+
+// Compiled code addresses the members of the Chip8 class relative to the
+// Chip8 pointer it gets as first argument (see Jit::NativeBlock)
+static_assert(std::is_standard_layout<Chip8>::value,
+              "The Jit needs offsetof on Chip8");
+static_assert(std::is_standard_layout<Chip8State>::value,
+              "The Jit needs offsetof on Chip8State");
+static_assert(std::is_standard_layout<Keypad>::value,
+              "The Jit needs offsetof on Keypad");
+
+enum HostRegister : u8 {
+  kRax = 0,
+  kRcx = 1,
+  kRdx = 2,
+  kRbx = 3,
+  kRsp = 4,
+  kRbp = 5,
+  kRsi = 6,
+  kRdi = 7,
+  kR8 = 8,
+  kR9 = 9,
+  kR10 = 10,
+  kR11 = 11,
+  kR12 = 12,
+  kR13 = 13,
+  kR14 = 14,
+  kR15 = 15
+};
+
+// Register usage of the compiled code (System V calling convention):
+// rdi = Chip8*, esi = cycle budget, edx = index register,
+// r11d = cycles executed by the blocks run before the current one,
+// eax and ecx = scratch registers. The general purpose registers of a block
+// are pinned in the remaining registers, in order of their usage.
+static const std::array<HostRegister, 9> PINNABLE_REGISTERS = {
+    kRbx, kRbp, kR12, kR13, kR14, kR15, kR8, kR9, kR10};
+
+// Location of a Chip-8 byte register: a host register or [rdi + offset]
+struct Operand {
+  bool is_register;
+  u8 host_register;
+  u32 offset;
+};
+
+/*
+    X64Emitter class:
+    Minimal x86-64 machine code emitter, only knows the encodings used to
+    compile Chip-8 instructions.
+*/
+
+class X64Emitter {
+ public:
+  std::vector<u8> code;
+
+  void emit(u8 value) { this->code.push_back(value); }
+
+  void emit(std::initializer_list<u8> values) {
+    this->code.insert(this->code.end(), values);
+  }
+
+  void emit16(u16 value) {
+    this->emit(value & 0xFF);
+    this->emit(value >> 8);
+  }
+
+  void emit32(u32 value) {
+    for (int i = 0; i < 4; i++) {
+      this->emit((value >> (i * 8)) & 0xFF);
+    }
+  }
+
+  // Byte sized instruction with a ModRM operand. reg is either a host
+  // register (is_register) or an opcode extension.
+  void emit_byte_operation(std::initializer_list<u8> opcode, u8 reg,
+                           bool is_register, const Operand& operand) {
+    // A REX prefix is needed for r8b - r15b and to address spl, bpl, sil
+    // and dil instead of ah, ch, dh and bh
+    u8 rex = 0;
+    if (is_register && reg >= 8) rex |= 0x44;
+    if (is_register && reg >= 4) rex |= 0x40;
+    if (operand.is_register && operand.host_register >= 8) rex |= 0x41;
+    if (operand.is_register && operand.host_register >= 4) rex |= 0x40;
+    if (rex != 0) {
+      this->emit(rex);
+    }
+
+    this->emit(opcode);
+    this->emit_modrm(reg, operand);
+  }
+
+  void emit_modrm(u8 reg, const Operand& operand) {
+    if (operand.is_register) {
+      this->emit(0xC0 | (reg & 7) << 3 | (operand.host_register & 7));
+    } else {
+      this->emit(0x80 | (reg & 7) << 3 | kRdi);
+      this->emit32(operand.offset);
+    }
+  }
+
+  // mov r8, r/m8
+  void load(u8 host_register, const Operand& source) {
+    this->emit_byte_operation({0x8A}, host_register, true, source);
+  }
+
+  // mov r/m8, r8
+  void store(const Operand& destination, u8 host_register) {
+    this->emit_byte_operation({0x88}, host_register, true, destination);
+  }
+
+  // Conditional jump with a 32 bit displacement, returns the position of
+  // the displacement for patch_jump
+  u32 jump_if(u8 condition) {
+    this->emit({0x0F, static_cast<u8>(0x80 | condition)});
+    this->emit32(0);
+    return this->code.size() - 4;
+  }
+
+  void patch_jump(u32 position) {
+    const u32 displacement = this->code.size() - (position + 4);
+    std::memcpy(&this->code[position], &displacement, 4);
+  }
+};
+
+// Condition codes of jcc and setcc
+static const u8 CONDITION_BELOW = 0x2;
+static const u8 CONDITION_ABOVE_OR_EQUAL = 0x3;
+static const u8 CONDITION_EQUAL = 0x4;
+static const u8 CONDITION_NOT_EQUAL = 0x5;
+static const u8 CONDITION_BELOW_OR_EQUAL = 0x6;
+static const u8 CONDITION_ABOVE = 0x7;
+
+// Opcode extensions of the 0x80 (r/m8, imm8) group
+static const u8 EXTENSION_ADD = 0;
+static const u8 EXTENSION_AND = 4;
+static const u8 EXTENSION_CMP = 7;
+
+#endif
+
+Jit::Jit(Chip8& chip8) : chip8(chip8), arena(nullptr), arena_used(0) {
+#if CHIP8_JIT_SUPPORTED
+  void* memory = mmap(nullptr, ARENA_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory != MAP_FAILED) {
+    this->arena = static_cast<u8*>(memory);
+  }
+#endif
+
+  this->flush();
+}
+
+Jit::~Jit() {
+#if CHIP8_JIT_SUPPORTED
+  if (this->arena != nullptr) {
+    munmap(this->arena, ARENA_SIZE);
+  }
+#endif
+}
+
+bool Jit::is_supported() { return CHIP8_JIT_SUPPORTED; }
+
+u32 Jit::run(u32 cycles) {
+  Interpreter interpreter(this->chip8);
+  u32 executed = 0;
+
+  // Without an executable arena the Jit is just the Interpreter
+  if (this->arena == nullptr) {
+    return interpreter.execute(cycles);
+  }
+
+  while (executed < cycles && this->chip8.state.fault == kNoFault) {
+    if (this->chip8.memory_written) {
+      this->invalidate_written_memory();
+    }
+
+    u16 block_cycles = 0;
+    const NativeBlock code =
+        this->lookup(this->chip8.state.program_counter, block_cycles);
+    if (code != nullptr && block_cycles <= cycles - executed) {
+      const u32 done = code(&this->chip8, cycles - executed);
+      this->update_timers(done);
+      executed += done;
+      continue;
+    }
+
+    // Cold code or instructions that are never compiled: interpret them in
+    // straight-line runs (see count_cold_instructions)
+    const u16 address = this->chip8.state.program_counter;
+    const u32 count = std::min<u32>(this->count_cold_instructions(address),
+                                    cycles - executed);
+    executed += interpreter.execute(count);
+
+    // Fx0A without a pressed key executes itself again, and the keys do not
+    // change before we return
+    if (this->chip8.state.program_counter == address &&
+        Decoder::decode(this->chip8.state.current_opcode).operation ==
+            kWaitForKeyPressed) {
+      executed += interpreter.execute(cycles - executed);
+    }
+  }
+
+  return executed;
+}
+
+void Jit::flush() {
+  this->block_at.fill(0);
+  this->heat.fill(0);
+  this->blocks.clear();
+  this->unlinked_exits.clear();
+  this->arena_used = 0;
+}
+
+Jit::NativeBlock Jit::lookup(u16 address, u16& cycles) {
+  if (address > 0x0FFE) {
+    return nullptr;
+  }
+
+  u16 index = this->block_at[address];
+  if (index == 0) {
+    const u16 opcode =
+        this->chip8.state.memory[address] << 8 | this->chip8.state.memory[address + 1];
+    if (!is_compilable(opcode) || ++this->heat[address] < COMPILE_THRESHOLD) {
+      return nullptr;
+    }
+
+    index = this->compile(address);
+    if (index == 0) {
+      return nullptr;
+    }
+  }
+
+  const JitBlock& block = this->blocks[index - 1];
+  cycles = block.cycles;
+  return reinterpret_cast<NativeBlock>(this->arena + block.code_offset);
+}
+
+void Jit::update_timers(u32 ticks) {
+  if (this->chip8.timer_mode != kInstructionTimers) {
+    return;
+  }
+
+  // Compiled blocks never set the timers, so every instruction executed by
+  // native code can be accounted for at once
+  this->chip8.state.delay_timer =
+      this->chip8.state.delay_timer > ticks ? this->chip8.state.delay_timer - ticks : 0;
+  this->chip8.state.sound_timer =
+      this->chip8.state.sound_timer > ticks ? this->chip8.state.sound_timer - ticks : 0;
+}
+
+void Jit::invalidate_written_memory() {
+  const u16 begin = this->chip8.memory_written_begin;
+  const u16 end = this->chip8.memory_written_end;
+  this->chip8.memory_written = false;
+
+  // Blocks may be linked to the modified block, so (rarely written) compiled
+  // code is dropped as a whole
+  for (const JitBlock& block : this->blocks) {
+    if (block.start_address < end && begin < block.end_address) {
+      this->flush();
+      return;
+    }
+  }
+}
+
+u16 Jit::count_cold_instructions(u16 address) {
+  // A run contains either only compilable or only not compilable
+  // instructions, so that the next run starts where a block can start. It
+  // ends after any instruction that may branch or write to memory and before
+  // a compiled block.
+  u16 count = 0;
+  bool compilable = false;
+  while (address < 0x0FFF && count < MAXIMUM_BLOCK_SIZE) {
+    const u16 opcode =
+        this->chip8.state.memory[address] << 8 | this->chip8.state.memory[address + 1];
+    if (count == 0) {
+      compilable = is_compilable(opcode);
+    } else if (this->block_at[address] != 0 ||
+               is_compilable(opcode) != compilable) {
+      break;
+    }
+
+    count++;
+    address += 2;
+    if (ends_cold_run(Decoder::decode(opcode).operation)) {
+      break;
+    }
+  }
+
+  // The interpreter handles addresses outside of the memory on its own
+  return count == 0 ? 1 : count;
+}
+
+bool Jit::ends_cold_run(Operation operation) {
+  switch (operation) {
+    case kUnknown:
+    case kReturnFromSubroutine:
+    case kJumpToLocation:
+    case kCallSubroutine:
+    case kJumpToExtendedLocation:
+    case kSkipIfEqual:
+    case kSkipIfNotEqual:
+    case kSkipIfVxEqualVy:
+    case kSkipIfVxNotEqualVy:
+    case kSkipIfKeyPressed:
+    case kSkipIfKeyNotPressed:
+    case kWaitForKeyPressed:
+    case kStoreBinaryCodedDecimal:
+    case kStoreRegisters:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool Jit::is_compilable(u16 opcode) {
+  switch (Decoder::decode(opcode).operation) {
+    case kSetVx:
+    case kAddToVx:
+    case kLoadVyInVx:
+    case kOrVxVy:
+    case kAndVxVy:
+    case kXorVxVy:
+    case kAddVyToVx:
+    case kSubtractVyFromVx:
+    case kShiftRight:
+    case kSetVxToVyMinusVx:
+    case kShiftLeft:
+    case kSkipIfEqual:
+    case kSkipIfNotEqual:
+    case kSkipIfVxEqualVy:
+    case kSkipIfVxNotEqualVy:
+    case kSetIndexRegister:
+    case kAddVxToI:
+    case kSetIToSpriteCharacter:
+    case kSkipIfKeyPressed:
+    case kSkipIfKeyNotPressed:
+    case kSetVxToDelayTimer:
+    case kJumpToLocation:
+      return true;
+    default:
+      return false;
+  }
+}
+
+void Jit::link(const JitExit& exit, const JitBlock& block) {
+#if CHIP8_JIT_SUPPORTED
+  // Jump behind the first instruction of the block (xor r11d, r11d), which
+  // only resets the cycle count when entering from Jit::run
+  const u32 displacement = block.code_offset + 3 - (exit.jump_offset + 4);
+  std::memcpy(this->arena + exit.jump_offset, &displacement, 4);
+#endif
+}
+
+u16 Jit::compile(u16 address) {
+#if CHIP8_JIT_SUPPORTED
+  // Collect the instructions of the block
+  std::array<Instruction, MAXIMUM_BLOCK_SIZE> instructions;
+  u16 size = 0;
+  u16 end_address = address;
+  while (size < MAXIMUM_BLOCK_SIZE && end_address < 0x0FFF) {
+    const u16 opcode = this->chip8.state.memory[end_address] << 8 |
+                       this->chip8.state.memory[end_address + 1];
+    if (!is_compilable(opcode)) {
+      break;
+    }
+
+    instructions[size++] = Decoder::decode(opcode);
+    end_address += 2;
+    if (instructions[size - 1].operation == kJumpToLocation) {
+      break;
+    }
+  }
+
+  if (size == 0) {
+    return 0;
+  }
+
+  // Count how often each general purpose register is used and pin the most
+  // used ones to host registers
+  std::array<u16, 16> uses{};
+  u16 written = 0;
+  bool index_register_used = false;
+  bool index_register_written = false;
+  for (u16 i = 0; i < size; i++) {
+    const Instruction& instruction = instructions[i];
+    switch (instruction.operation) {
+      case kSetVx:
+      case kAddToVx:
+      case kSetVxToDelayTimer:
+        uses[instruction.x]++;
+        written |= 1 << instruction.x;
+        break;
+      case kLoadVyInVx:
+      case kOrVxVy:
+      case kAndVxVy:
+      case kXorVxVy:
+        uses[instruction.x]++;
+        uses[instruction.y]++;
+        written |= 1 << instruction.x;
+        break;
+      case kAddVyToVx:
+      case kSubtractVyFromVx:
+      case kSetVxToVyMinusVx:
+        uses[instruction.x]++;
+        uses[instruction.y]++;
+        uses[0xF]++;
+        written |= 1 << instruction.x | 1 << 0xF;
+        break;
+      case kShiftRight:
+      case kShiftLeft:
+        uses[instruction.x]++;
+        uses[0xF]++;
+        written |= 1 << instruction.x | 1 << 0xF;
+        break;
+      case kSkipIfEqual:
+      case kSkipIfNotEqual:
+      case kSkipIfKeyPressed:
+      case kSkipIfKeyNotPressed:
+        uses[instruction.x]++;
+        break;
+      case kSkipIfVxEqualVy:
+      case kSkipIfVxNotEqualVy:
+        uses[instruction.x]++;
+        uses[instruction.y]++;
+        break;
+      case kSetIndexRegister:
+        index_register_used = index_register_written = true;
+        break;
+      case kAddVxToI:
+      case kSetIToSpriteCharacter:
+        uses[instruction.x]++;
+        index_register_used = index_register_written = true;
+        break;
+      default:
+        break;
+    }
+  }
+
+  std::array<u8, 16> by_usage;
+  for (u8 i = 0; i < 16; i++) {
+    by_usage[i] = i;
+  }
+  std::stable_sort(by_usage.begin(), by_usage.end(),
+                   [&uses](u8 a, u8 b) { return uses[a] > uses[b]; });
+
+  const u32 state_offset = offsetof(Chip8, state);
+  const u32 registers_offset =
+      state_offset + offsetof(Chip8State, general_purpose_variable_registers);
+  std::array<Operand, 16> home;
+  for (u8 i = 0; i < 16; i++) {
+    home[i] = {false, 0, registers_offset + i};
+  }
+
+  std::vector<u8> pinned;
+  for (u8 i = 0; i < PINNABLE_REGISTERS.size() && uses[by_usage[i]] > 0;
+       i++) {
+    home[by_usage[i]] = {true, PINNABLE_REGISTERS[i], 0};
+    pinned.push_back(by_usage[i]);
+  }
+
+  const u32 index_register_offset =
+      state_offset + offsetof(Chip8State, index_register);
+  const u32 program_counter_offset =
+      state_offset + offsetof(Chip8State, program_counter);
+  const u32 delay_timer_offset =
+      state_offset + offsetof(Chip8State, delay_timer);
+  const u32 keypad_offset = state_offset + offsetof(Chip8State, keypad);
+  const u32 keys_offset = keypad_offset + offsetof(Keypad, keys);
+
+  // Callee saved registers we use have to be restored
+  std::vector<u8> saved;
+  for (u8 v : pinned) {
+    const u8 host = home[v].host_register;
+    if (host == kRbx || host == kRbp || host >= kR12) {
+      saved.push_back(host);
+    }
+  }
+
+  X64Emitter x64;
+  std::vector<JitExit> exits;
+
+  // Write back the program counter and return the executed cycles (r11d)
+  auto emit_return = [&](u16 program_counter) {
+    x64.emit({0x66, 0xC7, 0x87});  // mov word [rdi + offset], imm16
+    x64.emit32(program_counter_offset);
+    x64.emit16(program_counter);
+    x64.emit({0x44, 0x89, 0xD8});  // mov eax, r11d
+    x64.emit(0xC3);                // ret
+  };
+
+  // Entry from Jit::run (linked blocks enter behind the first instruction)
+  x64.emit({0x45, 0x31, 0xDB});  // xor r11d, r11d
+
+  // Leave right away if a whole pass does not fit into the budget
+  x64.emit({0x41, 0x8D, 0x83});  // lea eax, [r11 + size]
+  x64.emit32(size);
+  x64.emit({0x39, 0xF0});  // cmp eax, esi
+  const u32 budget_check = x64.jump_if(CONDITION_ABOVE);
+
+  // Save registers and load the pinned Chip-8 registers
+  for (u8 host : saved) {
+    if (host >= 8) x64.emit(0x41);
+    x64.emit(0x50 | (host & 7));  // push
+  }
+  for (u8 v : pinned) {
+    x64.load(home[v].host_register, Operand{false, 0, registers_offset + v});
+  }
+  if (index_register_used) {
+    x64.emit({0x0F, 0xB7, 0x97});  // movzx edx, word [rdi + offset]
+    x64.emit32(index_register_offset);
+  }
+
+  // Leave the block: write back the registers, restore the saved ones and
+  // account for the executed instructions
+  auto emit_leave = [&](u32 executed) {
+    for (u8 v : pinned) {
+      if (written & (1 << v)) {
+        x64.store(Operand{false, 0, registers_offset + v},
+                  home[v].host_register);
+      }
+    }
+    if (index_register_written) {
+      x64.emit({0x66, 0x89, 0x97});  // mov word [rdi + offset], dx
+      x64.emit32(index_register_offset);
+    }
+    for (auto host = saved.rbegin(); host != saved.rend(); host++) {
+      if (*host >= 8) x64.emit(0x41);
+      x64.emit(0x58 | (*host & 7));  // pop
+    }
+    x64.emit({0x41, 0x81, 0xC3});  // add r11d, executed
+    x64.emit32(executed);
+  };
+
+  // Exit to a known address: a jump to the return sequence right behind
+  // it, until it is linked to the block at target
+  auto emit_exit = [&](u16 target, u32 executed) {
+    emit_leave(executed);
+    x64.emit(0xE9);  // jmp rel32
+    x64.emit32(0);
+    exits.push_back({target, static_cast<u32>(x64.code.size() - 4)});
+    emit_return(target);
+  };
+
+  // Skip instructions leave the block when the skip is taken
+  auto emit_skip_exit = [&](u8 condition, u16 i) {
+    const u32 jump = x64.jump_if(condition);
+    emit_exit(address + i * 2 + 4, i + 1);
+    x64.patch_jump(jump);
+  };
+
+  // The instructions are compiled in exactly the order in which the
+  // Interpreter reads and writes the registers (which matters if x or y is
+  // 0xF)
+  for (u16 i = 0; i < size; i++) {
+    const Instruction& instruction = instructions[i];
+    const Operand& vx = home[instruction.x];
+    const Operand& vy = home[instruction.y];
+    const Operand& vf = home[0xF];
+    const Operand al = {true, kRax, 0};
+    const Operand cl = {true, kRcx, 0};
+
+    switch (instruction.operation) {
+      case kSetVx:
+        x64.emit_byte_operation({0xC6}, 0, false, vx);  // mov vx, nn
+        x64.emit(instruction.nn);
+        break;
+      case kAddToVx:
+        x64.emit_byte_operation({0x80}, EXTENSION_ADD, false, vx);
+        x64.emit(instruction.nn);
+        break;
+      case kLoadVyInVx:
+        x64.load(kRax, vy);
+        x64.store(vx, kRax);
+        break;
+      case kOrVxVy:
+        x64.load(kRax, vy);
+        x64.emit_byte_operation({0x08}, kRax, true, vx);  // or vx, al
+        break;
+      case kAndVxVy:
+        x64.load(kRax, vy);
+        x64.emit_byte_operation({0x20}, kRax, true, vx);  // and vx, al
+        break;
+      case kXorVxVy:
+        x64.load(kRax, vy);
+        x64.emit_byte_operation({0x30}, kRax, true, vx);  // xor vx, al
+        break;
+      case kAddVyToVx:
+        x64.load(kRax, vx);
+        x64.emit_byte_operation({0x02}, kRax, true, vy);    // add al, vy
+        x64.emit_byte_operation({0x0F, 0x92}, 0, false, cl);  // setc cl
+        x64.store(vf, kRcx);
+        x64.store(vx, kRax);
+        break;
+      case kSubtractVyFromVx:
+        x64.load(kRax, vx);
+        x64.emit_byte_operation({0x3A}, kRax, true, vy);    // cmp al, vy
+        x64.emit_byte_operation({0x0F, 0x97}, 0, false, cl);  // seta cl
+        x64.store(vf, kRcx);
+        x64.load(kRax, vx);
+        x64.emit_byte_operation({0x2A}, kRax, true, vy);  // sub al, vy
+        x64.store(vx, kRax);
+        break;
+      case kShiftRight:
+        x64.load(kRax, vx);
+        x64.emit_byte_operation({0x80}, EXTENSION_AND, false, al);
+        x64.emit(0x01);  // and al, 1
+        x64.store(vf, kRax);
+        x64.emit_byte_operation({0xD0}, 5, false, vx);  // shr vx, 1
+        break;
+      case kSetVxToVyMinusVx:
+        x64.load(kRax, vy);
+        x64.emit_byte_operation({0x3A}, kRax, true, vx);    // cmp al, vx
+        x64.emit_byte_operation({0x0F, 0x97}, 0, false, cl);  // seta cl
+        x64.store(vf, kRcx);
+        x64.load(kRax, vy);
+        x64.emit_byte_operation({0x2A}, kRax, true, vx);  // sub al, vx
+        x64.store(vx, kRax);
+        break;
+      case kShiftLeft:
+        x64.load(kRax, vx);
+        x64.emit_byte_operation({0xC0}, 5, false, al);
+        x64.emit(0x07);  // shr al, 7
+        x64.store(vf, kRax);
+        x64.emit_byte_operation({0xD0}, 4, false, vx);  // shl vx, 1
+        break;
+      case kSkipIfEqual:
+        x64.emit_byte_operation({0x80}, EXTENSION_CMP, false, vx);
+        x64.emit(instruction.nn);
+        emit_skip_exit(CONDITION_NOT_EQUAL, i);
+        break;
+      case kSkipIfNotEqual:
+        x64.emit_byte_operation({0x80}, EXTENSION_CMP, false, vx);
+        x64.emit(instruction.nn);
+        emit_skip_exit(CONDITION_EQUAL, i);
+        break;
+      case kSkipIfVxEqualVy:
+        x64.load(kRax, vx);
+        x64.emit_byte_operation({0x3A}, kRax, true, vy);  // cmp al, vy
+        emit_skip_exit(CONDITION_NOT_EQUAL, i);
+        break;
+      case kSkipIfVxNotEqualVy:
+        x64.load(kRax, vx);
+        x64.emit_byte_operation({0x3A}, kRax, true, vy);  // cmp al, vy
+        emit_skip_exit(CONDITION_EQUAL, i);
+        break;
+      case kSetIndexRegister:
+        x64.emit(0xBA);  // mov edx, nnn
+        x64.emit32(instruction.nnn);
+        break;
+      case kAddVxToI:
+        x64.emit_byte_operation({0x0F, 0xB6}, kRax, false, vx);  // movzx
+        x64.emit({0x66, 0x01, 0xC2});  // add dx, ax
+        break;
+      case kSetIToSpriteCharacter:
+        x64.emit_byte_operation({0x0F, 0xB6}, kRax, false, vx);  // movzx
+        x64.emit({0x8D, 0x04, 0x80});  // lea eax, [rax + rax * 4]
+        x64.emit({0x89, 0xC2});        // mov edx, eax
+        break;
+      case kSkipIfKeyPressed:
+      case kSkipIfKeyNotPressed: {
+        // Keys outside of the keypad are left to the Interpreter
+        x64.emit_byte_operation({0x0F, 0xB6}, kRax, false, vx);  // movzx
+        x64.emit({0x83, 0xF8, 0x0F});  // cmp eax, 15
+        const u32 valid_key = x64.jump_if(CONDITION_BELOW_OR_EQUAL);
+        emit_leave(i);
+        emit_return(address + i * 2);
+        x64.patch_jump(valid_key);
+
+        x64.emit({0x0F, 0xB7, 0x8F});  // movzx ecx, word [rdi + keys]
+        x64.emit32(keys_offset);
+        x64.emit({0x0F, 0xA3, 0xC1});  // bt ecx, eax (CF = key is down)
+        emit_skip_exit(instruction.operation == kSkipIfKeyPressed
+                           ? CONDITION_ABOVE_OR_EQUAL
+                           : CONDITION_BELOW,
+                       i);
+        break;
+      }
+      case kSetVxToDelayTimer:
+        x64.emit_byte_operation({0x0F, 0xB6}, kRax, false,
+                                Operand{false, 0, delay_timer_offset});
+        // Timers ticking per frame do not change while the block runs
+        // (Chip8::set_timer_mode flushes the compiled code)
+        if (this->chip8.timer_mode != kInstructionTimers) {
+          x64.store(vx, kRax);
+          break;
+        }
+        // The timers are only updated after returning to Jit::run, so
+        // subtract the instructions executed so far (r11d + i) here
+        x64.emit({0x41, 0x8D, 0x8B});  // lea ecx, [r11 + i]
+        x64.emit32(i);
+        x64.emit({0x29, 0xC8});  // sub eax, ecx
+        x64.emit(0xB9);          // mov ecx, 0
+        x64.emit32(0);
+        x64.emit({0x0F, 0x42, 0xC1});  // cmovb eax, ecx
+        x64.store(vx, kRax);
+        break;
+      case kJumpToLocation:
+        emit_exit(instruction.nnn, i + 1);
+        break;
+      default:
+        break;
+    }
+  }
+
+  if (instructions[size - 1].operation != kJumpToLocation) {
+    emit_exit(end_address, size);
+  }
+
+  x64.patch_jump(budget_check);
+  emit_return(address);
+
+  // Copy the code into the arena (flush everything if it is full)
+  const u32 code_size = x64.code.size();
+  u32 offset = (this->arena_used + 15) & ~15u;
+  if (offset + code_size > ARENA_SIZE) {
+    this->flush();
+    offset = 0;
+  }
+
+  if (mprotect(this->arena, ARENA_SIZE, PROT_READ | PROT_WRITE) != 0) {
+    return 0;
+  }
+  std::memcpy(this->arena + offset, x64.code.data(), code_size);
+  this->arena_used = offset + code_size;
+
+  JitBlock block;
+  block.start_address = address;
+  block.end_address = end_address;
+  block.cycles = size;
+  block.code_offset = offset;
+  this->blocks.push_back(block);
+  this->block_at[address] = this->blocks.size();
+
+  // Link the exits of the new block to compiled blocks and the exits of
+  // other blocks to the new block
+  for (JitExit& exit : exits) {
+    exit.jump_offset += offset;
+    const u16 target = exit.target < 0x0FFF ? this->block_at[exit.target] : 0;
+    if (target != 0) {
+      this->link(exit, this->blocks[target - 1]);
+    } else {
+      this->unlinked_exits.push_back(exit);
+    }
+  }
+
+  auto exit = this->unlinked_exits.begin();
+  while (exit != this->unlinked_exits.end()) {
+    if (exit->target == address) {
+      this->link(*exit, block);
+      exit = this->unlinked_exits.erase(exit);
+    } else {
+      exit++;
+    }
+  }
+
+  // Without an executable arena the Jit falls back to the Interpreter for
+  // good, the destructor only unmaps an arena it still has
+  if (mprotect(this->arena, ARENA_SIZE, PROT_READ | PROT_EXEC) != 0) {
+    munmap(this->arena, ARENA_SIZE);
+    this->arena = nullptr;
+    return 0;
+  }
+
+  return this->blocks.size();
+#else
+  return 0;
+#endif
+}
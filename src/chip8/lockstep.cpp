@@ -0,0 +1,543 @@
+#include "chip8/lockstep.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "chip8/interpreter.h"
+
+// One lane per step, for processors without a vector kernel
+struct PortableVector {
+  typedef u8 Bytes;
+  typedef u16 Words;
+  static const u32 WIDTH = 1;
+  static const u32 WORDS = 1;
+
+  static Bytes load(const u8* source) { return *source; }
+  static void store(u8* destination, Bytes value) { *destination = value; }
+  static void store_masked(u8* destination, Bytes value, Bytes mask) {
+    *destination = (mask & value) | (~mask & *destination);
+  }
+  static Bytes splat(u8 value) { return value; }
+  static bool is_zero(Bytes value) { return value == 0; }
+
+  static Bytes and_(Bytes a, Bytes b) { return a & b; }
+  static Bytes or_(Bytes a, Bytes b) { return a | b; }
+  static Bytes xor_(Bytes a, Bytes b) { return a ^ b; }
+  static Bytes and_not(Bytes a, Bytes b) { return ~a & b; }
+  static Bytes equal(Bytes a, Bytes b) { return a == b ? 0xFF : 0; }
+  static Bytes add(Bytes a, Bytes b) { return a + b; }
+  static Bytes subtract(Bytes a, Bytes b) { return a - b; }
+  static Bytes add_saturated(Bytes a, Bytes b) {
+    return a + b > 0xFF ? 0xFF : a + b;
+  }
+  static Bytes subtract_saturated(Bytes a, Bytes b) {
+    return a > b ? a - b : 0;
+  }
+  static Bytes shift_right(Bytes a) { return a >> 1; }
+
+  static Words load_words(const u16* source) { return *source; }
+  static void store_words(u16* destination, Words value) {
+    *destination = value;
+  }
+  static Words splat_words(u16 value) { return value; }
+  static Words add_words(Words a, Words b) { return a + b; }
+  static Words select_words(Words current, Words value, Words mask) {
+    return (mask & value) | (~mask & current);
+  }
+  static Words widen(Bytes value, u32 /*half*/) { return value; }
+  static Words widen_mask(Bytes mask, u32 /*half*/) {
+    return mask ? 0xFFFF : 0;
+  }
+};
+
+void execute_lockstep_portable(LockstepLanes& lanes,
+                               const Instruction& instruction, u32 begin,
+                               u32 end) {
+  execute_lockstep<PortableVector>(lanes, instruction, begin, end);
+}
+
+// Index of the lowest set bit of a mask that is not zero
+static u32 lowest_bit(u32 mask) {
+#if defined(__GNUC__)
+  return __builtin_ctz(mask);
+#else
+  u32 index = 0;
+  while ((mask & 1) == 0) {
+    mask >>= 1;
+    index++;
+  }
+  return index;
+#endif
+}
+
+Chip8Lockstep::Chip8Lockstep(u32 size)
+    : count(size),
+      machines(new Chip8[size]),
+      kernel(execute_lockstep_portable),
+      remaining(size, 0),
+      halted(size, 0),
+      written_pages(size, 0) {
+  const u32 padded =
+      (size + LOCKSTEP_ALIGNMENT - 1) / LOCKSTEP_ALIGNMENT * LOCKSTEP_ALIGNMENT;
+
+  // Padding lanes never join a group, so they are never executed
+  this->general_purpose_variable_registers.assign(16 * padded, 0);
+  this->index_register.assign(padded, 0);
+  this->program_counter.assign(padded, 0);
+  this->delay_timer.assign(padded, 0);
+  this->sound_timer.assign(padded, 0);
+  this->group.assign(padded, 0);
+  this->key_pressed.assign(padded, 0);
+  this->return_address.assign(padded, 0);
+  this->current_opcode.assign(padded, 0);
+
+  this->lanes.count = padded;
+  for (u32 i = 0; i < 16; i++) {
+    this->lanes.general_purpose_variable_registers[i] =
+        &this->general_purpose_variable_registers[i * padded];
+  }
+  this->lanes.index_register = this->index_register.data();
+  this->lanes.program_counter = this->program_counter.data();
+  this->lanes.delay_timer = this->delay_timer.data();
+  this->lanes.sound_timer = this->sound_timer.data();
+  this->lanes.group = this->group.data();
+  this->lanes.key_pressed = this->key_pressed.data();
+  this->lanes.return_address = this->return_address.data();
+  this->lanes.timer_tick = 1;
+
+  this->set_kernel("avx2") || this->set_kernel("sse2");
+
+  for (u32 lane = 0; lane < size; lane++) {
+    this->load_lane(lane);
+  }
+}
+
+bool Chip8Lockstep::load_program(const void* source, u32 size) {
+  for (u32 lane = 0; lane < this->count; lane++) {
+    this->machines[lane].reset();
+    if (!this->machines[lane].save_rom(source, size)) {
+      return false;
+    }
+    this->machines[lane].memory_written = false;
+    this->load_lane(lane);
+    this->halted[lane] = false;
+    this->written_pages[lane] = 0;
+  }
+  return true;
+}
+
+u64 Chip8Lockstep::run_frames(u32 frames, u32 cycles_per_frame) {
+  u64 executed = 0;
+
+  // Tiles run all frames one after another, so only the machines of one
+  // tile have to stay in the cache while their instructions are executed
+  for (u32 begin = 0; begin < this->count; begin += LOCKSTEP_TILE) {
+    const u32 end =
+        begin + LOCKSTEP_TILE < this->count ? begin + LOCKSTEP_TILE : this->count;
+    for (u32 frame = 0; frame < frames; frame++) {
+      for (u32 lane = begin; lane < end; lane++) {
+        this->remaining[lane] = this->halted[lane] ? 0 : cycles_per_frame;
+      }
+      executed += this->run_tile(begin, end);
+
+      if (this->lanes.timer_tick == 0) {
+        for (u32 lane = begin; lane < end; lane++) {
+          if (!this->halted[lane]) {
+            this->delay_timer[lane] -= this->delay_timer[lane] != 0;
+            this->sound_timer[lane] -= this->sound_timer[lane] != 0;
+          }
+        }
+      }
+    }
+  }
+
+  return executed;
+}
+
+void Chip8Lockstep::set_random_seed(u64 seed) {
+  for (u32 lane = 0; lane < this->count; lane++) {
+    this->machines[lane].set_random_seed(seed, lane);
+  }
+}
+
+void Chip8Lockstep::set_timer_mode(Chip8TimerMode mode) {
+  for (u32 lane = 0; lane < this->count; lane++) {
+    this->machines[lane].set_timer_mode(mode);
+  }
+  this->lanes.timer_tick = mode == kInstructionTimers ? 1 : 0;
+}
+
+u64 Chip8Lockstep::run_tile(u32 begin, u32 end) {
+  const Decoder::Table& decoded = Decoder::table();
+  u64 executed = 0;
+
+  u32 leader = begin;
+  for (;;) {
+    while (leader < end && this->remaining[leader] == 0) {
+      leader++;
+    }
+    if (leader == end) {
+      break;
+    }
+
+    // The group: all unfinished lanes at the address of the leader that
+    // see the same operation code there (memory can differ between lanes)
+    u16 address = this->program_counter[leader];
+    u16 opcode = this->fetch(leader);
+    const u64 leader_pages = this->written_pages[leader];
+    u32 members = 0;
+    u32 budget = this->remaining[leader];
+    u64 group_pages = 0;
+    for (u32 lane = begin; lane < end; lane++) {
+      const bool member =
+          this->remaining[lane] != 0 &&
+          this->program_counter[lane] == address &&
+          (((this->written_pages[lane] | leader_pages) &
+            get_code_pages(address)) == 0 ||
+           this->fetch(lane) == opcode);
+      this->group[lane] = member ? 0xFF : 0;
+      if (member) {
+        budget = std::min(budget, this->remaining[lane]);
+        group_pages |= this->written_pages[lane];
+        members++;
+      }
+    }
+
+    // A diverged lane runs alone until the end of its budget
+    if (members == 1) {
+      executed += this->run_lane(leader, this->remaining[leader]);
+      continue;
+    }
+
+    // The keys do not change during a run, so lanes waiting for a key wait
+    // until the end of their budget. Unknown operation codes halt the lanes.
+    if (!is_group_instruction(decoded[opcode].operation)) {
+      for (u32 lane = leader; lane < end; lane++) {
+        if (this->group[lane] != 0) {
+          executed += this->run_lane(lane, this->remaining[lane]);
+        }
+      }
+      continue;
+    }
+
+    // Execute instructions on the group as long as all lanes stay at the
+    // same address and see the same operation codes there
+    u32 steps = 0;
+    u32 dropped = 0;
+    for (;;) {
+      const Instruction& instruction = decoded[opcode];
+      dropped = this->prepare_group(leader, end, instruction, opcode, steps);
+      this->kernel(this->lanes, instruction, begin, end);
+      steps++;
+
+      if (dropped != 0 || steps == budget ||
+          !keeps_group_together(instruction.operation)) {
+        break;
+      }
+
+      address = this->program_counter[leader];
+      if ((group_pages & get_code_pages(address)) != 0) {
+        break;
+      }
+      opcode = this->fetch(leader);
+      if (!is_group_instruction(decoded[opcode].operation)) {
+        break;
+      }
+    }
+
+    for (u32 lane = leader; lane < end; lane++) {
+      if (this->group[lane] != 0) {
+        this->remaining[lane] -= steps;
+        this->machines[lane].state.cycles += steps;
+        this->current_opcode[lane] = opcode;
+      }
+    }
+    executed += static_cast<u64>(members) * steps - dropped;
+  }
+
+  // Lanes of the next tile may share vectors with this one
+  for (u32 lane = begin; lane < end; lane++) {
+    this->group[lane] = 0;
+  }
+
+  return executed;
+}
+
+u32 Chip8Lockstep::prepare_group(u32 begin, u32 end,
+                                 const Instruction& instruction, u16 opcode,
+                                 u32 steps) {
+  // The parts of the instruction that need the machine of each lane, the
+  // same as in the Interpreter: keypad, stack and random numbers here,
+  // drawing and memory in the Interpreter itself
+  u8* const vx = this->lanes.general_purpose_variable_registers[instruction.x];
+  u32 dropped = 0;
+  switch (instruction.operation) {
+    case kSkipIfKeyPressed:
+    case kSkipIfKeyNotPressed:
+      for (u32 lane = begin; lane < end; lane++) {
+        if (this->group[lane] != 0) {
+          this->key_pressed[lane] =
+              this->machines[lane].state.keypad.is_pressed(vx[lane]) ? 0xFF : 0;
+        }
+      }
+      break;
+    case kCallSubroutine:
+      for (u32 lane = begin; lane < end; lane++) {
+        if (this->group[lane] == 0) {
+          continue;
+        }
+        Chip8& machine = this->machines[lane];
+        if (machine.state.stack_pointer == machine.state.stack.size()) {
+          // Halts at the call, like the Interpreter
+          machine.state.fault = kStackOverflow;
+          this->drop_lane(lane, opcode, steps);
+          dropped++;
+          continue;
+        }
+        machine.state.stack[machine.state.stack_pointer++] =
+            this->program_counter[lane] + 2;
+      }
+      break;
+    case kReturnFromSubroutine:
+      for (u32 lane = begin; lane < end; lane++) {
+        if (this->group[lane] == 0) {
+          continue;
+        }
+        Chip8& machine = this->machines[lane];
+        if (machine.state.stack_pointer == 0) {
+          machine.state.fault = kStackUnderflow;
+          this->drop_lane(lane, opcode, steps);
+          dropped++;
+          continue;
+        }
+        this->return_address[lane] =
+            machine.state.stack[--machine.state.stack_pointer];
+      }
+      break;
+    case kGenerateRandomNumber:
+      for (u32 lane = begin; lane < end; lane++) {
+        if (this->group[lane] != 0) {
+          vx[lane] = this->machines[lane].state.rand.get_random_number() &
+                     instruction.nn;
+        }
+      }
+      break;
+    case kClearScreen:
+    case kDrawSprite:
+    case kStoreBinaryCodedDecimal:
+    case kStoreRegisters:
+    case kLoadRegisters:
+    case kScrollDown:
+    case kScrollUp:
+    case kScrollRight:
+    case kScrollLeft:
+    case kLowResolution:
+    case kHighResolution:
+    case kDrawLargeSprite:
+    case kSelectPlanes: {
+      const u16 registers = get_used_registers(instruction);
+      for (u32 lane = begin; lane < end; lane++) {
+        if (this->group[lane] != 0 &&
+            !this->execute_lane(lane, instruction, registers)) {
+          this->drop_lane(lane, opcode, steps);
+          dropped++;
+        }
+      }
+      break;
+    }
+    default:
+      break;
+  }
+
+  return dropped;
+}
+
+void Chip8Lockstep::drop_lane(u32 lane, u16 opcode, u32 steps) {
+  // The group does not count the lane any more, so count the instructions
+  // it executed with the group here
+  this->machines[lane].state.cycles += steps;
+  this->current_opcode[lane] = opcode;
+  this->halted[lane] = true;
+  this->remaining[lane] = 0;
+  this->group[lane] = 0;
+}
+
+bool Chip8Lockstep::execute_lane(u32 lane, const Instruction& instruction,
+                                 u16 registers) {
+  Chip8& machine = this->machines[lane];
+  u8* const* v = this->lanes.general_purpose_variable_registers;
+  for (u32 left = registers; left != 0; left &= left - 1) {
+    const u32 i = lowest_bit(left);
+    machine.state.general_purpose_variable_registers[i] = v[i][lane];
+  }
+  machine.state.index_register = this->index_register[lane];
+
+  Interpreter interpreter(machine);
+  interpreter.execute_fetched(instruction);
+  const bool completed = machine.state.fault == kNoFault;
+  if (!completed) {
+    // Halt where the Interpreter stops: after the fetch, before the timer
+    // update
+    this->program_counter[lane] += 2;
+    this->halted[lane] = true;
+    this->remaining[lane] = 0;
+  }
+
+  for (u32 left = registers; left != 0; left &= left - 1) {
+    const u32 i = lowest_bit(left);
+    v[i][lane] = machine.state.general_purpose_variable_registers[i];
+  }
+  this->index_register[lane] = machine.state.index_register;
+  this->track_written_memory(lane);
+
+  return completed;
+}
+
+Chip8& Chip8Lockstep::get_machine(u32 lane) {
+  this->store_lane(lane);
+  return this->machines[lane];
+}
+
+const char* Chip8Lockstep::get_kernel_name() {
+#if defined(CHIP8_LOCKSTEP_AVX2)
+  if (this->kernel == execute_lockstep_avx2) {
+    return "avx2";
+  }
+#endif
+#if defined(CHIP8_LOCKSTEP_SSE2)
+  if (this->kernel == execute_lockstep_sse2) {
+    return "sse2";
+  }
+#endif
+  return "portable";
+}
+
+bool Chip8Lockstep::set_kernel(const std::string& name) {
+#if defined(CHIP8_LOCKSTEP_AVX2)
+  if (name == "avx2" && __builtin_cpu_supports("avx2")) {
+    this->kernel = execute_lockstep_avx2;
+    return true;
+  }
+#endif
+#if defined(CHIP8_LOCKSTEP_SSE2)
+  if (name == "sse2") {
+    this->kernel = execute_lockstep_sse2;
+    return true;
+  }
+#endif
+  if (name == "portable") {
+    this->kernel = execute_lockstep_portable;
+    return true;
+  }
+  return false;
+}
+
+void Chip8Lockstep::load_lane(u32 lane) {
+  const Chip8& machine = this->machines[lane];
+  for (u32 i = 0; i < 16; i++) {
+    this->lanes.general_purpose_variable_registers[i][lane] =
+        machine.state.general_purpose_variable_registers[i];
+  }
+  this->index_register[lane] = machine.state.index_register;
+  this->program_counter[lane] = machine.state.program_counter;
+  this->delay_timer[lane] = machine.state.delay_timer;
+  this->sound_timer[lane] = machine.state.sound_timer;
+  this->current_opcode[lane] = machine.state.current_opcode;
+}
+
+void Chip8Lockstep::store_lane(u32 lane) {
+  Chip8& machine = this->machines[lane];
+  for (u32 i = 0; i < 16; i++) {
+    machine.state.general_purpose_variable_registers[i] =
+        this->lanes.general_purpose_variable_registers[i][lane];
+  }
+  machine.state.index_register = this->index_register[lane];
+  machine.state.program_counter = this->program_counter[lane];
+  machine.state.delay_timer = this->delay_timer[lane];
+  machine.state.sound_timer = this->sound_timer[lane];
+  machine.state.current_opcode = this->current_opcode[lane];
+}
+
+u32 Chip8Lockstep::run_lane(u32 lane, u32 cycles) {
+  Chip8& machine = this->machines[lane];
+  this->store_lane(lane);
+
+  Interpreter interpreter(machine);
+  const u32 executed = interpreter.execute(cycles);
+  machine.state.cycles += executed;
+  if (machine.state.fault != kNoFault) {
+    this->halted[lane] = true;
+  }
+
+  this->track_written_memory(lane);
+
+  this->load_lane(lane);
+  this->remaining[lane] =
+      this->halted[lane] ? 0 : this->remaining[lane] - executed;
+  return executed;
+}
+
+void Chip8Lockstep::track_written_memory(u32 lane) {
+  Chip8& machine = this->machines[lane];
+  if (!machine.memory_written) {
+    return;
+  }
+
+  for (u32 page = machine.memory_written_begin >> 6;
+       page <= (machine.memory_written_end - 1u) >> 6; page++) {
+    this->written_pages[lane] |= 1ull << page;
+  }
+  machine.memory_written = false;
+}
+
+bool Chip8Lockstep::is_group_instruction(Operation operation) {
+  return operation != kWaitForKeyPressed && operation != kUnknown;
+}
+
+bool Chip8Lockstep::keeps_group_together(Operation operation) {
+  switch (operation) {
+    // The lanes can end up at different addresses
+    case kReturnFromSubroutine:
+    case kSkipIfEqual:
+    case kSkipIfNotEqual:
+    case kSkipIfVxEqualVy:
+    case kSkipIfVxNotEqualVy:
+    case kJumpToExtendedLocation:
+    case kSkipIfKeyPressed:
+    case kSkipIfKeyNotPressed:
+    // The lanes can end up with different code in memory
+    case kStoreBinaryCodedDecimal:
+    case kStoreRegisters:
+      return false;
+    default:
+      return true;
+  }
+}
+
+u16 Chip8Lockstep::get_used_registers(const Instruction& instruction) {
+  // General purpose registers read or written by the instructions that
+  // the Interpreter executes lane by lane (see prepare_group)
+  const u16 x = 1u << instruction.x;
+  const u16 up_to_x = (2u << instruction.x) - 1;
+  switch (instruction.operation) {
+    case kClearScreen:
+    case kScrollDown:
+    case kScrollUp:
+    case kScrollRight:
+    case kScrollLeft:
+    case kLowResolution:
+    case kHighResolution:
+    case kSelectPlanes:
+      return 0;
+    case kDrawSprite:
+    case kDrawLargeSprite:
+      return x | 1u << instruction.y | 1u << 0xF;
+    case kStoreRegisters:
+    case kLoadRegisters:
+      return up_to_x;
+    case kStoreBinaryCodedDecimal:
+      return x;
+    default:
+      return 0xFFFF;
+  }
+}
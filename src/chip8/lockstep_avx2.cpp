@@ -0,0 +1,81 @@
+#include "chip8/lockstep_kernel.h"
+
+// This file is compiled with -mavx2 and only called after checking that
+// the processor supports AVX2 (see Chip8Lockstep::select_kernel)
+#if defined(CHIP8_LOCKSTEP_AVX2)
+
+#include <immintrin.h>
+
+// 32 lanes per vector, words in two halves of 16 lanes each
+struct Avx2Vector {
+  typedef __m256i Bytes;
+  typedef __m256i Words;
+  static const u32 WIDTH = 32;
+  static const u32 WORDS = 2;
+
+  static Bytes load(const u8* source) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source));
+  }
+  static void store(u8* destination, Bytes value) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination), value);
+  }
+  static void store_masked(u8* destination, Bytes value, Bytes mask) {
+    store(destination, _mm256_blendv_epi8(load(destination), value, mask));
+  }
+  static Bytes splat(u8 value) {
+    return _mm256_set1_epi8(static_cast<char>(value));
+  }
+  static bool is_zero(Bytes value) { return _mm256_testz_si256(value, value); }
+
+  static Bytes and_(Bytes a, Bytes b) { return _mm256_and_si256(a, b); }
+  static Bytes or_(Bytes a, Bytes b) { return _mm256_or_si256(a, b); }
+  static Bytes xor_(Bytes a, Bytes b) { return _mm256_xor_si256(a, b); }
+  // ~a & b
+  static Bytes and_not(Bytes a, Bytes b) { return _mm256_andnot_si256(a, b); }
+  static Bytes equal(Bytes a, Bytes b) { return _mm256_cmpeq_epi8(a, b); }
+  static Bytes add(Bytes a, Bytes b) { return _mm256_add_epi8(a, b); }
+  static Bytes subtract(Bytes a, Bytes b) { return _mm256_sub_epi8(a, b); }
+  static Bytes add_saturated(Bytes a, Bytes b) {
+    return _mm256_adds_epu8(a, b);
+  }
+  static Bytes subtract_saturated(Bytes a, Bytes b) {
+    return _mm256_subs_epu8(a, b);
+  }
+  // There is no byte shift: shift words and clear the bit shifted in
+  static Bytes shift_right(Bytes a) {
+    return _mm256_and_si256(_mm256_srli_epi16(a, 1), _mm256_set1_epi8(0x7F));
+  }
+
+  static Words load_words(const u16* source) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source));
+  }
+  static void store_words(u16* destination, Words value) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination), value);
+  }
+  static Words splat_words(u16 value) {
+    return _mm256_set1_epi16(static_cast<short>(value));
+  }
+  static Words add_words(Words a, Words b) { return _mm256_add_epi16(a, b); }
+  static Words select_words(Words current, Words value, Words mask) {
+    return _mm256_blendv_epi8(current, value, mask);
+  }
+  // Zero extend half of the bytes to words (the unpack instructions of AVX2
+  // work within 128 bit lanes, so convert the halves instead)
+  static Words widen(Bytes value, u32 half) {
+    return _mm256_cvtepu8_epi16(half == 0 ? _mm256_castsi256_si128(value)
+                                          : _mm256_extracti128_si256(value, 1));
+  }
+  // Extend half of a byte mask (0xFF / 0) to a word mask (0xFFFF / 0)
+  static Words widen_mask(Bytes mask, u32 half) {
+    return _mm256_cvtepi8_epi16(half == 0 ? _mm256_castsi256_si128(mask)
+                                          : _mm256_extracti128_si256(mask, 1));
+  }
+};
+
+void execute_lockstep_avx2(LockstepLanes& lanes,
+                           const Instruction& instruction, u32 begin,
+                           u32 end) {
+  execute_lockstep<Avx2Vector>(lanes, instruction, begin, end);
+}
+
+#endif
@@ -0,0 +1,77 @@
+#include "chip8/lockstep_kernel.h"
+
+#if defined(CHIP8_LOCKSTEP_SSE2)
+
+#include <emmintrin.h>
+
+// 16 lanes per vector, words in two halves of 8 lanes each
+struct Sse2Vector {
+  typedef __m128i Bytes;
+  typedef __m128i Words;
+  static const u32 WIDTH = 16;
+  static const u32 WORDS = 2;
+
+  static Bytes load(const u8* source) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(source));
+  }
+  static void store(u8* destination, Bytes value) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(destination), value);
+  }
+  static void store_masked(u8* destination, Bytes value, Bytes mask) {
+    store(destination, _mm_or_si128(_mm_and_si128(mask, value),
+                                    _mm_andnot_si128(mask, load(destination))));
+  }
+  static Bytes splat(u8 value) { return _mm_set1_epi8(static_cast<char>(value)); }
+  static bool is_zero(Bytes value) { return _mm_movemask_epi8(value) == 0; }
+
+  static Bytes and_(Bytes a, Bytes b) { return _mm_and_si128(a, b); }
+  static Bytes or_(Bytes a, Bytes b) { return _mm_or_si128(a, b); }
+  static Bytes xor_(Bytes a, Bytes b) { return _mm_xor_si128(a, b); }
+  // ~a & b
+  static Bytes and_not(Bytes a, Bytes b) { return _mm_andnot_si128(a, b); }
+  static Bytes equal(Bytes a, Bytes b) { return _mm_cmpeq_epi8(a, b); }
+  static Bytes add(Bytes a, Bytes b) { return _mm_add_epi8(a, b); }
+  static Bytes subtract(Bytes a, Bytes b) { return _mm_sub_epi8(a, b); }
+  static Bytes add_saturated(Bytes a, Bytes b) { return _mm_adds_epu8(a, b); }
+  static Bytes subtract_saturated(Bytes a, Bytes b) {
+    return _mm_subs_epu8(a, b);
+  }
+  // There is no byte shift: shift words and clear the bit shifted in
+  static Bytes shift_right(Bytes a) {
+    return _mm_and_si128(_mm_srli_epi16(a, 1), _mm_set1_epi8(0x7F));
+  }
+
+  static Words load_words(const u16* source) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(source));
+  }
+  static void store_words(u16* destination, Words value) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(destination), value);
+  }
+  static Words splat_words(u16 value) {
+    return _mm_set1_epi16(static_cast<short>(value));
+  }
+  static Words add_words(Words a, Words b) { return _mm_add_epi16(a, b); }
+  static Words select_words(Words current, Words value, Words mask) {
+    return _mm_or_si128(_mm_and_si128(mask, value),
+                        _mm_andnot_si128(mask, current));
+  }
+  // Zero extend half of the bytes to words
+  static Words widen(Bytes value, u32 half) {
+    const __m128i zero = _mm_setzero_si128();
+    return half == 0 ? _mm_unpacklo_epi8(value, zero)
+                     : _mm_unpackhi_epi8(value, zero);
+  }
+  // Extend half of a byte mask (0xFF / 0) to a word mask (0xFFFF / 0)
+  static Words widen_mask(Bytes mask, u32 half) {
+    return half == 0 ? _mm_unpacklo_epi8(mask, mask)
+                     : _mm_unpackhi_epi8(mask, mask);
+  }
+};
+
+void execute_lockstep_sse2(LockstepLanes& lanes,
+                           const Instruction& instruction, u32 begin,
+                           u32 end) {
+  execute_lockstep<Sse2Vector>(lanes, instruction, begin, end);
+}
+
+#endif
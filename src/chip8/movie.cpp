@@ -0,0 +1,168 @@
+#include "chip8/movie.h"
+
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+
+static const char MAGIC[4] = {'C', '8', 'M', 'V'};
+
+// The host keys of the keypad keys 0 - F before version 3 (the keycodes of
+// SDL, which the keypad translated itself)
+static const char LEGACY_KEYS[17] = "1234qwerasdfzxcv";
+
+void Movie::start(u64 program_hash, u64 seed, u32 instructions_per_frame,
+                  Chip8Quirks quirks) {
+  this->header = {};
+  std::memcpy(this->header.magic, MAGIC, sizeof(MAGIC));
+  this->header.version = VERSION;
+  this->header.program_hash = program_hash;
+  this->header.seed = seed;
+  this->header.instructions_per_frame = instructions_per_frame;
+  this->header.quirks = quirks;
+  this->events.clear();
+}
+
+void Movie::record(u64 cycle, u8 key, bool pressed) {
+  MovieEvent event = {};
+  event.cycle = cycle;
+  event.key = key;
+  event.pressed = pressed;
+  this->events.push_back(event);
+}
+
+void Movie::rewind(u64 cycle) {
+  while (!this->events.empty() && this->events.back().cycle >= cycle) {
+    this->events.pop_back();
+  }
+}
+
+void Movie::finish(Chip8& chip8) {
+  this->header.event_count = this->events.size();
+  this->header.cycles = chip8.get_cycles();
+  this->header.state_hash = chip8.get_state_hash();
+}
+
+bool Movie::write(const std::string& path) {
+  std::ofstream file(path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  file.write(reinterpret_cast<const char*>(&this->header),
+             sizeof(this->header));
+  file.write(reinterpret_cast<const char*>(this->events.data()),
+             this->events.size() * sizeof(MovieEvent));
+  return static_cast<bool>(file);
+}
+
+bool Movie::read(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+
+  // Version 1 headers end before the quirks
+  const size_t version_1_size = offsetof(MovieHeader, quirks);
+  MovieHeader header{};
+  if (!file.read(reinterpret_cast<char*>(&header), version_1_size) ||
+      std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      header.version < 1 || header.version > VERSION) {
+    return false;
+  }
+  if (header.version > 1 &&
+      !file.read(reinterpret_cast<char*>(&header) + version_1_size,
+                 sizeof(header) - version_1_size)) {
+    return false;
+  }
+  if (header.instructions_per_frame == 0 ||
+      header.quirks > kSuperChipQuirks) {
+    return false;
+  }
+
+  // The count sizes the allocation, so it has to fit into the file
+  const std::streampos events_start = file.tellg();
+  file.seekg(0, std::ios::end);
+  const std::streamoff remaining = file.tellg() - events_start;
+  file.seekg(events_start);
+  if (!file || remaining < 0 ||
+      static_cast<u64>(header.event_count) * sizeof(MovieEvent) >
+          static_cast<u64>(remaining)) {
+    return false;
+  }
+
+  std::vector<MovieEvent> events(header.event_count);
+  if (!file.read(reinterpret_cast<char*>(events.data()),
+                 events.size() * sizeof(MovieEvent))) {
+    return false;
+  }
+
+  // Older movies name host keys, the ones that were no keypad key never
+  // changed the machine
+  if (header.version < 3) {
+    std::vector<MovieEvent> keypad_events;
+    for (MovieEvent event : events) {
+      const char* key = std::strchr(LEGACY_KEYS, event.key);
+      if (event.key != 0 && key != nullptr) {
+        event.key = key - LEGACY_KEYS;
+        keypad_events.push_back(event);
+      }
+    }
+    events.swap(keypad_events);
+    header.event_count = events.size();
+  }
+
+  // Playback applies the events in order of their cycles
+  for (size_t i = 0; i < events.size(); i++) {
+    if (events[i].key >= Keypad::KEYS ||
+        (i > 0 && events[i].cycle < events[i - 1].cycle)) {
+      return false;
+    }
+  }
+
+  this->header = header;
+  this->events.swap(events);
+  return true;
+}
+
+u64 Movie::play(Chip8& chip8) {
+  chip8.set_random_seed(this->header.seed);
+  chip8.set_quirks(static_cast<Chip8Quirks>(this->header.quirks));
+  chip8.set_timer_mode(kFrameTimers);
+
+  size_t next = 0;
+  while (chip8.get_cycles() < this->header.cycles &&
+         chip8.get_fault() == kNoFault) {
+    // One frame, split at the cycles of the key events inside it
+    u32 left = this->header.instructions_per_frame;
+    while (left > 0) {
+      for (; next < this->events.size() &&
+             this->events[next].cycle <= chip8.get_cycles();
+           next++) {
+        chip8.set_key(this->events[next].key, this->events[next].pressed);
+      }
+
+      u32 cycles = left;
+      if (next < this->events.size() &&
+          this->events[next].cycle - chip8.get_cycles() < cycles) {
+        cycles = this->events[next].cycle - chip8.get_cycles();
+      }
+      const u32 executed = chip8.run(cycles);
+      left -= executed;
+      if (executed < cycles) {
+        break;
+      }
+    }
+
+    if (chip8.get_fault() == kNoFault) {
+      chip8.tick_timers();
+    }
+  }
+
+  // Keys that changed after the last frame
+  for (; next < this->events.size() &&
+         this->events[next].cycle <= chip8.get_cycles();
+       next++) {
+    chip8.set_key(this->events[next].key, this->events[next].pressed);
+  }
+
+  return chip8.get_cycles();
+}
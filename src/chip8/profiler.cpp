@@ -0,0 +1,160 @@
+#include "chip8/profiler.h"
+
+#include <algorithm>
+#include <utility>
+
+#define CHIP8_OPERATION_NAME(name, handler) #name,
+static const char* const OPERATION_NAMES[kOperationCount] = {
+    "Unknown", CHIP8_OPERATIONS(CHIP8_OPERATION_NAME)};
+#undef CHIP8_OPERATION_NAME
+
+#define CHIP8_HANDLER_NAME(name, handler) #handler,
+static const char* const HANDLER_NAMES[kOperationCount] = {
+    "trap_unknown_opcode", CHIP8_OPERATIONS(CHIP8_HANDLER_NAME)};
+#undef CHIP8_HANDLER_NAME
+
+Profiler::Profiler() { this->reset(); }
+
+void Profiler::reset() {
+  this->paths.assign(1, CallPath{0x200, 0, 0, {}, {}});
+  this->path = 0;
+  this->hidden_calls = 0;
+  this->instructions = 0;
+
+  this->executed.fill(0);
+  this->reads.fill(0);
+  this->writes.fill(0);
+
+  this->frames.clear();
+  this->instructions_before_frame = 0;
+}
+
+void Profiler::enter_subroutine(u16 address) {
+  const u32 depth = this->paths[this->path].depth;
+  if (depth == MAXIMUM_DEPTH) {
+    this->hidden_calls++;
+    return;
+  }
+
+  for (u32 child : this->paths[this->path].children) {
+    if (this->paths[child].address == address) {
+      this->path = child;
+      return;
+    }
+  }
+
+  const u32 child = this->paths.size();
+  this->paths.push_back(CallPath{address, this->path, depth + 1, {}, {}});
+  this->paths[this->path].children.push_back(child);
+  this->path = child;
+}
+
+void Profiler::leave_subroutine() {
+  if (this->hidden_calls > 0) {
+    this->hidden_calls--;
+  } else if (this->path != 0) {
+    // A return without a call (stack underflow) stays at the start
+    this->path = this->paths[this->path].parent;
+  }
+}
+
+void Profiler::end_frame() {
+  this->frames.push_back(this->instructions - this->instructions_before_frame);
+  this->instructions_before_frame = this->instructions;
+}
+
+u64 Profiler::get_operation_count(Operation operation) {
+  u64 count = 0;
+  for (const CallPath& path : this->paths) {
+    count += path.operations[operation];
+  }
+  return count;
+}
+
+// Array of 4096 counters on one line
+static void write_counters(BufferedWriter& out,
+                           const std::array<u64, 4096>& counters) {
+  out << '[';
+  for (size_t i = 0; i < counters.size(); i++) {
+    out << (i > 0 ? ", " : "") << counters[i];
+  }
+  out << ']';
+}
+
+void Profiler::write_json(BufferedWriter& out) {
+  out << "{\n  \"instructions\": " << this->instructions << ",\n";
+
+  // Operations and addresses with the most instructions first
+  std::vector<std::pair<u64, u32>> operations;
+  for (u32 operation = 0; operation < kOperationCount; operation++) {
+    const u64 count = this->get_operation_count(Operation(operation));
+    if (count > 0) {
+      operations.push_back({count, operation});
+    }
+  }
+  std::sort(operations.rbegin(), operations.rend());
+
+  out << "  \"operations\": [";
+  for (size_t i = 0; i < operations.size(); i++) {
+    out << (i > 0 ? ",\n" : "\n") << "    {\"operation\": \""
+        << OPERATION_NAMES[operations[i].second] << "\", \"handler\": \""
+        << HANDLER_NAMES[operations[i].second]
+        << "\", \"count\": " << operations[i].first << '}';
+  }
+  out << "\n  ],\n";
+
+  std::vector<std::pair<u64, u32>> addresses;
+  for (u32 address = 0; address < this->executed.size(); address++) {
+    if (this->executed[address] > 0) {
+      addresses.push_back({this->executed[address], address});
+    }
+  }
+  std::sort(addresses.rbegin(), addresses.rend());
+
+  out << "  \"hot_addresses\": [";
+  for (size_t i = 0; i < addresses.size(); i++) {
+    out << (i > 0 ? ",\n" : "\n") << "    {\"address\": "
+        << u64(addresses[i].second) << ", \"count\": " << addresses[i].first
+        << '}';
+  }
+  out << "\n  ],\n";
+
+  // Heatmap of the memory: instructions executed at, bytes read from and
+  // bytes written to every address
+  out << "  \"memory\": {\n    \"execute\": ";
+  write_counters(out, this->executed);
+  out << ",\n    \"read\": ";
+  write_counters(out, this->reads);
+  out << ",\n    \"write\": ";
+  write_counters(out, this->writes);
+  out << "\n  },\n";
+
+  out << "  \"frames\": [";
+  for (size_t i = 0; i < this->frames.size(); i++) {
+    out << (i > 0 ? ", " : "") << u64(this->frames[i]);
+  }
+  out << "]\n}\n";
+}
+
+void Profiler::write_folded(BufferedWriter& out) {
+  for (u32 path = 0; path < this->paths.size(); path++) {
+    for (u32 operation = 0; operation < kOperationCount; operation++) {
+      const u64 count = this->paths[path].operations[operation];
+      if (count == 0) {
+        continue;
+      }
+      this->write_path(out, path);
+      out << ';' << OPERATION_NAMES[operation] << ' ' << count << '\n';
+    }
+  }
+}
+
+void Profiler::write_path(BufferedWriter& out, u32 path) {
+  if (path == 0) {
+    out << "start";
+    return;
+  }
+  this->write_path(out, this->paths[path].parent);
+  out << ";sub_";
+  out.write_hex(this->paths[path].address, 3);
+}
@@ -1,10 +1,13 @@
 #include "chip8/random.h"
 
-Random::Random() {}
+void Random::set_seed(u64 seed, u64 stream) {
+  this->seed = seed;
+  this->stream = stream;
 
-Random::~Random() {}
-
-int Random::get_random_number() {
-  srand(time(0));
-  return rand() % 256;
-}
\ No newline at end of file
+  // Seeding procedure of the PCG reference implementation
+  this->increment = stream << 1 | 1u;
+  this->state = 0;
+  this->next();
+  this->state += seed;
+  this->next();
+}
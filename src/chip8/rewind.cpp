@@ -0,0 +1,202 @@
+#include "chip8/rewind.h"
+
+#include <cstring>
+
+static_assert(sizeof(Chip8State) % sizeof(u64) == 0,
+              "The XOR delta compares the state in u64 words");
+static_assert(sizeof(Chip8State) <= 0xFFFF,
+              "Delta runs are stored with u16 offsets and lengths");
+
+// A delta is a sequence of runs: u16 bytes to skip (unchanged since the end
+// of the previous run), u16 run length, then the run length XOR bytes
+static const u32 RUN_HEADER_SIZE = 2 * sizeof(u16);
+
+RewindBuffer::RewindBuffer(u32 budget)
+    : storage(budget < MINIMUM_BUDGET ? MINIMUM_BUDGET : budget),
+      write_offset(0),
+      used_bytes(0),
+      next_frame(0),
+      current(),
+      scratch(2 * sizeof(Chip8State)) {}
+
+void RewindBuffer::clear() {
+  this->records.clear();
+  this->write_offset = 0;
+  this->used_bytes = 0;
+  this->next_frame = 0;
+}
+
+void RewindBuffer::push(const Chip8State& state) {
+  // The first frame has nothing to be a delta of
+  const u32 delta_size =
+      this->records.empty() ? 0 : this->encode(this->current, state);
+
+  RewindRecord record;
+  record.delta_size = delta_size;
+  record.keyframe =
+      this->records.empty() || this->next_frame % KEYFRAME_INTERVAL == 0;
+  record.offset = this->allocate(record.get_size());
+
+  u8* data = this->storage.data() + record.offset;
+  std::memcpy(data, this->scratch.data(), delta_size);
+  if (record.keyframe) {
+    std::memcpy(data + delta_size, &state, sizeof(Chip8State));
+  }
+
+  this->records.push_back(record);
+  this->used_bytes += record.get_size();
+  this->write_offset = record.offset + record.get_size();
+  this->next_frame++;
+  this->current = state;
+}
+
+bool RewindBuffer::step_back(Chip8State& state) {
+  if (this->records.size() < 2) {
+    return false;
+  }
+
+  const RewindRecord& newest = this->records.back();
+  apply(this->storage.data() + newest.offset, newest.delta_size,
+        this->current);
+  this->used_bytes -= newest.get_size();
+  this->records.pop_back();
+
+  const RewindRecord& previous = this->records.back();
+  this->write_offset = previous.offset + previous.get_size();
+  this->next_frame--;
+
+  state = this->current;
+  return true;
+}
+
+bool RewindBuffer::seek_back(u32 frames, Chip8State& state) {
+  if (frames == 0 || frames > this->get_frame_count()) {
+    return false;
+  }
+
+  // Newest keyframe at or before the target frame
+  const size_t target = this->records.size() - 1 - frames;
+  size_t keyframe = target;
+  while (keyframe > 0 && !this->records[keyframe].keyframe) {
+    keyframe--;
+  }
+
+  if (!this->records[keyframe].keyframe || frames <= target - keyframe) {
+    // Walking back from the newest frame is shorter (or the only way, if
+    // the keyframe before the target was dropped)
+    for (u32 i = 0; i < frames; i++) {
+      this->step_back(state);
+    }
+    return true;
+  }
+
+  const RewindRecord& start = this->records[keyframe];
+  std::memcpy(&this->current,
+              this->storage.data() + start.offset + start.delta_size,
+              sizeof(Chip8State));
+  for (size_t i = keyframe + 1; i <= target; i++) {
+    const RewindRecord& record = this->records[i];
+    apply(this->storage.data() + record.offset, record.delta_size,
+          this->current);
+  }
+
+  for (size_t i = target + 1; i < this->records.size(); i++) {
+    this->used_bytes -= this->records[i].get_size();
+  }
+  this->records.resize(target + 1);
+  const RewindRecord& newest = this->records.back();
+  this->write_offset = newest.offset + newest.get_size();
+  this->next_frame -= frames;
+
+  state = this->current;
+  return true;
+}
+
+u32 RewindBuffer::allocate(u32 size) {
+  // Records are stored one after another and wrap around to the start of
+  // the storage when the next one does not fit before the end. Records in
+  // the way of the new one are the oldest, drop them.
+  u32 offset = this->write_offset;
+  if (offset + size > this->storage.size()) {
+    while (!this->records.empty() && this->records.front().offset >= offset) {
+      this->used_bytes -= this->records.front().get_size();
+      this->records.pop_front();
+    }
+    offset = 0;
+  }
+  while (!this->records.empty() && this->records.front().offset >= offset &&
+         this->records.front().offset < offset + size) {
+    this->used_bytes -= this->records.front().get_size();
+    this->records.pop_front();
+  }
+  return offset;
+}
+
+u32 RewindBuffer::encode(const Chip8State& previous, const Chip8State& next) {
+  const u8* a = reinterpret_cast<const u8*>(&previous);
+  const u8* b = reinterpret_cast<const u8*>(&next);
+  u8* out = this->scratch.data();
+  u32 size = 0;
+  u32 run_end = 0;  // End of the previous run
+
+  // Find runs of changed u64 words, then trim the unchanged bytes at their
+  // edges
+  const u32 words = sizeof(Chip8State) / sizeof(u64);
+  u32 word = 0;
+  while (word < words) {
+    u64 x, y;
+    std::memcpy(&x, a + word * sizeof(u64), sizeof(u64));
+    std::memcpy(&y, b + word * sizeof(u64), sizeof(u64));
+    if (x == y) {
+      word++;
+      continue;
+    }
+
+    u32 begin = word * sizeof(u64);
+    do {
+      word++;
+      if (word == words) {
+        break;
+      }
+      std::memcpy(&x, a + word * sizeof(u64), sizeof(u64));
+      std::memcpy(&y, b + word * sizeof(u64), sizeof(u64));
+    } while (x != y);
+    u32 end = word * sizeof(u64);
+    while (a[begin] == b[begin]) {
+      begin++;
+    }
+    while (a[end - 1] == b[end - 1]) {
+      end--;
+    }
+
+    const u16 skip = begin - run_end;
+    const u16 length = end - begin;
+    std::memcpy(out + size, &skip, sizeof(skip));
+    std::memcpy(out + size + sizeof(skip), &length, sizeof(length));
+    size += RUN_HEADER_SIZE;
+    for (u32 i = begin; i < end; i++) {
+      out[size++] = a[i] ^ b[i];
+    }
+    run_end = end;
+  }
+
+  return size;
+}
+
+void RewindBuffer::apply(const u8* delta, u32 size, Chip8State& state) {
+  u8* bytes = reinterpret_cast<u8*>(&state);
+  u32 position = 0;
+  u32 offset = 0;
+  while (position < size) {
+    u16 skip, length;
+    std::memcpy(&skip, delta + position, sizeof(skip));
+    std::memcpy(&length, delta + position + sizeof(skip), sizeof(length));
+    position += RUN_HEADER_SIZE;
+    offset += skip;
+    for (u32 i = 0; i < length; i++) {
+      bytes[offset + i] ^= delta[position + i];
+    }
+    position += length;
+    offset += length;
+  }
+}
@@ -0,0 +1,185 @@
+#include "chip8/rom.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+RomFile::RomFile() : mapping(nullptr), size(0) {}
+
+RomFile::~RomFile() { this->close(); }
+
+bool RomFile::open(const std::string& filename) {
+  this->close();
+
+  const int file = ::open(filename.c_str(), O_RDONLY);
+  if (file < 0) {
+    std::cerr << "Unable to load program: " << filename << '\n';
+    return false;
+  }
+
+  struct stat status;
+  if (fstat(file, &status) != 0 || !S_ISREG(status.st_mode)) {
+    std::cerr << "Unable to load program: " << filename << '\n';
+    ::close(file);
+    return false;
+  }
+  if (status.st_size == 0 || status.st_size > MAXIMUM_SIZE) {
+    std::cerr << "Invalid program size: " << filename << " ("
+              << status.st_size << " bytes, at most " << MAXIMUM_SIZE
+              << ")\n";
+    ::close(file);
+    return false;
+  }
+
+  // The mapping stays valid after the file is closed
+  void* mapping =
+      mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+  ::close(file);
+  if (mapping == MAP_FAILED) {
+    std::cerr << "Unable to load program: " << filename << '\n';
+    return false;
+  }
+
+  this->mapping = mapping;
+  this->size = status.st_size;
+  return true;
+}
+
+void RomFile::close() {
+  if (this->mapping != nullptr) {
+    munmap(this->mapping, this->size);
+  }
+  this->mapping = nullptr;
+  this->size = 0;
+}
+
+u64 RomLibrary::get_hash(const void* program, u32 size) {
+  // 64-bit FNV-1a
+  const u8* bytes = static_cast<const u8*>(program);
+  u64 hash = 0xCBF29CE484222325ull;
+  for (u32 i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+  }
+  for (u32 i = size; i < RomFile::MAXIMUM_SIZE; i++) {
+    hash *= 0x100000001B3ull;
+  }
+  return hash;
+}
+
+Chip8Quirks RomLibrary::find_quirks(const std::string& program_file) {
+  const size_t slash = program_file.find_last_of("/\\");
+  const std::string name =
+      program_file.substr(slash == std::string::npos ? 0 : slash + 1);
+  const std::string quirks_file =
+      (slash == std::string::npos ? "" : program_file.substr(0, slash + 1)) +
+      "quirks.txt";
+
+  std::ifstream file(quirks_file);
+  std::string line;
+  u32 number = 0;
+  while (std::getline(file, line)) {
+    number++;
+    std::istringstream words(line.substr(0, line.find('#')));
+    std::string program;
+    std::string profile;
+    if (!(words >> program) || program != name) {
+      continue;
+    }
+
+    Chip8Quirks quirks;
+    if (!(words >> profile) || !Chip8::parse_quirks(profile, quirks)) {
+      std::cerr << quirks_file << ':' << number << ": unknown quirk profile "
+                << profile << '\n';
+      return kDefaultQuirks;
+    }
+    return quirks;
+  }
+  return kDefaultQuirks;
+}
+
+bool RomLibrary::add_directory(const std::string& directory) {
+  namespace fs = std::filesystem;
+
+  std::error_code error;
+  std::vector<std::string> files;
+  for (const fs::directory_entry& entry :
+       fs::directory_iterator(directory, error)) {
+    const std::string extension = entry.path().extension().string();
+    if (entry.is_regular_file(error) &&
+        (extension == ".ch8" || extension == ".c8")) {
+      files.push_back(entry.path().string());
+    }
+  }
+  if (error) {
+    std::cerr << "Unable to read directory: " << directory << '\n';
+    return false;
+  }
+
+  std::sort(files.begin(), files.end());
+  for (const std::string& file : files) {
+    this->add_file(file);
+  }
+  return true;
+}
+
+const RomEntry* RomLibrary::add_file(const std::string& filename) {
+  RomFile rom;
+  if (!rom.open(filename)) {
+    return nullptr;
+  }
+
+  const size_t slash = filename.find_last_of("/\\");
+  RomEntry entry = {
+      filename.substr(slash == std::string::npos ? 0 : slash + 1),
+      get_hash(rom.get_data(), rom.get_size()), 0, rom.get_size(),
+      find_quirks(filename)};
+
+  // The hash only finds a candidate, the content decides (two programs
+  // with the same hash are both stored, find returns the first one)
+  const auto existing = this->entry_of_hash.find(entry.hash);
+  const RomEntry* first =
+      existing != this->entry_of_hash.end() ? &this->entries[existing->second]
+                                            : nullptr;
+  if (first != nullptr && first->size == entry.size &&
+      std::memcmp(this->get_data(*first), rom.get_data(), entry.size) ==
+          0) {
+    if (first->name == entry.name) {
+      return first;
+    }
+    // Same content under another name
+    entry.offset = first->offset;
+  } else {
+    entry.offset = this->arena.size();
+    this->arena.insert(this->arena.end(), rom.get_data(),
+                       rom.get_data() + rom.get_size());
+    if (first == nullptr) {
+      this->entry_of_hash.emplace(entry.hash, this->entries.size());
+    }
+  }
+
+  this->entries.push_back(entry);
+  return &this->entries.back();
+}
+
+const RomEntry* RomLibrary::find(u64 hash) {
+  const auto entry = this->entry_of_hash.find(hash);
+  return entry == this->entry_of_hash.end() ? nullptr
+                                            : &this->entries[entry->second];
+}
+
+const RomEntry* RomLibrary::find_name(const std::string& name) {
+  for (const RomEntry& entry : this->entries) {
+    if (entry.name == name) {
+      return &entry;
+    }
+  }
+  return nullptr;
+}
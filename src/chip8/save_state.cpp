@@ -0,0 +1,66 @@
+#include "chip8/save_state.h"
+
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+static const char MAGIC[4] = {'C', '8', 'S', 'S'};
+
+bool SaveState::write(const std::string& path, const Chip8State& state) {
+  SaveStateHeader header = {};
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.state_size = sizeof(Chip8State);
+  header.checksum = get_checksum(state);
+
+  std::ofstream file(path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(&state), sizeof(state));
+  return static_cast<bool>(file);
+}
+
+bool SaveState::read(const std::string& path, Chip8State& state) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+
+  SaveStateHeader header;
+  if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+      std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      header.version != VERSION || header.state_size != sizeof(Chip8State)) {
+    return false;
+  }
+
+  // Read into a copy, so state stays untouched if the file is corrupt
+  Chip8State loaded;
+  if (!file.read(reinterpret_cast<char*>(&loaded), sizeof(loaded)) ||
+      get_checksum(loaded) != header.checksum || !is_valid(loaded)) {
+    return false;
+  }
+
+  state = loaded;
+  return true;
+}
+
+bool SaveState::is_valid(const Chip8State& state) {
+  // The fault is an enum, copy its bytes instead of loading it
+  std::underlying_type<Chip8Fault>::type fault;
+  std::memcpy(&fault, &state.fault, sizeof(fault));
+  return state.stack_pointer <= state.stack.size() &&
+         static_cast<u32>(fault) <= kStackUnderflow &&
+         state.display.is_valid();
+}
+
+u64 SaveState::get_checksum(const Chip8State& state) {
+  // 64-bit FNV-1a over the bytes of the state (as written to the file)
+  const u8* bytes = reinterpret_cast<const u8*>(&state);
+  u64 hash = 0xCBF29CE484222325ull;
+  for (size_t i = 0; i < sizeof(state); i++) {
+    hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+  }
+  return hash;
+}
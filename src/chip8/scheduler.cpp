@@ -0,0 +1,188 @@
+#include "chip8/scheduler.h"
+
+#include <thread>
+
+Scheduler::Scheduler(Chip8& chip8, u32 instructions_per_second)
+    : chip8(chip8),
+      mode(kRealTimeMode),
+      pending_steps(0),
+      rewind(nullptr),
+      rewinding(false),
+      idle_waiting(false),
+      woken(false),
+      frame_period(std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double>(1.0 / FRAMES_PER_SECOND))),
+      overshoot_samples(0),
+      total_overshoot_ms(0) {
+  this->chip8.set_timer_mode(kFrameTimers);
+  this->set_instructions_per_second(instructions_per_second);
+  this->set_mode(kRealTimeMode);
+}
+
+void Scheduler::set_instructions_per_second(u32 instructions_per_second) {
+  this->instructions_per_frame = instructions_per_second / FRAMES_PER_SECOND;
+  if (this->instructions_per_frame == 0) {
+    this->instructions_per_frame = 1;
+  }
+}
+
+void Scheduler::set_mode(SchedulerMode mode) {
+  this->mode = mode;
+  this->pending_steps = 0;
+  this->epoch = Clock::now();
+  this->scheduled_frames = 0;
+  this->emulated_frames = 0;
+}
+
+u32 Scheduler::run_frames() {
+  u32 frames = 0;
+
+  switch (this->mode) {
+    case kRealTimeMode: {
+      // Frames whose start time has passed (the first one starts at epoch)
+      const u64 due = (Clock::now() - this->epoch) / this->frame_period + 1;
+      if (due <= this->scheduled_frames) {
+        break;
+      }
+      u64 behind = due - this->scheduled_frames;
+      if (behind > MAXIMUM_CATCH_UP) {
+        this->statistics.skipped_frames += behind - MAXIMUM_CATCH_UP;
+        this->scheduled_frames += behind - MAXIMUM_CATCH_UP;
+        behind = MAXIMUM_CATCH_UP;
+      }
+      for (; frames < behind; frames++) {
+        this->scheduled_frames++;
+        if (!this->run_frame()) {
+          break;
+        }
+      }
+      break;
+    }
+    case kTurboMode: {
+      const Clock::time_point end = Clock::now() + this->frame_period;
+      do {
+        frames++;
+        if (!this->run_frame()) {
+          break;
+        }
+      } while (Clock::now() < end);
+      break;
+    }
+    case kFrameStepMode:
+      for (; this->pending_steps > 0; this->pending_steps--) {
+        frames++;
+        if (!this->run_frame()) {
+          this->pending_steps = 0;
+          break;
+        }
+      }
+      break;
+  }
+
+  return frames;
+}
+
+bool Scheduler::run_frame() {
+  if (this->rewinding) {
+    Chip8State state;
+    if (!this->rewind->step_back(state)) {
+      return false;
+    }
+    this->chip8.restore(state);
+    this->emulated_frames++;
+    return true;
+  }
+
+  const u32 executed = this->chip8.run_frame(this->instructions_per_frame);
+  this->statistics.instructions += executed;
+  this->statistics.frames++;
+  this->emulated_frames++;
+  if (this->rewind != nullptr) {
+    this->rewind->push(this->chip8.get_state());
+  }
+  return this->chip8.get_fault() == kNoFault;
+}
+
+void Scheduler::wait_for_next_frame() {
+  if (this->mode == kTurboMode) {
+    return;
+  }
+  if (this->mode == kRealTimeMode && this->idle_waiting &&
+      !this->rewinding && this->chip8.is_waiting_for_input()) {
+    this->wait_for_input();
+    return;
+  }
+
+  // Frame step mode keeps polling the input at the frame rate
+  const Clock::time_point deadline =
+      this->mode == kRealTimeMode
+          ? this->epoch + this->frame_period *
+                              static_cast<Clock::rep>(this->scheduled_frames)
+          : Clock::now() + this->frame_period;
+  std::this_thread::sleep_until(deadline);
+
+  if (this->mode == kRealTimeMode) {
+    const double overshoot_ms =
+        std::chrono::duration<double, std::milli>(Clock::now() - deadline)
+            .count();
+    if (overshoot_ms > 0) {
+      this->total_overshoot_ms += overshoot_ms;
+      this->overshoot_samples++;
+      if (overshoot_ms > this->statistics.maximum_overshoot_ms) {
+        this->statistics.maximum_overshoot_ms = overshoot_ms;
+      }
+    }
+  }
+}
+
+void Scheduler::wake() {
+  {
+    std::lock_guard<std::mutex> lock(this->wake_mutex);
+    this->woken = true;
+  }
+  this->wake_condition.notify_one();
+}
+
+void Scheduler::wait_for_input() {
+  const Clock::time_point start = Clock::now();
+  {
+    std::unique_lock<std::mutex> lock(this->wake_mutex);
+    this->wake_condition.wait_until(
+        lock, start + std::chrono::milliseconds(MAXIMUM_IDLE_WAIT_MS),
+        [this] { return this->woken; });
+    this->woken = false;
+  }
+  const Clock::time_point end = Clock::now();
+  this->statistics.idle_ms +=
+      std::chrono::duration<double, std::milli>(end - start).count();
+
+  // The frames that passed only repeat the wait (they are skipped by the
+  // Chip8, so there is no catch up limit) and see none of the input that
+  // ended it, like the frames run before a key event without the wait
+  const u64 due = (end - this->epoch) / this->frame_period + 1;
+  while (this->scheduled_frames < due) {
+    this->scheduled_frames++;
+    if (!this->run_frame()) {
+      break;
+    }
+  }
+}
+
+const SchedulerStatistics& Scheduler::get_statistics() {
+  this->statistics.average_overshoot_ms =
+      this->overshoot_samples > 0
+          ? this->total_overshoot_ms / this->overshoot_samples
+          : 0;
+
+  // Emulated time only advances with the frames actually run
+  const double wall_ms =
+      std::chrono::duration<double, std::milli>(Clock::now() - this->epoch)
+          .count();
+  const double emulated_ms =
+      std::chrono::duration<double, std::milli>(this->frame_period).count() *
+      this->emulated_frames;
+  this->statistics.drift_ms =
+      this->mode == kFrameStepMode ? 0 : wall_ms - emulated_ms;
+
+  return this->statistics;
+}
@@ -0,0 +1,120 @@
+#include "chip8/thread_pool.h"
+
+ThreadPool::ThreadPool(u32 threads)
+    : task(nullptr),
+      generation(0),
+      stopping(false),
+      active(0),
+      remaining(0) {
+  if (threads == 0) {
+    threads = std::thread::hardware_concurrency();
+  }
+  if (threads == 0) {
+    threads = 1;
+  }
+
+  for (u32 i = 0; i < threads; i++) {
+    this->workers.emplace_back(new Worker());
+  }
+  for (u32 i = 0; i < threads; i++) {
+    this->threads.emplace_back(&ThreadPool::work, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stopping = true;
+  }
+  this->work_available.notify_all();
+
+  for (std::thread& thread : this->threads) {
+    thread.join();
+  }
+}
+
+void ThreadPool::parallel_for(u32 count,
+                              const std::function<void(u32)>& task) {
+  if (count == 0) {
+    return;
+  }
+
+  // The workers still in the previous generation only take tasks of it,
+  // so the tasks can be queued before the generation is published
+  const u64 generation = this->generation + 1;
+  this->remaining = count;
+  for (u32 i = 0; i < count; i++) {
+    Worker& worker = *this->workers[i % this->workers.size()];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.tasks.push_back({generation, i});
+  }
+
+  std::unique_lock<std::mutex> lock(this->mutex);
+  this->task = &task;
+  this->generation = generation;
+  this->work_available.notify_all();
+  this->work_done.wait(
+      lock, [this] { return this->remaining == 0 && this->active == 0; });
+  this->task = nullptr;
+}
+
+void ThreadPool::work(u32 worker) {
+  u64 seen_generation = 0;
+
+  for (;;) {
+    const std::function<void(u32)>* task;
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      this->work_available.wait(lock, [&] {
+        return this->stopping || this->generation != seen_generation;
+      });
+      if (this->stopping) {
+        return;
+      }
+      seen_generation = this->generation;
+      task = this->task;
+      this->active++;
+    }
+
+    u32 index;
+    while (this->take_task(worker, seen_generation, index)) {
+      (*task)(index);
+      this->remaining--;
+    }
+
+    // parallel_for returns (and resets the task) once the tasks are done
+    // and no worker uses the task any more
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->active--;
+    if (this->remaining == 0 && this->active == 0) {
+      this->work_done.notify_all();
+    }
+  }
+}
+
+bool ThreadPool::take_task(u32 worker, u64 generation, u32& index) {
+  // Own queue first (newest task, still warm in the cache)
+  {
+    Worker& own = *this->workers[worker];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty() && own.tasks.back().generation == generation) {
+      index = own.tasks.back().index;
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+
+  // Then steal the oldest task of another worker
+  for (u32 i = 1; i < this->workers.size(); i++) {
+    Worker& victim = *this->workers[(worker + i) % this->workers.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty() &&
+        victim.tasks.front().generation == generation) {
+      index = victim.tasks.front().index;
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+
+  return false;
+}
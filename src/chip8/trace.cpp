@@ -0,0 +1,147 @@
+#include "chip8/trace.h"
+
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "chip8/disassembler.h"
+
+static const char MAGIC[4] = {'C', '8', 'T', 'R'};
+
+// Column of the changed registers in the text form
+static const size_t CHANGES_COLUMN = 40;
+
+static volatile std::sig_atomic_t dump_requested = 0;
+
+static void request_dump(int) { dump_requested = 1; }
+
+// The registers after the newest entry
+static TraceEntry get_current_entry(const Chip8State& state) {
+  TraceEntry entry;
+  entry.program_counter = state.program_counter;
+  entry.opcode = state.current_opcode;
+  entry.index_register = state.index_register;
+  entry.stack_pointer = state.stack_pointer;
+  entry.delay_timer = state.delay_timer;
+  entry.registers = state.general_purpose_variable_registers;
+  return entry;
+}
+
+// The registers shown in the text form are the same
+static bool is_unchanged(const TraceEntry& entry, const TraceEntry& after) {
+  return entry.registers == after.registers &&
+         entry.index_register == after.index_register &&
+         entry.stack_pointer == after.stack_pointer &&
+         entry.delay_timer == after.delay_timer;
+}
+
+u32 ExecutionTrace::copy_entries(TraceEntry* entries) {
+  const u64 end = this->written.load(std::memory_order_acquire);
+  const u64 begin = end > CAPACITY ? end - CAPACITY : 0;
+  for (u64 i = begin; i < end; i++) {
+    entries[i - begin] = this->entries[i & (CAPACITY - 1)];
+  }
+
+  // The writer may have overwritten the oldest entries in the meantime (and
+  // may be writing the next one right now)
+  std::atomic_thread_fence(std::memory_order_acquire);
+  const u64 now = this->written.load(std::memory_order_relaxed);
+  const u64 valid = now + 1 > CAPACITY ? now + 1 - CAPACITY : 0;
+  if (valid <= begin) {
+    return end - begin;
+  }
+  if (valid >= end) {
+    return 0;
+  }
+  std::memmove(entries, entries + (valid - begin),
+               (end - valid) * sizeof(TraceEntry));
+  return end - valid;
+}
+
+void ExecutionTrace::write_text(BufferedWriter& out, const Chip8State& state) {
+  std::vector<TraceEntry> entries(CAPACITY);
+  const u32 count = this->copy_entries(entries.data());
+  const TraceEntry current = get_current_entry(state);
+
+  out << "Last " << u64(count) << " instructions (oldest first)";
+  if (state.fault != kNoFault) {
+    out << ", halted by " << Chip8::get_fault_name(state.fault);
+  }
+  out << ":\n";
+
+  Disassembler disassembler;
+  for (u32 i = 0; i < count; i++) {
+    const TraceEntry& entry = entries[i];
+    const TraceEntry& after = i + 1 < count ? entries[i + 1] : current;
+
+    out << "  0x";
+    out.write_hex(entry.program_counter, 3);
+    out << "  ";
+    out.write_hex(entry.opcode, 4);
+    out << "  ";
+    disassembler.write_instruction(out, entry.opcode);
+
+    // What the instruction changed
+    const bool faulted = i + 1 == count && state.fault != kNoFault;
+    if (faulted || !is_unchanged(entry, after)) {
+      out.pad_to(CHANGES_COLUMN);
+    }
+    for (u8 r = 0; r < 16; r++) {
+      if (after.registers[r] != entry.registers[r]) {
+        out << " V";
+        out.write_hex(r, 1);
+        out << '=';
+        out.write_hex(after.registers[r], 2);
+      }
+    }
+    if (after.index_register != entry.index_register) {
+      out << " I=";
+      out.write_hex(after.index_register, 3);
+    }
+    if (after.stack_pointer != entry.stack_pointer) {
+      out << " SP=" << u64(after.stack_pointer);
+    }
+    if (after.delay_timer != entry.delay_timer) {
+      out << " DT=";
+      out.write_hex(after.delay_timer, 2);
+    }
+    if (faulted) {
+      out << " <- " << Chip8::get_fault_name(state.fault);
+    }
+    out << '\n';
+  }
+}
+
+bool ExecutionTrace::write_binary(const std::string& filename,
+                                  const Chip8State& state) {
+  std::vector<TraceEntry> entries(CAPACITY);
+  TraceHeader header = {};
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.entry_count = this->copy_entries(entries.data());
+  header.fault = state.fault;
+  header.cycles = state.cycles;
+  header.current = get_current_entry(state);
+
+  std::ofstream file(filename, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(entries.data()),
+             header.entry_count * sizeof(TraceEntry));
+  return static_cast<bool>(file);
+}
+
+bool ExecutionTrace::request_dump_on_signal(int signal) {
+  return std::signal(signal, request_dump) != SIG_ERR;
+}
+
+bool ExecutionTrace::take_dump_request() {
+  if (dump_requested == 0) {
+    return false;
+  }
+  dump_requested = 0;
+  return true;
+}
@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "chip8/arguments.h"
+#include "chip8/buffered_writer.h"
+#include "chip8/disassembler.h"
+#include "chip8/thread_pool.h"
+
+namespace fs = std::filesystem;
+
+static void print_usage(const char* program_name) {
+  std::cout << "Usage: " << program_name
+            << " [options] chip8application|directory...\n\n"
+            << "  -o DIR        write NAME.asm and the control flow graph of "
+               "every program\n"
+            << "                into DIR (default: the listings to stdout)\n"
+            << "  --graph G     format of the graph: dot (default) or json\n"
+            << "  --threads N   worker threads for -o (default: all)\n";
+}
+
+// Programs of a directory (*.ch8 and *.c8, sorted) or the file itself
+static bool add_programs(const std::string& path,
+                         std::vector<std::string>& programs) {
+  std::error_code error;
+  if (!fs::is_directory(path, error)) {
+    programs.push_back(path);
+    return true;
+  }
+
+  std::vector<std::string> found;
+  for (const fs::directory_entry& entry :
+       fs::directory_iterator(path, error)) {
+    const std::string extension = entry.path().extension().string();
+    if (entry.is_regular_file(error) &&
+        (extension == ".ch8" || extension == ".c8")) {
+      found.push_back(entry.path().string());
+    }
+  }
+  if (error) {
+    std::cerr << "Unable to read directory: " << path << '\n';
+    return false;
+  }
+
+  std::sort(found.begin(), found.end());
+  programs.insert(programs.end(), found.begin(), found.end());
+  return true;
+}
+
+static bool write_file(const fs::path& path, Disassembler& disassembler,
+                       bool graph, DisassemblerGraphFormat format) {
+  std::FILE* file = std::fopen(path.string().c_str(), "wb");
+  if (file == nullptr) {
+    std::cerr << "Unable to write: " << path.string() << '\n';
+    return false;
+  }
+
+  bool written;
+  {
+    BufferedWriter out(file);
+    if (graph) {
+      disassembler.write_graph(out, format);
+    } else {
+      disassembler.write_listing(out);
+    }
+    written = out.flush();
+  }
+  written &= std::fclose(file) == 0;
+  if (!written) {
+    std::cerr << "Unable to write: " << path.string() << '\n';
+  }
+  return written;
+}
+
+int main(int argc, char** argv) {
+  std::string output_directory;
+  DisassemblerGraphFormat format = kDotGraph;
+  u32 threads = 0;
+  std::vector<std::string> programs;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string argument = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (argument == "-o" && has_value) {
+      output_directory = argv[++i];
+    } else if (argument == "--graph" && has_value) {
+      const std::string graph = argv[++i];
+      if (graph != "dot" && graph != "json") {
+        std::cerr << "Unknown graph format: " << graph << '\n';
+        return 1;
+      }
+      format = graph == "dot" ? kDotGraph : kJsonGraph;
+    } else if (argument == "--threads" && has_value) {
+      if (!parse_option(argument, argv[++i], threads, 1)) {
+        print_usage(argv[0]);
+        return 1;
+      }
+    } else if (argument[0] != '-') {
+      if (!add_programs(argument, programs)) {
+        return 1;
+      }
+    } else {
+      std::cerr << "Unknown argument: " << argument << '\n';
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (programs.empty()) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  // Without an output directory the listings go to stdout one by one
+  if (output_directory.empty()) {
+    bool succeeded = true;
+    BufferedWriter out(stdout);
+    for (const std::string& program : programs) {
+      Disassembler disassembler;
+      if (!disassembler.load_program(program)) {
+        succeeded = false;
+        continue;
+      }
+      disassembler.analyze();
+      disassembler.write_listing(out);
+    }
+    return out.flush() && succeeded ? 0 : 1;
+  }
+
+  std::error_code error;
+  fs::create_directories(output_directory, error);
+  if (error) {
+    std::cerr << "Unable to create directory: " << output_directory << '\n';
+    return 1;
+  }
+
+  // Every program is disassembled and written by one task
+  std::vector<std::string> summaries(programs.size());
+  std::vector<char> succeeded(programs.size(), false);
+  const char* const graph_extension = format == kDotGraph ? ".dot" : ".json";
+
+  ThreadPool pool(threads);
+  const auto start = std::chrono::steady_clock::now();
+  pool.parallel_for(programs.size(), [&](u32 i) {
+    Disassembler disassembler;
+    if (!disassembler.load_program(programs[i])) {
+      return;
+    }
+    disassembler.analyze();
+
+    const std::string name = fs::path(programs[i]).stem().string();
+    const fs::path listing = fs::path(output_directory) / (name + ".asm");
+    const fs::path graph =
+        fs::path(output_directory) / (name + graph_extension);
+    if (!write_file(listing, disassembler, false, format) ||
+        !write_file(graph, disassembler, true, format)) {
+      return;
+    }
+
+    summaries[i] = programs[i] + ": " +
+                   std::to_string(disassembler.get_instruction_count()) +
+                   " instructions, " +
+                   std::to_string(disassembler.get_block_count()) +
+                   " blocks, " +
+                   std::to_string(disassembler.get_byte_count(kSpriteByte)) +
+                   " sprite bytes -> " + listing.string();
+    succeeded[i] = true;
+  });
+  const auto end = std::chrono::steady_clock::now();
+
+  u32 failed = 0;
+  for (size_t i = 0; i < programs.size(); i++) {
+    if (succeeded[i]) {
+      std::cout << summaries[i] << '\n';
+    } else {
+      failed++;
+    }
+  }
+  std::cout << programs.size() - failed << " programs in "
+            << std::chrono::duration<double, std::milli>(end - start).count()
+            << " ms on " << pool.get_thread_count() << " threads\n";
+
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,16 @@
+#include "headless/runner.h"
+
+int main(int argc, char** argv) {
+  HeadlessOptions options;
+  if (!HeadlessRunner::parse_arguments(argc, argv, options)) {
+    HeadlessRunner::print_usage(argv[0]);
+    return 1;
+  }
+
+  HeadlessRunner runner(options);
+  if (!runner.load_program()) {
+    return 1;
+  }
+
+  return runner.run();
+}
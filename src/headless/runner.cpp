@@ -0,0 +1,749 @@
+#include "headless/runner.h"
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include "chip8/aot.h"
+#include "chip8/arguments.h"
+#include "chip8/batch.h"
+#include "chip8/lockstep.h"
+#include "chip8/movie.h"
+#include "chip8/rom.h"
+#include "chip8/save_state.h"
+#include "chip8/scheduler.h"
+
+HeadlessRunner::HeadlessRunner(HeadlessOptions const& options)
+    : options(options), audio(AudioSettings()) {
+  this->chip8.set_engine(options.engine);
+  this->chip8.set_idle_skipping(options.idle_skipping);
+  this->chip8.set_random_seed(options.seed);
+  if (!options.profile_prefix.empty()) {
+    this->chip8.set_profiler(&this->profiler);
+  }
+  if (!options.trace_file.empty()) {
+    this->chip8.set_trace(&this->trace);
+  }
+  if (options.audio) {
+    this->chip8.set_audio(&this->audio);
+  }
+}
+
+bool HeadlessRunner::parse_arguments(int argc, char** argv,
+                                     HeadlessOptions& options) {
+  for (int i = 1; i < argc; i++) {
+    const std::string argument = argv[i];
+    const bool has_value = i + 1 < argc;
+
+    if (argument == "--cycles" && has_value) {
+      if (!parse_option(argument, argv[++i], options.cycles, 1)) {
+        return false;
+      }
+    } else if (argument == "--frames" && has_value) {
+      if (!parse_option(argument, argv[++i], options.frames, 1)) {
+        return false;
+      }
+    } else if (argument == "--cycles-per-frame" && has_value) {
+      if (!parse_option(argument, argv[++i], options.cycles_per_frame, 1)) {
+        return false;
+      }
+    } else if (argument == "--ips" && has_value) {
+      u32 instructions_per_second;
+      if (!parse_option(argument, argv[++i], instructions_per_second, 1)) {
+        return false;
+      }
+      options.cycles_per_frame =
+          instructions_per_second >= Scheduler::FRAMES_PER_SECOND
+              ? instructions_per_second / Scheduler::FRAMES_PER_SECOND
+              : 1;
+    } else if (argument == "--seed" && has_value) {
+      if (!parse_option(argument, argv[++i], options.seed, 0,
+                        std::numeric_limits<u64>::max(), 0)) {
+        return false;
+      }
+    } else if (argument == "--instruction-timers") {
+      options.instruction_timers = true;
+    } else if (argument == "--realtime") {
+      options.realtime = true;
+    } else if (argument == "--engine" && has_value) {
+      const std::string engine = argv[++i];
+      if (engine == "interpreter") {
+        options.engine = kInterpreterEngine;
+      } else if (engine == "blocks") {
+        options.engine = kBlockCacheEngine;
+      } else if (engine == "jit") {
+        options.engine = kJitEngine;
+      } else if (engine == "aot") {
+        options.engine = kAotEngine;
+      } else {
+        std::cerr << "Unknown engine: " << engine << '\n';
+        return false;
+      }
+    } else if (argument == "--no-idle-skip") {
+      options.idle_skipping = false;
+    } else if (argument == "--quirks" && has_value) {
+      const std::string quirks = argv[++i];
+      options.automatic_quirks = quirks == "auto";
+      if (!options.automatic_quirks &&
+          !Chip8::parse_quirks(quirks, options.quirks)) {
+        std::cerr << "Unknown quirk profile: " << quirks << '\n';
+        return false;
+      }
+    } else if (argument == "--batch" && has_value) {
+      if (!parse_option(argument, argv[++i], options.batch, 1)) {
+        return false;
+      }
+    } else if (argument == "--threads" && has_value) {
+      if (!parse_option(argument, argv[++i], options.threads, 1)) {
+        return false;
+      }
+    } else if (argument == "--scaling") {
+      options.scaling = true;
+    } else if (argument == "--lockstep") {
+      options.lockstep = true;
+    } else if (argument == "--load-state" && has_value) {
+      options.load_state_file = argv[++i];
+    } else if (argument == "--save-state" && has_value) {
+      options.save_state_file = argv[++i];
+    } else if (argument == "--replay" && has_value) {
+      options.replay_file = argv[++i];
+    } else if (argument == "--record" && has_value) {
+      options.record_file = argv[++i];
+    } else if (argument == "--dump-framebuffer" && has_value) {
+      options.framebuffer_file = argv[++i];
+    } else if (argument == "--hash") {
+      options.print_state_hash = true;
+    } else if (argument == "--rewind") {
+      options.rewind = true;
+    } else if (argument == "--profile" && has_value) {
+      options.profile_prefix = argv[++i];
+    } else if (argument == "--trace" && has_value) {
+      options.trace_file = argv[++i];
+    } else if (argument == "--audio") {
+      options.audio = true;
+    } else if (argument[0] != '-' && options.program_file.empty()) {
+      options.program_file = argument;
+    } else {
+      std::cerr << "Unknown argument: " << argument << '\n';
+      return false;
+    }
+  }
+
+  if (options.batch > 0 && options.cycles > 0) {
+    std::cerr << "--batch runs frames, use --frames instead of --cycles\n";
+    return false;
+  }
+  if (options.realtime && (options.cycles > 0 || options.batch > 0)) {
+    std::cerr << "--realtime runs frames of a single instance\n";
+    return false;
+  }
+  if (options.batch > 0 && (!options.load_state_file.empty() ||
+                            !options.save_state_file.empty())) {
+    std::cerr << "--load-state and --save-state need a single instance\n";
+    return false;
+  }
+  if (!options.replay_file.empty() &&
+      (options.batch > 0 || options.realtime || options.rewind ||
+       !options.load_state_file.empty() || !options.record_file.empty())) {
+    std::cerr << "--replay runs a movie from the reset state of a single "
+                 "instance\n";
+    return false;
+  }
+  if (!options.record_file.empty() &&
+      (options.frames == 0 || options.instruction_timers ||
+       options.batch > 0 || options.realtime ||
+       !options.load_state_file.empty())) {
+    std::cerr << "--record records the --frames of a single instance from "
+                 "its reset state\n";
+    return false;
+  }
+  if (options.rewind &&
+      (options.frames == 0 || options.batch > 0 || options.realtime)) {
+    std::cerr << "--rewind records the --frames of a single instance\n";
+    return false;
+  }
+  if (!options.profile_prefix.empty()) {
+#ifndef CHIP8_PROFILER
+    std::cerr << "--profile needs a build with -DCHIP8_PROFILER=ON\n";
+    return false;
+#endif
+    if (options.batch > 0 || options.engine != kInterpreterEngine) {
+      std::cerr << "--profile counts the instructions of a single instance "
+                   "on the interpreter\n";
+      return false;
+    }
+  }
+  if (!options.trace_file.empty() && options.batch > 0) {
+    std::cerr << "--trace records the instructions of a single instance\n";
+    return false;
+  }
+  if (options.audio &&
+      (options.frames == 0 || options.instruction_timers ||
+       options.batch > 0 || !options.replay_file.empty())) {
+    std::cerr << "--audio generates the sound of the --frames of a single "
+                 "instance\n";
+    return false;
+  }
+  if (options.batch > 0 && options.frames == 0) {
+    options.frames = 1000;
+  }
+  if (options.realtime && options.frames == 0) {
+    options.frames = 600;
+  }
+  if (options.cycles == 0 && options.frames == 0) {
+    options.cycles = 10000000;
+  }
+
+  return !options.program_file.empty() && options.cycles_per_frame > 0;
+}
+
+void HeadlessRunner::print_usage(const char* program_name) {
+  std::cout << "Usage: " << program_name << " [options] chip8application\n\n"
+            << "  --cycles N            run N instructions (default 10000000)\n"
+            << "  --frames N            run N frames instead\n"
+            << "  --cycles-per-frame N  instructions per frame (default 10)\n"
+            << "  --ips N               instructions per second (N / 60 per frame)\n"
+            << "  --instruction-timers  tick the timers per instruction, not frame\n"
+            << "  --realtime            run --frames at 60 frames per second\n"
+            << "  --engine E            interpreter (default), blocks, jit or aot\n"
+            << "  --no-idle-skip        execute idle loops instead of skipping them\n"
+            << "  --quirks Q            auto (default: quirks.txt), default, vip,\n"
+            << "                        chip48 or schip\n"
+            << "  --seed N              seed of the random numbers (Cxnn)\n"
+            << "  --batch N             run N instances in parallel (frames only)\n"
+            << "  --threads N           worker threads for --batch (default: all)\n"
+            << "  --scaling             repeat --batch with 1, 2, 4, ... threads\n"
+            << "  --lockstep            run --batch in lockstep on SIMD lanes\n"
+            << "  --load-state F        start from the save state F\n"
+            << "  --save-state F        write the final state to F\n"
+            << "  --record F            write the --frames run as movie F\n"
+            << "  --replay F            replay the movie F, check the state hash\n"
+            << "  --dump-framebuffer F  write the final display to F (PBM)\n"
+            << "  --hash                print the final state hash\n"
+            << "  --rewind              record the frames, report the history\n"
+            << "  --profile PREFIX      write PREFIX.json and PREFIX.folded\n"
+            << "  --trace F             write the last instructions to F on a\n"
+            << "                        fault or SIGUSR1 (runs interpreted)\n"
+            << "  --audio               generate the sound, report its samples\n";
+}
+
+bool HeadlessRunner::load_program() {
+  // The program stays mapped for the batch and lockstep runs
+  if (!this->rom.open(this->options.program_file) ||
+      !this->chip8.save_rom(this->rom.get_data(), this->rom.get_size())) {
+    return false;
+  }
+
+  if (this->options.automatic_quirks) {
+    this->options.quirks = RomLibrary::find_quirks(this->options.program_file);
+  }
+  if (this->options.quirks != kDefaultQuirks) {
+    if (this->options.lockstep) {
+      std::cerr << "--lockstep only runs the default quirks, not "
+                << Chip8::get_quirks_name(this->options.quirks) << '\n';
+      return false;
+    }
+    std::cout << "quirks:       "
+              << Chip8::get_quirks_name(this->options.quirks) << '\n';
+  }
+  this->chip8.set_quirks(this->options.quirks);
+
+  if (this->options.engine == kAotEngine &&
+      AotEngine::find_program(this->rom.get_data(), this->rom.get_size()) ==
+          nullptr) {
+    std::cerr << "No recompiled code for " << this->options.program_file
+              << ", using the interpreter\n";
+  }
+
+  if (!this->options.load_state_file.empty()) {
+    Chip8State state;
+    if (!SaveState::read(this->options.load_state_file, state)) {
+      std::cerr << "Unable to load save state: "
+                << this->options.load_state_file << '\n';
+      return false;
+    }
+    this->chip8.restore(state);
+  }
+
+  return true;
+}
+
+int HeadlessRunner::run() {
+  if (this->options.batch > 0) {
+    return this->options.lockstep ? this->run_lockstep() : this->run_batch();
+  }
+
+#ifdef SIGUSR1
+  if (!this->options.trace_file.empty()) {
+    ExecutionTrace::request_dump_on_signal(SIGUSR1);
+  }
+#endif
+
+  int exit_code;
+  if (this->options.realtime) {
+    exit_code = this->run_realtime();
+  } else if (!this->options.replay_file.empty()) {
+    exit_code = this->run_replay();
+  } else {
+    exit_code = this->run_single();
+  }
+
+  if (!this->options.profile_prefix.empty() && !this->write_profile()) {
+    exit_code = 1;
+  }
+  if (!this->options.trace_file.empty() &&
+      this->chip8.get_fault() != kNoFault && !this->write_trace()) {
+    exit_code = 1;
+  }
+  return exit_code;
+}
+
+int HeadlessRunner::run_single() {
+  // Runs of --cycles have no frames, so their timers tick per instruction
+  const bool frame_timers =
+      this->options.frames > 0 && !this->options.instruction_timers;
+  this->chip8.set_timer_mode(frame_timers ? kFrameTimers : kInstructionTimers);
+
+  const u64 budget = this->options.cycles > 0
+                         ? this->options.cycles
+                         : this->options.frames * this->options.cycles_per_frame;
+  const u32 chunk = this->options.cycles > 0 ? 1 << 20
+                                             : this->options.cycles_per_frame;
+  u64 executed = 0;
+  int exit_code = 0;
+  RewindBuffer rewind;
+  Movie movie;
+  movie.start(
+      RomLibrary::get_hash(this->rom.get_data(), this->rom.get_size()),
+      this->options.seed, this->options.cycles_per_frame,
+      this->chip8.get_quirks());
+
+  const auto start = std::chrono::steady_clock::now();
+  while (executed < budget) {
+    const u64 remaining = budget - executed;
+    const u32 cycles = remaining < chunk ? remaining : chunk;
+    const u32 done = frame_timers ? this->chip8.run_frame(cycles)
+                                  : this->chip8.run(cycles);
+    executed += done;
+    if (this->options.audio) {
+      this->audio_sink.drain(this->audio.get_ring());
+    }
+    if (this->options.rewind) {
+      rewind.push(this->chip8.get_state());
+    }
+    if (!this->options.trace_file.empty() &&
+        ExecutionTrace::take_dump_request()) {
+      this->write_trace();
+    }
+    if (done < cycles) {
+      break;
+    }
+  }
+  const auto end = std::chrono::steady_clock::now();
+
+  if (this->chip8.get_fault() != kNoFault) {
+    this->report_fault();
+    exit_code = 1;
+  }
+
+  const double seconds = std::chrono::duration<double>(end - start).count();
+  std::cout << "program:      " << this->options.program_file << '\n'
+            << "instructions: " << executed << '\n'
+            << "seconds:      " << seconds << '\n'
+            << "ips:          "
+            << (seconds > 0 ? static_cast<u64>(executed / seconds) : 0)
+            << '\n';
+  if (this->chip8.get_skipped_cycles() > 0) {
+    std::cout << "idle:         " << this->chip8.get_skipped_cycles()
+              << " skipped\n";
+  }
+
+  if (this->options.print_state_hash) {
+    std::cout << "state hash:   " << std::hex << this->chip8.get_state_hash()
+              << std::dec << '\n';
+  }
+
+  if (this->options.rewind) {
+    this->report_rewind(rewind);
+  }
+  if (this->options.audio) {
+    this->report_audio();
+  }
+
+  if (!this->options.record_file.empty()) {
+    movie.finish(this->chip8);
+    if (!movie.write(this->options.record_file)) {
+      std::cerr << "Unable to write movie: " << this->options.record_file
+                << '\n';
+      exit_code = 1;
+    }
+  }
+
+  if (!this->options.framebuffer_file.empty() && !this->dump_framebuffer()) {
+    exit_code = 1;
+  }
+  if (!this->options.save_state_file.empty() &&
+      !SaveState::write(this->options.save_state_file,
+                        this->chip8.get_state())) {
+    std::cerr << "Unable to write save state: "
+              << this->options.save_state_file << '\n';
+    exit_code = 1;
+  }
+
+  return exit_code;
+}
+
+int HeadlessRunner::run_batch() {
+  const u32 maximum_threads = this->options.threads > 0
+                                  ? this->options.threads
+                                  : std::thread::hardware_concurrency();
+  std::vector<u32> thread_counts;
+  if (this->options.scaling) {
+    for (u32 threads = 1; threads < maximum_threads; threads *= 2) {
+      thread_counts.push_back(threads);
+    }
+  }
+  thread_counts.push_back(maximum_threads > 0 ? maximum_threads : 1);
+
+  std::cout << "program:      " << this->options.program_file << '\n'
+            << "instances:    " << this->options.batch << '\n';
+
+  u32 halted = 0;
+  for (u32 threads : thread_counts) {
+    // Fresh instances for every run, so all runs do the same work
+    Chip8Batch batch(this->options.batch, threads);
+    batch.set_engine(this->options.engine);
+    batch.set_quirks(this->options.quirks);
+    batch.set_timer_mode(this->options.instruction_timers ? kInstructionTimers
+                                                          : kFrameTimers);
+    batch.set_random_seed(this->options.seed);
+    batch.load_program(this->rom.get_data(), this->rom.get_size());
+    for (u32 i = 0; i < batch.size(); i++) {
+      batch.set_frame_budget(i, this->options.cycles_per_frame);
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const u64 executed = batch.run_frames(this->options.frames);
+    const auto end = std::chrono::steady_clock::now();
+
+    halted = 0;
+    for (u32 i = 0; i < batch.size(); i++) {
+      halted += batch.is_halted(i);
+    }
+
+    const double seconds = std::chrono::duration<double>(end - start).count();
+    std::cout << "threads:      " << batch.get_thread_count() << '\n'
+              << "instructions: " << executed << '\n'
+              << "seconds:      " << seconds << '\n'
+              << "ips:          "
+              << (seconds > 0 ? static_cast<u64>(executed / seconds) : 0)
+              << '\n';
+
+    if (this->options.print_state_hash && threads == thread_counts.back()) {
+      // The hash of instance 0 (seeded like a single run). The instances
+      // draw from different random streams, they diverged if their states
+      // apart from the generators differ (i.e. the program used Cxnn).
+      const u64 hash = batch[0].get_state_hash();
+      const u64 machine_hash = batch[0].get_state_hash(false);
+      bool diverged = false;
+      for (u32 i = 1; i < batch.size(); i++) {
+        diverged |= batch[i].get_state_hash(false) != machine_hash;
+      }
+      std::cout << "state hash:   " << std::hex << hash << std::dec
+                << (diverged ? " (instances diverged)" : "") << '\n';
+    }
+  }
+
+  if (halted > 0) {
+    std::cerr << "Chip-8 halted: " << halted << " of " << this->options.batch
+              << " instances\n";
+    return 1;
+  }
+
+  return 0;
+}
+
+int HeadlessRunner::run_lockstep() {
+  Chip8Lockstep lockstep(this->options.batch);
+  lockstep.set_timer_mode(this->options.instruction_timers ? kInstructionTimers
+                                                           : kFrameTimers);
+  lockstep.set_random_seed(this->options.seed);
+  lockstep.load_program(this->rom.get_data(), this->rom.get_size());
+
+  const auto start = std::chrono::steady_clock::now();
+  const u64 executed =
+      lockstep.run_frames(this->options.frames, this->options.cycles_per_frame);
+  const auto end = std::chrono::steady_clock::now();
+
+  u32 halted = 0;
+  for (u32 i = 0; i < lockstep.size(); i++) {
+    halted += lockstep.is_halted(i);
+  }
+
+  const double seconds = std::chrono::duration<double>(end - start).count();
+  std::cout << "program:      " << this->options.program_file << '\n'
+            << "instances:    " << this->options.batch << '\n'
+            << "kernel:       " << lockstep.get_kernel_name() << '\n'
+            << "instructions: " << executed << '\n'
+            << "seconds:      " << seconds << '\n'
+            << "ips:          "
+            << (seconds > 0 ? static_cast<u64>(executed / seconds) : 0)
+            << '\n';
+
+  if (this->options.print_state_hash) {
+    // Like run_batch: the hash of lane 0, divergence apart from the
+    // random streams of the lanes
+    const u64 hash = lockstep.get_machine(0).get_state_hash();
+    const u64 machine_hash = lockstep.get_machine(0).get_state_hash(false);
+    bool diverged = false;
+    for (u32 i = 1; i < lockstep.size(); i++) {
+      diverged |=
+          lockstep.get_machine(i).get_state_hash(false) != machine_hash;
+    }
+    std::cout << "state hash:   " << std::hex << hash << std::dec
+              << (diverged ? " (instances diverged)" : "") << '\n';
+  }
+
+  if (halted > 0) {
+    std::cerr << "Chip-8 halted: " << halted << " of " << this->options.batch
+              << " instances\n";
+    return 1;
+  }
+
+  return 0;
+}
+
+int HeadlessRunner::run_realtime() {
+  Scheduler scheduler(this->chip8, this->options.cycles_per_frame *
+                                       Scheduler::FRAMES_PER_SECOND);
+  int exit_code = 0;
+
+  while (scheduler.get_statistics().frames < this->options.frames &&
+         this->chip8.get_fault() == kNoFault) {
+    scheduler.run_frames();
+    if (this->options.audio) {
+      this->audio_sink.drain(this->audio.get_ring());
+    }
+    if (!this->options.trace_file.empty() &&
+        ExecutionTrace::take_dump_request()) {
+      this->write_trace();
+    }
+    scheduler.wait_for_next_frame();
+  }
+
+  if (this->chip8.get_fault() != kNoFault) {
+    this->report_fault();
+    exit_code = 1;
+  }
+
+  const SchedulerStatistics& statistics = scheduler.get_statistics();
+  std::cout << "program:        " << this->options.program_file << '\n'
+            << "frames:         " << statistics.frames << '\n'
+            << "instructions:   " << statistics.instructions << '\n'
+            << "skipped frames: " << statistics.skipped_frames << '\n'
+            << "overshoot:      " << statistics.average_overshoot_ms
+            << " ms average, " << statistics.maximum_overshoot_ms
+            << " ms maximum\n"
+            << "drift:          " << statistics.drift_ms << " ms\n";
+
+  if (this->options.print_state_hash) {
+    std::cout << "state hash:     " << std::hex << this->chip8.get_state_hash()
+              << std::dec << '\n';
+  }
+  if (this->options.audio) {
+    this->report_audio();
+  }
+
+  if (!this->options.framebuffer_file.empty() && !this->dump_framebuffer()) {
+    exit_code = 1;
+  }
+  if (!this->options.save_state_file.empty() &&
+      !SaveState::write(this->options.save_state_file,
+                        this->chip8.get_state())) {
+    std::cerr << "Unable to write save state: "
+              << this->options.save_state_file << '\n';
+    exit_code = 1;
+  }
+
+  return exit_code;
+}
+
+int HeadlessRunner::run_replay() {
+  Movie movie;
+  if (!movie.read(this->options.replay_file)) {
+    std::cerr << "Unable to load movie: " << this->options.replay_file
+              << '\n';
+    return 1;
+  }
+  const MovieHeader& header = movie.get_header();
+  if (header.program_hash !=
+      RomLibrary::get_hash(this->rom.get_data(), this->rom.get_size())) {
+    std::cerr << "The movie " << this->options.replay_file
+              << " was recorded with another program\n";
+    return 1;
+  }
+
+  int exit_code = 0;
+  const auto start = std::chrono::steady_clock::now();
+  const u64 executed = movie.play(this->chip8);
+  const auto end = std::chrono::steady_clock::now();
+
+  // A movie may end in a fault, the state hash tells if it is the same one
+  const u64 state_hash = this->chip8.get_state_hash();
+  const double seconds = std::chrono::duration<double>(end - start).count();
+  std::cout << "program:      " << this->options.program_file << '\n'
+            << "movie:        " << this->options.replay_file << " ("
+            << header.event_count << " key events, "
+            << header.cycles / header.instructions_per_frame << " frames)\n"
+            << "instructions: " << executed << '\n'
+            << "seconds:      " << seconds << '\n'
+            << "ips:          "
+            << (seconds > 0 ? static_cast<u64>(executed / seconds) : 0)
+            << '\n'
+            << "state hash:   " << std::hex << state_hash << std::dec
+            << (state_hash == header.state_hash ? " (matches the movie)"
+                                                : " (differs from the movie)")
+            << '\n';
+  if (state_hash != header.state_hash || executed != header.cycles) {
+    std::cerr << "Replay diverged: recorded state hash " << std::hex
+              << header.state_hash << std::dec << " after " << header.cycles
+              << " instructions\n";
+    exit_code = 1;
+  }
+
+  if (!this->options.framebuffer_file.empty() && !this->dump_framebuffer()) {
+    exit_code = 1;
+  }
+  if (!this->options.save_state_file.empty() &&
+      !SaveState::write(this->options.save_state_file,
+                        this->chip8.get_state())) {
+    std::cerr << "Unable to write save state: "
+              << this->options.save_state_file << '\n';
+    exit_code = 1;
+  }
+
+  return exit_code;
+}
+
+bool HeadlessRunner::dump_framebuffer() {
+  std::ofstream file(this->options.framebuffer_file);
+  if (!file) {
+    std::cerr << "Unable to write framebuffer: "
+              << this->options.framebuffer_file << '\n';
+    return false;
+  }
+
+  // Plain PBM (P1): one character per pixel, 1 = lit in any plane
+  Display& display = this->chip8.get_display();
+  file << "P1\n" << display.get_width() << ' ' << display.get_height() << '\n';
+  for (int y = 0; y < display.get_height(); y++) {
+    for (int x = 0; x < display.get_width(); x++) {
+      file << (display.get_pixel(x, y) ? '1' : '0');
+    }
+    file << '\n';
+  }
+
+  return true;
+}
+
+void HeadlessRunner::report_fault() {
+  std::cerr << "Chip-8 halted: "
+            << Chip8::get_fault_name(this->chip8.get_fault()) << " 0x"
+            << std::hex << this->chip8.get_current_opcode()
+            << " at address 0x" << this->chip8.get_program_counter()
+            << std::dec << '\n';
+}
+
+// Trace as text to stderr and in binary to the --trace file
+bool HeadlessRunner::write_trace() {
+  {
+    BufferedWriter out(stderr);
+    this->trace.write_text(out, this->chip8.get_state());
+    out.flush();
+  }
+
+  if (!this->trace.write_binary(this->options.trace_file,
+                                this->chip8.get_state())) {
+    std::cerr << "Unable to write trace: " << this->options.trace_file
+              << '\n';
+    return false;
+  }
+  std::cerr << "trace:        " << this->options.trace_file << '\n';
+  return true;
+}
+
+// Profile as JSON or as folded stacks
+static bool write_profile_file(const std::string& filename, Profiler& profiler,
+                               bool folded) {
+  std::FILE* file = std::fopen(filename.c_str(), "wb");
+  if (file == nullptr) {
+    std::cerr << "Unable to write profile: " << filename << '\n';
+    return false;
+  }
+
+  bool written;
+  {
+    BufferedWriter out(file);
+    if (folded) {
+      profiler.write_folded(out);
+    } else {
+      profiler.write_json(out);
+    }
+    written = out.flush();
+  }
+  written &= std::fclose(file) == 0;
+  if (!written) {
+    std::cerr << "Unable to write profile: " << filename << '\n';
+  }
+  return written;
+}
+
+bool HeadlessRunner::write_profile() {
+  const std::string& prefix = this->options.profile_prefix;
+  if (!write_profile_file(prefix + ".json", this->profiler, false) ||
+      !write_profile_file(prefix + ".folded", this->profiler, true)) {
+    return false;
+  }
+
+  std::cout << "profile:      " << prefix << ".json, " << prefix
+            << ".folded\n";
+  return true;
+}
+
+void HeadlessRunner::report_rewind(RewindBuffer& rewind) {
+  const u32 frames = rewind.get_frame_count();
+  const u64 bytes = rewind.get_used_bytes();
+  std::cout << "rewind:       " << frames << " frames in " << bytes
+            << " bytes (" << (frames > 0 ? bytes / (frames + 1) : bytes)
+            << " per frame, " << sizeof(Chip8State) << " per state)\n";
+
+  // Step back through the whole history (this empties the buffer)
+  Chip8State state;
+  const auto start = std::chrono::steady_clock::now();
+  while (rewind.step_back(state)) {
+  }
+  const auto end = std::chrono::steady_clock::now();
+  if (frames > 0) {
+    std::cout << "step back:    "
+              << std::chrono::duration<double, std::nano>(end - start).count() /
+                     frames
+              << " ns per frame\n";
+  }
+}
+
+void HeadlessRunner::report_audio() {
+  AudioRing& ring = this->audio.get_ring();
+  std::cout << "audio:        " << this->audio_sink.get_samples()
+            << " samples (" << this->audio_sink.get_tone_samples()
+            << " tone) at " << this->audio.get_settings().sample_rate
+            << " Hz, " << ring.get_overruns() << " overruns, "
+            << ring.get_underruns() << " underruns\n"
+            << "audio hash:   " << std::hex << this->audio_sink.get_hash()
+            << std::dec << '\n';
+}
@@ -4,7 +4,11 @@
 */
 
 #include <iostream>
+#include <limits>
+#include <string>
 
+#include "chip8/arguments.h"
+#include "headless/runner.h"
 #include "virtual-machine.h"
 
 VirtualMachine virtual_machine;
@@ -14,7 +18,9 @@ void main_loop() { virtual_machine.run(); }
 
 extern "C" {
 // Wrap in extern C to prevent C++ name mangling
-void load_game(char* data) { virtual_machine.flash_program(data); }
+void load_game(char* data, u32 size) {
+  virtual_machine.flash_program(data, size);
+}
 void change_game_color(u8 red, u8 green, u8 blue) {
   virtual_machine.change_game_color(red, green, blue);
 }
@@ -22,13 +28,111 @@ void change_game_color(u8 red, u8 green, u8 blue) {
 
 int main(int argc, char** argv) {
   if (argc < 2) {
-    printf("Usage: chip-8 chip8application\n\n");
+    printf(
+        "Usage: chip-8 [--ips N] [--seed N] [--quirks Q] [--record F] "
+        "[--trace F]\n"
+        "              [--volume PERCENT] [--audio-latency MS] "
+        "[--audio-buffer N]\n"
+        "              [--keys KEYS] [--buttons KEYS] [--measure-latency] "
+        "chip8application\n");
+    printf("       chip-8 --headless [options] chip8application\n\n");
     return 1;
   }
 
+  // Run without window, input and frame limiter
+  if (std::string(argv[1]) == "--headless") {
+    HeadlessOptions options;
+    if (!HeadlessRunner::parse_arguments(argc - 1, argv + 1, options)) {
+      HeadlessRunner::print_usage("chip-8 --headless");
+      return 1;
+    }
+
+    HeadlessRunner runner(options);
+    return runner.load_program() ? runner.run() : 1;
+  }
+
+  // Instructions per second (default 600, 10 per 60 Hz frame), the seed
+  // of the random numbers (default: from the clock), the quirk profile
+  // (default: quirks.txt next to the program), the movie file, the file
+  // of the binary trace, the sound output (see AudioSettings), the input
+  // mapping (see InputMap) and the measurement of the input latency
+  int program_argument = 1;
+  while (program_argument + 1 < argc) {
+    const std::string option = argv[program_argument];
+    if (option == "--measure-latency") {
+      virtual_machine.measure_input_latency();
+      program_argument++;
+      continue;
+    }
+    if (program_argument + 2 >= argc) {
+      break;
+    }
+
+    const std::string value = argv[program_argument + 1];
+    if (option == "--ips") {
+      u32 instructions_per_second;
+      if (!parse_option(option, value, instructions_per_second, 1)) {
+        return 1;
+      }
+      virtual_machine.set_instructions_per_second(instructions_per_second);
+    } else if (option == "--seed") {
+      u64 seed;
+      if (!parse_option(option, value, seed, 0,
+                        std::numeric_limits<u64>::max(), 0)) {
+        return 1;
+      }
+      virtual_machine.set_random_seed(seed);
+    } else if (option == "--quirks") {
+      Chip8Quirks quirks;
+      if (!Chip8::parse_quirks(argv[program_argument + 1], quirks)) {
+        std::cerr << "Unknown quirk profile: " << argv[program_argument + 1]
+                  << '\n';
+        return 1;
+      }
+      virtual_machine.set_quirks(quirks);
+    } else if (option == "--record") {
+      virtual_machine.record_movie(argv[program_argument + 1]);
+    } else if (option == "--trace") {
+      virtual_machine.set_trace_file(argv[program_argument + 1]);
+    } else if (option == "--volume") {
+      u32 percent;
+      if (!parse_option(option, value, percent, 0, 100)) {
+        return 1;
+      }
+      virtual_machine.set_volume(percent);
+    } else if (option == "--audio-latency") {
+      u32 milliseconds;
+      if (!parse_option(option, value, milliseconds, 1, 10000)) {
+        return 1;
+      }
+      virtual_machine.set_audio_latency(milliseconds);
+    } else if (option == "--audio-buffer") {
+      // The samples of an SDL_AudioSpec are a Uint16
+      u32 samples;
+      if (!parse_option(option, value, samples, 1, 65535)) {
+        return 1;
+      }
+      virtual_machine.set_audio_buffer(samples);
+    } else if (option == "--keys") {
+      if (!virtual_machine.set_keys(argv[program_argument + 1])) {
+        std::cerr << "--keys needs the 16 host keys of the keys 0 - F\n";
+        return 1;
+      }
+    } else if (option == "--buttons") {
+      if (!virtual_machine.set_buttons(argv[program_argument + 1])) {
+        std::cerr << "--buttons needs a key (0 - F or -) for each of the 15 "
+                     "controller buttons\n";
+        return 1;
+      }
+    } else {
+      break;
+    }
+    program_argument += 2;
+  }
+
   bool initSucceeded = virtual_machine.boot();
 
-  if (!virtual_machine.load_program(argv[1])) {
+  if (!virtual_machine.load_program(argv[program_argument])) {
     return 1;
   };
 
@@ -0,0 +1,25 @@
+#include <iostream>
+#include <string>
+
+#include "recompiler/recompiler.h"
+
+int main(int argc, char** argv) {
+  if (argc != 4 || std::string(argv[2]) != "-o") {
+    std::cout << "Usage: " << argv[0] << " chip8application -o output.cpp\n";
+    return 1;
+  }
+
+  Recompiler recompiler;
+  if (!recompiler.load_program(argv[1])) {
+    return 1;
+  }
+
+  recompiler.discover();
+  if (!recompiler.write_source(argv[3])) {
+    return 1;
+  }
+
+  std::cout << argv[1] << ": " << recompiler.get_block_count()
+            << " blocks written to " << argv[3] << '\n';
+  return 0;
+}
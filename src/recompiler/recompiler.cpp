@@ -0,0 +1,376 @@
+#include "recompiler/recompiler.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "chip8/rom.h"
+
+const u16 PROGRAM_START = 0x200;
+
+static std::string hex(u32 value, int digits) {
+  std::ostringstream text;
+  text << "0x" << std::uppercase << std::hex << std::setw(digits)
+       << std::setfill('0') << value;
+  return text.str();
+}
+
+Recompiler::Recompiler() { this->memory.fill(0); }
+
+bool Recompiler::load_program(const std::string& filename) {
+  RomFile file;
+  if (!file.open(filename)) {
+    return false;
+  }
+
+  this->rom.assign(file.get_data(), file.get_data() + file.get_size());
+
+  std::copy(this->rom.begin(), this->rom.end(),
+            this->memory.begin() + PROGRAM_START);
+
+  // Name of the program: file name without directory and extension
+  const size_t slash = filename.find_last_of("/\\");
+  this->program_name =
+      filename.substr(slash == std::string::npos ? 0 : slash + 1);
+  this->program_name =
+      this->program_name.substr(0, this->program_name.find_last_of('.'));
+  return true;
+}
+
+void Recompiler::discover() {
+  std::vector<u16> pending = {PROGRAM_START};
+  std::array<bool, 4096> visited{};
+
+  while (!pending.empty()) {
+    const u16 start = pending.back();
+    pending.pop_back();
+    if (start < PROGRAM_START || start > 0x0FFE || visited[start]) {
+      continue;
+    }
+    visited[start] = true;
+
+    RecompiledBlock block = {start, start, 0, false};
+    u16 address = start;
+    bool ended = false;
+    while (!ended && block.cycles < MAXIMUM_BLOCK_SIZE && address < 0x0FFF) {
+      const Instruction& instruction = Decoder::decode(this->get_opcode(address));
+
+      // Unknown opcodes (or data) are left to the Interpreter
+      if (instruction.operation == kUnknown) {
+        break;
+      }
+
+      block.cycles++;
+      address += 2;
+
+      switch (instruction.operation) {
+        case kSkipIfEqual:
+        case kSkipIfNotEqual:
+        case kSkipIfVxEqualVy:
+        case kSkipIfVxNotEqualVy:
+        case kSkipIfKeyPressed:
+        case kSkipIfKeyNotPressed:
+          // The block continues with the next instruction, the skip leaves it
+          pending.push_back(address + 2);
+          break;
+        case kJumpToLocation:
+          pending.push_back(instruction.nnn);
+          block.loops = instruction.nnn == start;
+          ended = true;
+          break;
+        case kCallSubroutine:
+          pending.push_back(instruction.nnn);
+          pending.push_back(address);
+          ended = true;
+          break;
+        case kReturnFromSubroutine:
+        case kJumpToExtendedLocation:
+          ended = true;
+          break;
+        case kWaitForKeyPressed:
+        case kStoreBinaryCodedDecimal:
+        case kStoreRegisters:
+          // Fx33 and Fx55 may modify code, the AotEngine checks the written
+          // memory before the next block
+          pending.push_back(address);
+          ended = true;
+          break;
+        default:
+          break;
+      }
+    }
+
+    if (!ended && block.cycles == MAXIMUM_BLOCK_SIZE) {
+      pending.push_back(address);
+    }
+
+    if (block.cycles > 0) {
+      block.end_address = address;
+      this->blocks[start] = block;
+    }
+  }
+}
+
+bool Recompiler::write_source(const std::string& filename) {
+  std::ofstream out(filename);
+  if (!out) {
+    std::cerr << "Unable to write: " << filename << '\n';
+    return false;
+  }
+
+  out << "// Generated by chip8-recompile from " << this->program_name
+      << ", do not edit.\n\n"
+      << "#include \"chip8/aot.h\"\n\n";
+
+  out << "static const u8 ROM[] = {";
+  for (size_t i = 0; i < this->rom.size(); i++) {
+    out << (i % 12 == 0 ? "\n    " : " ") << hex(this->rom[i], 2) << ',';
+  }
+  out << "\n};\n";
+
+  for (const auto& entry : this->blocks) {
+    out << '\n';
+    this->write_block(out, entry.second);
+  }
+
+  out << "\nstatic const AotBlock BLOCKS[] = {\n";
+  for (const auto& entry : this->blocks) {
+    const RecompiledBlock& block = entry.second;
+    out << "    {" << hex(block.start_address, 3) << ", "
+        << hex(block.end_address, 3) << ", " << block.cycles << ", block_"
+        << hex(block.start_address, 3).substr(2) << "},\n";
+  }
+  out << "};\n\n";
+
+  out << "static const bool REGISTERED = AotEngine::register_program(\n"
+      << "    {\"" << this->program_name << "\", ROM, sizeof(ROM), BLOCKS,\n"
+      << "     sizeof(BLOCKS) / sizeof(BLOCKS[0])});\n";
+
+  return static_cast<bool>(out);
+}
+
+u16 Recompiler::get_opcode(u16 address) {
+  return this->memory[address] << 8 | this->memory[address + 1];
+}
+
+void Recompiler::write_block(std::ostream& out, const RecompiledBlock& block) {
+  // The timers are decremented after every instruction. Generated code only
+  // calls tick before interpreted instructions and when leaving the block,
+  // applied counts the instructions of the current pass already ticked.
+  const std::string indent = block.loops ? "    " : "  ";
+  const std::string executed = block.loops ? "executed + " : "";
+  u16 applied = 0;
+
+  auto leave = [&](const std::string& indent, const std::string& next,
+                   u16 cycles) {
+    if (cycles > applied) {
+      out << indent << "c.tick(" << cycles - applied << ");\n";
+    }
+    if (!next.empty()) {
+      out << indent << "c.program_counter = " << next << ";\n";
+    }
+    out << indent << "return " << executed << cycles << ";\n";
+  };
+
+  // The Interpreter halts the Chip8 at an instruction that faults (see
+  // Chip8Fault), without counting it
+  auto fault_if = [&](const std::string& condition, u16 address, u16 cycles) {
+    out << indent << "if (" << condition << ") {\n";
+    if (cycles > applied) {
+      out << indent << "  c.tick(" << cycles - applied << ");\n";
+    }
+    out << indent << "  c.interpret(" << hex(address, 3) << ");\n"
+        << indent << "  return " << executed << cycles << ";\n"
+        << indent << "}\n";
+  };
+
+  auto skip = [&](const std::string& condition, u16 address, u16 cycles) {
+    out << indent << "if (" << condition << ") {\n";
+    leave(indent + "  ", hex(address + 4, 3), cycles);
+    out << indent << "}\n";
+  };
+
+  out << "static u32 block_" << hex(block.start_address, 3).substr(2)
+      << "(AotContext& c, u32 budget) {\n";
+  if (block.loops) {
+    out << "  u32 executed = 0;\n"
+        << "  for (;;) {\n";
+  } else {
+    out << "  (void)budget;\n";
+  }
+
+  u16 address = block.start_address;
+  for (u16 i = 0; i < block.cycles; i++, address += 2) {
+    const u16 opcode = this->get_opcode(address);
+    const Instruction& instruction = Decoder::decode(opcode);
+    const std::string vx = "c.v[" + hex(instruction.x, 1) + "]";
+    const std::string vy = "c.v[" + hex(instruction.y, 1) + "]";
+    const std::string nn = hex(instruction.nn, 2);
+    const std::string nnn = hex(instruction.nnn, 3);
+
+    out << indent << "// " << hex(address, 3) << ": " << hex(opcode, 4)
+        << '\n';
+
+    if (is_interpreted(instruction.operation)) {
+      if (i > applied) {
+        out << indent << "c.tick(" << i - applied << ");\n";
+      }
+      out << indent << "c.interpret(" << hex(address, 3) << ");\n";
+      applied = i + 1;
+    }
+
+    switch (instruction.operation) {
+      case kReturnFromSubroutine:
+        fault_if("c.stack_pointer == 0", address, i);
+        leave(indent, "c.stack[--c.stack_pointer]", i + 1);
+        break;
+      case kJumpToLocation:
+        if (!block.loops) {
+          leave(indent, nnn, i + 1);
+        }
+        break;
+      case kCallSubroutine:
+        fault_if("c.stack_pointer == 16", address, i);
+        out << indent << "c.stack[c.stack_pointer++] = "
+            << hex(address + 2, 3) << ";\n";
+        leave(indent, nnn, i + 1);
+        break;
+      case kSkipIfEqual:
+        skip(vx + " == " + nn, address, i + 1);
+        break;
+      case kSkipIfNotEqual:
+        skip(vx + " != " + nn, address, i + 1);
+        break;
+      case kSkipIfVxEqualVy:
+        skip(vx + " == " + vy, address, i + 1);
+        break;
+      case kSkipIfVxNotEqualVy:
+        skip(vx + " != " + vy, address, i + 1);
+        break;
+      case kSetVx:
+        out << indent << vx << " = " << nn << ";\n";
+        break;
+      case kAddToVx:
+        out << indent << vx << " += " << nn << ";\n";
+        break;
+      case kLoadVyInVx:
+        out << indent << vx << " = " << vy << ";\n";
+        break;
+      case kOrVxVy:
+        out << indent << vx << " |= " << vy << ";\n";
+        break;
+      case kAndVxVy:
+        out << indent << vx << " &= " << vy << ";\n";
+        break;
+      case kXorVxVy:
+        out << indent << vx << " ^= " << vy << ";\n";
+        break;
+      case kAddVyToVx:
+        out << indent << "{\n"
+            << indent << "  const u16 sum = " << vy << " + " << vx << ";\n"
+            << indent << "  c.v[0xF] = sum > 255;\n"
+            << indent << "  " << vx << " = sum & 0xFF;\n"
+            << indent << "}\n";
+        break;
+      case kSubtractVyFromVx:
+        out << indent << "c.v[0xF] = " << vx << " > " << vy << ";\n"
+            << indent << vx << " -= " << vy << ";\n";
+        break;
+      case kShiftRight:
+        out << indent << "c.v[0xF] = " << vx << " & 0x1;\n"
+            << indent << vx << " >>= 1;\n";
+        break;
+      case kSetVxToVyMinusVx:
+        out << indent << "c.v[0xF] = " << vy << " > " << vx << ";\n"
+            << indent << vx << " = " << vy << " - " << vx << ";\n";
+        break;
+      case kShiftLeft:
+        out << indent << "c.v[0xF] = " << vx << " >> 7;\n"
+            << indent << vx << " <<= 1;\n";
+        break;
+      case kSetIndexRegister:
+        out << indent << "c.index_register = " << nnn << ";\n";
+        break;
+      case kJumpToExtendedLocation:
+        leave(indent, "c.v[0x0] + " + nnn, i + 1);
+        break;
+      case kSkipIfKeyPressed:
+        skip("c.is_key_pressed(" + vx + ")", address, i + 1);
+        break;
+      case kSkipIfKeyNotPressed:
+        skip("!c.is_key_pressed(" + vx + ")", address, i + 1);
+        break;
+      case kSetVxToDelayTimer:
+        out << indent << vx << " = c.get_delay_timer(" << i - applied
+            << ");\n";
+        break;
+      case kAddVxToI:
+        out << indent << "c.index_register += " << vx << ";\n";
+        break;
+      case kSetIToSpriteCharacter:
+        out << indent << "c.index_register = " << vx << " * 5;\n";
+        break;
+      case kWaitForKeyPressed:
+      case kStoreBinaryCodedDecimal:
+      case kStoreRegisters:
+        // The Interpreter already set the program counter
+        leave(indent, "", i + 1);
+        break;
+      default:
+        break;
+    }
+  }
+
+  if (block.loops) {
+    // Run the block again as long as a whole pass fits into the budget
+    if (block.cycles > applied) {
+      out << indent << "c.tick(" << block.cycles - applied << ");\n";
+    }
+    out << indent << "executed += " << block.cycles << ";\n"
+        << indent << "if (executed + " << block.cycles << " > budget) {\n"
+        << indent << "  c.program_counter = " << hex(block.start_address, 3)
+        << ";\n"
+        << indent << "  return executed;\n"
+        << indent << "}\n"
+        << "  }\n";
+  } else {
+    const Operation last = Decoder::decode(this->get_opcode(address - 2)).operation;
+    const bool left = last == kReturnFromSubroutine ||
+                      last == kJumpToLocation || last == kCallSubroutine ||
+                      last == kJumpToExtendedLocation ||
+                      last == kWaitForKeyPressed ||
+                      last == kStoreBinaryCodedDecimal ||
+                      last == kStoreRegisters;
+    if (!left) {
+      leave(indent, hex(address, 3), block.cycles);
+    }
+  }
+
+  out << "}\n";
+}
+
+bool Recompiler::is_interpreted(Operation operation) {
+  switch (operation) {
+    case kClearScreen:
+    case kGenerateRandomNumber:
+    case kDrawSprite:
+    case kWaitForKeyPressed:
+    case kSetDelayTimer:
+    case kSetSoundTimer:
+    case kStoreBinaryCodedDecimal:
+    case kStoreRegisters:
+    case kLoadRegisters:
+    case kScrollDown:
+    case kScrollUp:
+    case kScrollRight:
+    case kScrollLeft:
+    case kLowResolution:
+    case kHighResolution:
+    case kDrawLargeSprite:
+    case kSelectPlanes:
+      return true;
+    default:
+      return false;
+  }
+}
@@ -0,0 +1,59 @@
+#include "sdl/audio.h"
+
+#include <algorithm>
+#include <iostream>
+
+AudioDevice::AudioDevice(AudioGenerator& generator)
+    : ring(generator.get_ring()),
+      settings(generator.get_settings()),
+      device(0),
+      start_level(generator.get_settings().get_latency_samples() / 2),
+      playing(false) {}
+
+AudioDevice::~AudioDevice() {
+  if (this->device != 0) {
+    SDL_CloseAudioDevice(this->device);
+  }
+}
+
+bool AudioDevice::open() {
+  SDL_AudioSpec desired = {};
+  desired.freq = this->settings.sample_rate;
+  desired.format = AUDIO_S16SYS;
+  desired.channels = 1;
+  desired.samples = this->settings.device_samples;
+  desired.callback = AudioDevice::callback;
+  desired.userdata = this;
+
+  // No changes allowed: SDL converts if the device differs, so the
+  // generator keeps its sample rate
+  this->device = SDL_OpenAudioDevice(nullptr, 0, &desired, nullptr, 0);
+  if (this->device == 0) {
+    std::cerr << "Unable to open the audio device: " << SDL_GetError()
+              << '\n';
+    return false;
+  }
+  SDL_PauseAudioDevice(this->device, 0);
+  return true;
+}
+
+void AudioDevice::callback(void* userdata, Uint8* stream, int length) {
+  static_cast<AudioDevice*>(userdata)->fill(reinterpret_cast<i16*>(stream),
+                                           length / sizeof(i16));
+}
+
+void AudioDevice::fill(i16* samples, u32 count) {
+  if (!this->playing && this->ring.get_size() >= this->start_level) {
+    this->playing = true;
+  }
+
+  u32 copied = 0;
+  if (this->playing) {
+    copied = this->ring.read(samples, count);
+    if (copied < count) {
+      this->ring.record_underrun();
+      this->playing = false;
+    }
+  }
+  std::fill(samples + copied, samples + count, 0);
+}
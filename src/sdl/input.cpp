@@ -0,0 +1,45 @@
+#include "sdl/input.h"
+
+#include <cctype>
+
+// Movement on the d-pad and the usual action keys on the buttons
+static const char DEFAULT_KEYS[] = "x123qweasdzc4rfv";
+static const char DEFAULT_BUTTONS[] = "5640--F--792846";
+
+InputMap::InputMap() {
+  this->set_keys(DEFAULT_KEYS);
+  this->set_buttons(DEFAULT_BUTTONS);
+}
+
+bool InputMap::set_keys(const std::string& keys) {
+  if (keys.size() != 16) {
+    return false;
+  }
+
+  // Printable keys have the lower case character as key code
+  this->keys.clear();
+  for (u8 key = 0; key < keys.size(); key++) {
+    this->keys[std::tolower(static_cast<unsigned char>(keys[key]))] = key;
+  }
+  return true;
+}
+
+bool InputMap::set_buttons(const std::string& buttons) {
+  if (buttons.size() != this->buttons.size()) {
+    return false;
+  }
+
+  std::array<u8, SDL_CONTROLLER_BUTTON_MAX> map;
+  for (size_t button = 0; button < buttons.size(); button++) {
+    const char digit = buttons[button];
+    if (digit == '-') {
+      map[button] = NO_KEY;
+    } else if (std::isxdigit(static_cast<unsigned char>(digit))) {
+      map[button] = std::stoi(std::string(1, digit), nullptr, 16);
+    } else {
+      return false;
+    }
+  }
+  this->buttons = map;
+  return true;
+}
@@ -1,14 +1,23 @@
 
 #include "sdl/renderer.h"
 
+#include <cstring>
+
 #include "chip8/display.h"
 
 Renderer::Renderer(WindowProperties const &properties)
-    : window_properties(properties), window(nullptr), renderer(nullptr) {}
+    : window(nullptr),
+      renderer(nullptr),
+      window_properties(properties),
+      screen(nullptr),
+      grid(nullptr),
+      texture_width(0),
+      expand_all_rows(true) {}
 
 Renderer::~Renderer() {
-  SDL_DestroyWindow(window);
+  this->destroy_textures();
   SDL_DestroyRenderer(renderer);
+  SDL_DestroyWindow(window);
   SDL_Quit();
 }
 
@@ -50,43 +59,121 @@ bool Renderer::initialize() {
 }
 
 void Renderer::draw(Display &display) {
-  // Clear the screen
-  SDL_SetRenderDrawColor(this->renderer, 0, 0, 0, 0xff);
-  SDL_RenderClear(this->renderer);
-
-  // Loop through the display and draw pixels
-  for (int y = 0; y < display.get_height(); y++) {
-    for (int x = 0; x < display.get_width(); x++) {
-      if (display[x + (y * display.get_width())]) {
-        draw_pixel(x, y, display.get_scale());
-      }
-    }
+  // Nothing to present if no row changed since the last frame
+  u64 dirty_rows = display.get_dirty_rows();
+  if (dirty_rows == 0 && !this->expand_all_rows) {
+    return;
   }
+  display.clear_dirty_rows();
 
-  // Draw Grid
-  SDL_SetRenderDrawColor(this->renderer, this->grid_line_color.r,
-                         this->grid_line_color.g, this->grid_line_color.b,
-                         this->grid_line_color.a);
+  // The textures have one texel per pixel of the current resolution
+  const int width = display.get_width();
+  const int height = display.get_height();
+  if (this->screen != nullptr && this->texture_width != width) {
+    this->destroy_textures();
+  }
+  if (this->screen == nullptr && !this->create_textures(display)) {
+    return;
+  }
 
-  for (int x = 0; x < 1 + display.get_width() * display.get_scale();
-       x += display.get_scale()) {
-    SDL_RenderDrawLine(this->renderer, x, 0, x, window_properties.height);
+  if (this->expand_all_rows) {
+    dirty_rows = ~0ull;
+    this->expand_all_rows = false;
+  }
+  for (int y = 0; y < height; y++) {
+    if (dirty_rows & (1ull << y)) {
+      this->expand_row(display, y, &this->frame[y * width]);
+    }
   }
 
-  for (int y = 0; y < 1 + display.get_height() * display.get_scale();
-       y += display.get_scale()) {
-    SDL_RenderDrawLine(this->renderer, 0, y, window_properties.width, y);
+  void *pixels;
+  int pitch;
+  if (SDL_LockTexture(this->screen, nullptr, &pixels, &pitch) != 0) {
+    return;
+  }
+  for (int y = 0; y < height; y++) {
+    std::memcpy(static_cast<u8 *>(pixels) + y * pitch, &this->frame[y * width],
+                width * sizeof(u32));
   }
+  SDL_UnlockTexture(this->screen);
 
+  // The copy scales the framebuffer to the window, the grid is blended over
+  SDL_RenderCopy(this->renderer, this->screen, nullptr, nullptr);
+  SDL_RenderCopy(this->renderer, this->grid, nullptr, nullptr);
   SDL_RenderPresent(this->renderer);
 }
 
-void Renderer::draw_pixel(int x, int y, int scale) {
-  SDL_SetRenderDrawColor(this->renderer, this->pixel_color.r,
-                         this->pixel_color.g, this->pixel_color.b,
-                         this->pixel_color.a);
+bool Renderer::create_textures(Display &display) {
+  const int width = display.get_width();
+  const int height = display.get_height();
+  const int scale = display.get_scale();
+
+  this->screen =
+      SDL_CreateTexture(this->renderer, SDL_PIXELFORMAT_ARGB8888,
+                        SDL_TEXTUREACCESS_STREAMING, width, height);
+  if (this->screen == nullptr) {
+    printf("SDL_CreateTexture failed: %s\n", SDL_GetError());
+    return false;
+  }
+  this->frame.assign(width * height, 0);
+  this->texture_width = width;
+  this->expand_all_rows = true;
+
+  // Grid lines every scale pixels of the window, transparent in between
+  const int grid_width = width * scale;
+  const int grid_height = height * scale;
+  this->grid = SDL_CreateTexture(this->renderer, SDL_PIXELFORMAT_ARGB8888,
+                                 SDL_TEXTUREACCESS_STATIC, grid_width,
+                                 grid_height);
+  if (this->grid == nullptr) {
+    printf("SDL_CreateTexture failed: %s\n", SDL_GetError());
+    return false;
+  }
+  const u32 line = to_argb(this->grid_line_color);
+  std::vector<u32> overlay(grid_width * grid_height, 0);
+  for (int y = 0; y < grid_height; y++) {
+    for (int x = 0; x < grid_width; x++) {
+      if (x % scale == 0 || y % scale == 0) {
+        overlay[y * grid_width + x] = line;
+      }
+    }
+  }
+  SDL_UpdateTexture(this->grid, nullptr, overlay.data(),
+                    grid_width * sizeof(u32));
+  SDL_SetTextureBlendMode(this->grid, SDL_BLENDMODE_BLEND);
+
+  return true;
+}
+
+void Renderer::destroy_textures() {
+  if (this->grid != nullptr) {
+    SDL_DestroyTexture(this->grid);
+    this->grid = nullptr;
+  }
+  if (this->screen != nullptr) {
+    SDL_DestroyTexture(this->screen);
+    this->screen = nullptr;
+  }
+}
+
+void Renderer::expand_row(Display &display, int y, u32 *texels) {
+  // Color of each combination of the two planes
+  const u32 colors[4] = {to_argb({0, 0, 0, 0xFF}), to_argb(this->pixel_color),
+                         to_argb(this->second_plane_color),
+                         to_argb(this->both_planes_color)};
+  const int width = display.get_width();
+  for (int word = 0; word * 64 < width; word++) {
+    const u64 first = display.get_row(y, word, 0);
+    const u64 second = display.get_row(y, word, 1);
+    for (int bit = 0; bit < 64 && word * 64 + bit < width; bit++) {
+      const int shift = 63 - bit;
+      texels[word * 64 + bit] =
+          colors[(first >> shift & 1u) | (second >> shift & 1u) << 1];
+    }
+  }
+}
 
-  SDL_Rect rect{x * scale, y * scale, scale, scale};
-  SDL_RenderDrawRect(this->renderer, &rect);
-  SDL_RenderFillRect(this->renderer, &rect);
+u32 Renderer::to_argb(SDL_Color color) {
+  return static_cast<u32>(color.a) << 24 | static_cast<u32>(color.r) << 16 |
+         static_cast<u32>(color.g) << 8 | color.b;
 }
@@ -4,103 +4,444 @@
 #include <emscripten.h>
 */
 
-#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <csignal>
 #include <iostream>
 #include <vector>
 
-VirtualMachine::VirtualMachine() : is_running(false) {
+// Nanoseconds of the steady clock, the time base of the input latency
+static u64 get_timestamp() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+VirtualMachine::VirtualMachine()
+    : is_running(false),
+      scheduler(chip8),
+      program_index(0),
+      automatic_quirks(true),
+      quirks(kDefaultQuirks),
+      program_hash(0),
+      audio(nullptr),
+      audio_device(nullptr),
+      published_displays(0),
+      rendered_display(0),
+      measuring_latency(false),
+      input_timestamp(0) {
   Display display = this->chip8.get_display();
   const int DISPLAY_WIDTH = display.get_width() * display.get_scale();
   const int DISPLAY_HEIGHT = display.get_height() * display.get_scale();
 
   this->renderer =
       new Renderer({"CHIP-8 interpreter", DISPLAY_WIDTH, DISPLAY_HEIGHT});
+
+  this->scheduler.set_rewind_buffer(&this->rewind);
+  this->scheduler.set_idle_waiting(true);
+
+  // The game runs at a few hundred instructions per second, which the
+  // interpreter appending to the trace easily keeps up with
+  this->chip8.set_trace(&this->trace);
+#ifdef SIGUSR1
+  ExecutionTrace::request_dump_on_signal(SIGUSR1);
+#endif
+
+  // Every game starts differently unless a seed is given (see --seed)
+  this->set_random_seed(
+      std::chrono::system_clock::now().time_since_epoch().count());
 }
 
 VirtualMachine::~VirtualMachine() {
-  // free up memories
+  // free up memories (the emulation and the audio device stop before SDL
+  // quits)
+  this->shutdown_systems();
   delete this->renderer;
 }
 
-bool VirtualMachine::boot() { return renderer->initialize(); }
+bool VirtualMachine::boot() {
+  if (!renderer->initialize()) {
+    return false;
+  }
+
+  // Without an audio device the emulation runs silently
+  if (this->audio_settings.amplitude > 0) {
+    this->audio = new AudioGenerator(this->audio_settings);
+    this->audio_device = new AudioDevice(*this->audio);
+    if (this->audio_device->open()) {
+      this->chip8.set_audio(this->audio);
+    } else {
+      delete this->audio_device;
+      delete this->audio;
+      this->audio_device = nullptr;
+      this->audio = nullptr;
+    }
+  }
+  return true;
+}
 
 bool VirtualMachine::load_program(const std::string& program_file) {
   ToggleState(kRomLoading);  // Turn on rom loading state
 
-  std::ifstream rom(program_file);
-  if (!rom) return false;
-
-  rom.seekg(0, std::ios::end);
-  const int kSize = rom.tellg();
-  rom.seekg(0, std::ios::beg);
-
-  // Read rom data into a temporary buffer
-  std::vector<char> buffer;
-  buffer.reserve(kSize);
-  buffer.insert(buffer.begin(), std::istreambuf_iterator<char>(rom),
-                std::istreambuf_iterator<char>());
+  // The programs next to it are read once, switching between them and
+  // restarting them copies from the library without any file I/O
+  const size_t slash = program_file.find_last_of("/\\");
+  if (this->library.get_entries().empty()) {
+    this->library.add_directory(
+        slash == std::string::npos ? "." : program_file.substr(0, slash));
+  }
+  const RomEntry* entry = this->library.find_name(
+      program_file.substr(slash == std::string::npos ? 0 : slash + 1));
+  if (entry == nullptr) {
+    entry = this->library.add_file(program_file);
+  }
+  if (entry == nullptr) return false;
 
   ToggleState(kRomLoading);  // Turn off rom loading state
-  flash_program(buffer.data());
+  this->program_index = entry - this->library.get_entries().data();
+  return this->flash_entry(*entry);
+}
 
-  return true;
+bool VirtualMachine::flash_entry(const RomEntry& entry) {
+  this->chip8.set_quirks(this->automatic_quirks ? entry.quirks
+                                                : this->quirks);
+  if (this->chip8.get_quirks() != kDefaultQuirks) {
+    std::cout << "Quirks: " << Chip8::get_quirks_name(this->chip8.get_quirks())
+              << '\n';
+  }
+  return this->flash_program(this->library.get_data(entry), entry.size);
 }
 
-void VirtualMachine::flash_program(char* data) {
+bool VirtualMachine::flash_program(const void* data, u32 size) {
   if (CheckState(kRomLoaded)) {
     // Rom is already loaded, reset state
     ToggleState(kRomLoaded);
     this->chip8.reset();
   }
+  this->rewind.clear();
+  this->trace.clear();
 
-  this->chip8.save_rom(data);
+  if (!this->chip8.save_rom(data, size)) {
+    return false;
+  }
+  this->program_hash = RomLibrary::get_hash(data, size);
   ToggleState(kRomLoaded);
+  return true;
 }
 
-void VirtualMachine::disassemble_program(char* data) {
-  this->disassembler.load_program(data);
+void VirtualMachine::switch_program(int step) {
+  // A movie covers one run of one program
+  if (!this->movie_file.empty()) {
+    std::cerr << "The program can not be changed while recording a movie\n";
+    return;
+  }
+
+  const std::vector<RomEntry>& entries = this->library.get_entries();
+  const int count = entries.size();
+  this->program_index = ((this->program_index + step) % count + count) % count;
+  const RomEntry& entry = entries[this->program_index];
+  std::cout << "Program: " << entry.name << '\n';
+  this->flash_entry(entry);
+}
+
+void VirtualMachine::disassemble_program(const void* data, u32 size) {
+  this->disassembler.load_program(data, size, "program");
+  this->disassembler.analyze();
+  BufferedWriter out(stdout);
+  this->disassembler.write_listing(out);
 }
 
 void VirtualMachine::run() {
   this->is_running = true;
+  this->emulation_thread = std::thread(&VirtualMachine::emulate, this);
+
+  while (this->is_running) {
+    this->process_input();
+
+    // The newest display, the ones published in between were skipped and
+    // their changed rows are unknown
+    if (this->displays.update()) {
+      DisplayFrame& frame = this->displays.get_front();
+      if (frame.number != this->rendered_display + 1) {
+        frame.display.mark_all_rows_dirty();
+      }
+      this->rendered_display = frame.number;
+      this->renderer->draw(frame.display);
+      if (this->measuring_latency && frame.input_timestamp != 0) {
+        const u64 now = get_timestamp();
+        this->input_latencies_ms.push_back((now - frame.input_timestamp) /
+                                           1e6);
+      }
+    }
+
+    // Until the next input event, at most a quarter of a frame
+    SDL_WaitEventTimeout(nullptr, 4);
+  }
+}
+
+void VirtualMachine::emulate() {
+  this->scheduler.set_mode(kRealTimeMode);
+  if (!this->movie_file.empty()) {
+    this->movie.start(this->program_hash, this->chip8.get_random_seed(),
+                      this->scheduler.get_instructions_per_frame(),
+                      this->chip8.get_quirks());
+  }
 
   while (this->is_running && (kRomLoaded) && !CheckState(kRomLoading)) {
-    this->frame_start = SDL_GetTicks();
+    // The input polled since the last frames, then the frames that are due
+    KeyEvent event;
+    while (this->key_events.pop(event)) {
+      this->handle_key_event(event);
+    }
+
+    this->scheduler.run_frames();
+    if (this->scheduler.is_rewinding()) {
+      // The input after the rewound frames never happened
+      this->movie.rewind(this->chip8.get_cycles());
+      this->trace.clear();
+    }
+    if (ExecutionTrace::take_dump_request()) {
+      this->write_trace();
+    }
+    if (this->chip8.get_fault() != kNoFault) {
+      this->report_fault();
+      break;
+    }
 
-    this->chip8.cycle();
     if (this->chip8.get_draw_flag()) {
-      this->renderer->draw(this->chip8.get_display());
+      this->publish_display();
       this->chip8.deactivate_draw_flag();
     }
 
-    this->process_input();
+    this->scheduler.wait_for_next_frame();
+  }
 
-    this->frame_time = SDL_GetTicks() - this->frame_start;
+  // Also stops the SDL thread (on a fault)
+  this->is_running = false;
+}
 
-    if (this->frame_delay > this->frame_time) {
-      SDL_Delay(this->frame_delay - this->frame_time);
-    }
+void VirtualMachine::publish_display() {
+  // The slot carries the rows changed since the last publication
+  Display& display = this->chip8.get_display();
+  DisplayFrame& frame = this->displays.get_back();
+  frame.display = display;
+  frame.number = ++this->published_displays;
+  frame.input_timestamp = this->input_timestamp;
+  this->input_timestamp = 0;
+  display.clear_dirty_rows();
+  this->displays.publish();
+}
+
+void VirtualMachine::report_statistics() {
+  const SchedulerStatistics& statistics = this->scheduler.get_statistics();
+  std::cout << "random seed:    " << this->chip8.get_random_seed() << '\n'
+            << "frames:         " << statistics.frames << '\n'
+            << "instructions:   " << statistics.instructions << '\n'
+            << "skipped frames: " << statistics.skipped_frames << '\n'
+            << "overshoot:      " << statistics.average_overshoot_ms
+            << " ms average, " << statistics.maximum_overshoot_ms
+            << " ms maximum\n"
+            << "drift:          " << statistics.drift_ms << " ms\n"
+            << "idle:           " << statistics.idle_ms << " ms\n";
+  if (this->audio != nullptr) {
+    AudioRing& ring = this->audio->get_ring();
+    std::cout << "audio:          " << ring.get_underruns() << " underruns, "
+              << ring.get_overruns() << " overruns\n";
+  }
+}
+
+void VirtualMachine::report_input_latency() {
+  std::vector<double>& latencies = this->input_latencies_ms;
+  if (latencies.empty()) {
+    std::cout << "input latency:  no key changed the display\n";
+    return;
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+  double total = 0;
+  for (double latency : latencies) {
+    total += latency;
+  }
+  std::cout << "input latency:  " << latencies.size() << " samples, "
+            << total / latencies.size() << " ms average, "
+            << latencies[latencies.size() / 2] << " ms median, "
+            << latencies[latencies.size() * 95 / 100] << " ms 95th "
+            << "percentile, " << latencies.back() << " ms maximum\n";
+}
+
+void VirtualMachine::report_fault() {
+  std::cerr << "Chip-8 halted: "
+            << Chip8::get_fault_name(this->chip8.get_fault()) << " 0x"
+            << std::hex << this->chip8.get_current_opcode()
+            << " at address 0x" << this->chip8.get_program_counter()
+            << std::dec << '\n';
+  this->write_trace();
+}
+
+void VirtualMachine::write_trace() {
+  {
+    BufferedWriter out(stderr);
+    this->trace.write_text(out, this->chip8.get_state());
+    out.flush();
+  }
+
+  if (!this->trace_file.empty() &&
+      !this->trace.write_binary(this->trace_file, this->chip8.get_state())) {
+    std::cerr << "Unable to write trace: " << this->trace_file << '\n';
   }
 }
 
 void VirtualMachine::process_input() {
   SDL_Event event;
   while (SDL_PollEvent(&event) != 0) {
-    const u8 key = event.key.keysym.sym;
     switch (event.type) {
       case SDL_QUIT:
         this->is_running = false;
         break;
       case SDL_KEYDOWN:
-        this->chip8.set_key(key, true);
+      case SDL_KEYUP: {
+        const SDL_Keycode key = event.key.keysym.sym;
+        this->push_key_event(key, this->input.get_key(key),
+                             event.type == SDL_KEYDOWN,
+                             event.key.repeat != 0);
+        break;
+      }
+      case SDL_CONTROLLERBUTTONDOWN:
+      case SDL_CONTROLLERBUTTONUP:
+        this->push_key_event(
+            0, this->input.get_button_key(event.cbutton.button),
+            event.type == SDL_CONTROLLERBUTTONDOWN, false);
+        break;
+      // Also sent for the controllers connected at startup
+      case SDL_CONTROLLERDEVICEADDED: {
+        SDL_GameController* controller =
+            SDL_GameControllerOpen(event.cdevice.which);
+        if (controller != nullptr) {
+          this->controllers.push_back(controller);
+        }
         break;
-      case SDL_KEYUP:
-        this->chip8.set_key(key, false);
+      }
+      case SDL_CONTROLLERDEVICEREMOVED: {
+        SDL_GameController* controller =
+            SDL_GameControllerFromInstanceID(event.cdevice.which);
+        for (size_t i = 0; i < this->controllers.size(); i++) {
+          if (this->controllers[i] == controller) {
+            SDL_GameControllerClose(controller);
+            this->controllers.erase(this->controllers.begin() + i);
+            break;
+          }
+        }
         break;
+      }
+    }
+  }
+}
+
+void VirtualMachine::push_key_event(SDL_Keycode key, u8 keypad_key,
+                                    bool pressed, bool repeat) {
+  this->key_events.push({key, keypad_key, pressed, repeat, get_timestamp()});
+  // A program waiting for a key blocks the emulation thread until then
+  this->scheduler.wake();
+}
+
+void VirtualMachine::handle_key_event(const KeyEvent& event) {
+  if (event.pressed) {
+    if (event.key != 0 && !event.repeat &&
+        this->process_control_key(event.key)) {
+      return;
     }
+  } else if (event.key == SDLK_BACKSPACE) {
+    this->scheduler.set_rewinding(false);
+    return;
+  }
+
+  // A held key repeats, but the keypad key is already down
+  if (event.keypad_key == InputMap::NO_KEY || event.repeat) {
+    return;
+  }
+  this->set_key(event.keypad_key, event.pressed);
+  if (this->input_timestamp == 0) {
+    this->input_timestamp = event.timestamp;
+  }
+}
+
+void VirtualMachine::set_key(u8 key, bool pressed) {
+  this->chip8.set_key(key, pressed);
+  if (!this->movie_file.empty()) {
+    this->movie.record(this->chip8.get_cycles(), key, pressed);
+  }
+}
+
+bool VirtualMachine::process_control_key(SDL_Keycode key) {
+  switch (key) {
+    // Tab: toggle turbo mode (uncapped speed)
+    case SDLK_TAB:
+      this->scheduler.set_mode(this->scheduler.get_mode() == kTurboMode
+                                   ? kRealTimeMode
+                                   : kTurboMode);
+      return true;
+    // P: pause and step frame by frame, or continue in real time
+    case SDLK_p:
+      this->scheduler.set_mode(this->scheduler.get_mode() == kFrameStepMode
+                                   ? kRealTimeMode
+                                   : kFrameStepMode);
+      return true;
+    // Space: run one frame while paused
+    case SDLK_SPACE:
+      if (this->scheduler.get_mode() != kFrameStepMode) {
+        return false;
+      }
+      this->scheduler.request_step();
+      return true;
+    // Backspace (held): run backwards through the recorded frames
+    case SDLK_BACKSPACE:
+      this->scheduler.set_rewinding(true);
+      return true;
+    // Page Down / Page Up: the next / previous program of the library
+    case SDLK_PAGEDOWN:
+      this->switch_program(1);
+      return true;
+    case SDLK_PAGEUP:
+      this->switch_program(-1);
+      return true;
+    // F5: restart the program
+    case SDLK_F5:
+      this->switch_program(0);
+      return true;
+    default:
+      return false;
   }
 }
 
 void VirtualMachine::shutdown_systems() {
-  // shutdown here
+  // The emulation thread finishes its frame, after that only this thread
+  // uses the Chip8
+  this->is_running = false;
+  this->scheduler.wake();
+  if (this->emulation_thread.joinable()) {
+    this->emulation_thread.join();
+
+    this->report_statistics();
+    if (this->measuring_latency) {
+      this->report_input_latency();
+    }
+    if (!this->movie_file.empty()) {
+      this->movie.finish(this->chip8);
+      if (!this->movie.write(this->movie_file)) {
+        std::cerr << "Unable to write movie: " << this->movie_file << '\n';
+      }
+    }
+  }
+
+  for (SDL_GameController* controller : this->controllers) {
+    SDL_GameControllerClose(controller);
+  }
+  this->controllers.clear();
+
+  // The audio callback stops before the ring it reads goes away
+  this->chip8.set_audio(nullptr);
+  delete this->audio_device;
+  delete this->audio;
+  this->audio_device = nullptr;
+  this->audio = nullptr;
 }